@@ -0,0 +1,9 @@
+#ifndef ALLOCATION_COUNTER_H
+#define ALLOCATION_COUNTER_H
+
+// Number of calls to operator new so far. allocation_counter.cpp replaces the global operator
+// new / delete with malloc / free plus this counter; only programs that want the count (the
+// benchmark) link it in, and a program can link it only once.
+long long heap_allocations();
+
+#endif
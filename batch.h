@@ -0,0 +1,543 @@
+#ifndef BATCH_H
+#define BATCH_H
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdio>
+#include <deque>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include <opencv2/core/core.hpp>
+#include <opencv2/highgui/highgui.hpp>
+
+#include "bounding_boxes.h"
+#include "detection.h"
+#include "detections_output.h"
+#include "logo.h"
+#include "logo_detector.h"
+#include "thread_pool.h"
+#include "timing.h"
+
+// Task pool with one deque per worker. A worker pushes the tasks it spawns onto its own deque and
+// pops them LIFO, so an image that has started tends to be finished before a new one is decoded;
+// idle workers steal the oldest task from the other deques. Tasks receive the index of the worker
+// that runs them.
+struct WorkStealingPool
+{
+	typedef std::function<void(int)> Task;
+
+	struct WorkerQueue
+	{
+		std::mutex mutex;
+		std::deque<Task> tasks;
+	};
+
+	std::vector<std::unique_ptr<WorkerQueue>> queues;
+	std::vector<std::thread> workers;
+	std::mutex mutex;
+	std::condition_variable wake;
+	std::condition_variable idle;
+	int pending = 0;
+	int queued = 0;
+	int next_queue = 0;
+	bool stopping = false;
+
+	explicit WorkStealingPool(int thread_count)
+	{
+		thread_count = std::max(1, thread_count);
+		for (int i = 0; i < thread_count; i++)
+		{
+			queues.emplace_back(new WorkerQueue());
+		}
+		for (int i = 0; i < thread_count; i++)
+		{
+			workers.emplace_back([this, i] { worker_loop(i); });
+		}
+	}
+
+	~WorkStealingPool()
+	{
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			stopping = true;
+		}
+		wake.notify_all();
+		for (auto& worker : workers)
+		{
+			worker.join();
+		}
+	}
+
+	WorkStealingPool(const WorkStealingPool&) = delete;
+	WorkStealingPool& operator=(const WorkStealingPool&) = delete;
+
+	int size() const
+	{
+		return (int)queues.size();
+	}
+
+	// From outside the pool pass worker = -1; the tasks are then spread round-robin.
+	void submit(Task task, int worker = -1)
+	{
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			pending++;
+			queued++;
+			if (worker < 0)
+				worker = next_queue++ % size();
+		}
+		{
+			std::lock_guard<std::mutex> lock(queues[worker]->mutex);
+			queues[worker]->tasks.push_back(std::move(task));
+		}
+		wake.notify_one();
+	}
+
+	void wait_idle()
+	{
+		std::unique_lock<std::mutex> lock(mutex);
+		idle.wait(lock, [this] { return pending == 0; });
+	}
+
+	bool take_task(int worker, Task& task)
+	{
+		{
+			WorkerQueue& own = *queues[worker];
+			std::lock_guard<std::mutex> lock(own.mutex);
+			if (!own.tasks.empty())
+			{
+				task = std::move(own.tasks.back());
+				own.tasks.pop_back();
+				return true;
+			}
+		}
+		for (int k = 1; k < size(); k++)
+		{
+			WorkerQueue& victim = *queues[(worker + k) % size()];
+			std::lock_guard<std::mutex> lock(victim.mutex);
+			if (!victim.tasks.empty())
+			{
+				task = std::move(victim.tasks.front());
+				victim.tasks.pop_front();
+				return true;
+			}
+		}
+		return false;
+	}
+
+	void worker_loop(int worker)
+	{
+		while (true)
+		{
+			Task task;
+			if (take_task(worker, task))
+			{
+				{
+					std::lock_guard<std::mutex> lock(mutex);
+					queued--;
+				}
+				task(worker);
+				std::lock_guard<std::mutex> lock(mutex);
+				if (--pending == 0)
+					idle.notify_all();
+				continue;
+			}
+
+			std::unique_lock<std::mutex> lock(mutex);
+			wake.wait(lock, [this] { return stopping || queued > 0; });
+			if (stopping && queued == 0)
+				return;
+		}
+	}
+};
+
+// Counting semaphore that caps the number of images between decode and encode.
+struct InFlightLimit
+{
+	std::mutex mutex;
+	std::condition_variable released;
+	int available;
+
+	explicit InFlightLimit(int limit) : available(std::max(1, limit)) {}
+
+	void acquire()
+	{
+		std::unique_lock<std::mutex> lock(mutex);
+		released.wait(lock, [this] { return available > 0; });
+		available--;
+	}
+
+	void release()
+	{
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			available++;
+		}
+		released.notify_one();
+	}
+};
+
+enum BatchStage
+{
+	Stage_Decode,
+	Stage_Detect,
+	Stage_Encode,
+	Stage_Total,
+	Stage_Count
+};
+
+inline const char* batch_stage_name(int stage)
+{
+	static const char* names[Stage_Count] = { "decode", "detect", "encode", "total" };
+	return names[stage];
+}
+
+struct BatchOptions
+{
+	std::vector<std::string> inputs;
+	std::string output_dir = "out";
+	int threads = default_thread_count();
+	int max_in_flight = 0;
+	int pyramid_factor = 0;
+	OutputFormat output_format = Output_Images;
+	// Chrome trace of every image written here when set, see write_chrome_trace.
+	std::string trace_path;
+	ShapeClassifier classifier = logo_shape_classifier();
+	std::shared_ptr<const BgrLut> lut;
+};
+
+struct BatchReport
+{
+	int images = 0;
+	int failed = 0;
+	// The trace or detections file could not be written; the images themselves were processed.
+	bool output_failed = false;
+	int logos = 0;
+	double seconds = 0;
+	std::vector<double> stage_ms[Stage_Count];
+	CascadeStats cascade;
+	std::vector<FrameTrace> traces;
+};
+
+inline bool is_image_file(const std::filesystem::path& path)
+{
+	std::string extension = path.extension().string();
+	std::transform(extension.begin(), extension.end(), extension.begin(), ::tolower);
+	static const char* extensions[] = { ".jpg", ".jpeg", ".png", ".bmp", ".tif", ".tiff", ".ppm", ".pgm", ".webp" };
+	for (const char* known : extensions)
+	{
+		if (extension == known)
+			return true;
+	}
+	return false;
+}
+
+// A directory stands for the image files in it (sorted by name), a .txt or .lst file for the
+// paths listed in it, one per line; anything else is taken as an image path.
+inline std::vector<std::string> collect_batch_inputs(const std::vector<std::string>& arguments)
+{
+	std::vector<std::string> files;
+	for (const std::string& argument : arguments)
+	{
+		std::filesystem::path path(argument);
+		if (std::filesystem::is_directory(path))
+		{
+			std::vector<std::string> found;
+			for (const auto& entry : std::filesystem::directory_iterator(path))
+			{
+				if (entry.is_regular_file() && is_image_file(entry.path()))
+					found.push_back(entry.path().string());
+			}
+			std::sort(found.begin(), found.end());
+			files.insert(files.end(), found.begin(), found.end());
+		}
+		else if (path.extension() == ".txt" || path.extension() == ".lst")
+		{
+			std::ifstream list(argument);
+			std::string line;
+			while (std::getline(list, line))
+			{
+				while (!line.empty() && (line.back() == '\r' || line.back() == ' '))
+					line.pop_back();
+				if (!line.empty())
+					files.push_back(line);
+			}
+		}
+		else
+		{
+			files.push_back(argument);
+		}
+	}
+	return files;
+}
+
+// Output paths, relative to the output directory, of the annotated images of files. An image is
+// written under its file name unless another input has the same name; those keep their
+// directories below the deepest one they share, so a/1.jpg and b/1.jpg become a/1.jpg and
+// b/1.jpg. Inputs listed twice get _2, _3, ... before the extension.
+inline std::vector<std::filesystem::path> batch_output_names(const std::vector<std::string>& files)
+{
+	std::map<std::string, std::vector<size_t>> by_name;
+	for (size_t i = 0; i < files.size(); i++)
+		by_name[std::filesystem::path(files[i]).filename().string()].push_back(i);
+
+	std::vector<std::filesystem::path> names(files.size());
+	for (const auto& group : by_name)
+	{
+		if (group.second.size() == 1)
+		{
+			names[group.second[0]] = group.first;
+			continue;
+		}
+		std::filesystem::path shared;
+		for (size_t n = 0; n < group.second.size(); n++)
+		{
+			std::filesystem::path parent = std::filesystem::absolute(files[group.second[n]]).lexically_normal().parent_path();
+			if (n == 0)
+			{
+				shared = parent;
+				continue;
+			}
+			std::filesystem::path common;
+			for (auto a = shared.begin(), b = parent.begin(); a != shared.end() && b != parent.end() && *a == *b; ++a, ++b)
+				common /= *a;
+			shared = common;
+		}
+		std::map<std::string, int> uses;
+		for (size_t i : group.second)
+		{
+			std::filesystem::path name = std::filesystem::absolute(files[i]).lexically_normal().lexically_relative(shared);
+			int use = ++uses[name.string()];
+			if (use > 1)
+				name.replace_filename(name.stem().string() + "_" + std::to_string(use) + name.extension().string());
+			names[i] = name;
+		}
+	}
+	return names;
+}
+
+inline void print_cascade_stats(const CascadeStats& stats)
+{
+	printf("yellow candidates %lld: rejected by aspect ratio %lld, fill ratio %lld, containment %lld, second-order %lld, Hu %lld\n",
+		stats.yellow_candidates, stats.rejected_aspect_ratio, stats.rejected_fill_ratio, stats.rejected_containment,
+		stats.rejected_second_order, stats.rejected_hu);
+	printf("letter candidates %lld: rejected by second-order %lld, Hu %lld; full Hu invariants computed %lld\n",
+		stats.letter_candidates, stats.letters_rejected_second_order, stats.letters_rejected_hu, stats.hu_computed);
+}
+
+inline void print_batch_report(const BatchReport& report)
+{
+	printf("%d images (%d failed), %d logos in %.2f s: %.2f images/s\n", report.images, report.failed, report.logos,
+		report.seconds, report.seconds > 0 ? report.images / report.seconds : 0.0);
+	printf("%-8s %10s %10s %10s %10s\n", "stage", "p50 ms", "p95 ms", "p99 ms", "max ms");
+	for (int stage = 0; stage < Stage_Count; stage++)
+	{
+		const std::vector<double>& ms = report.stage_ms[stage];
+		printf("%-8s %10.2f %10.2f %10.2f %10.2f\n", batch_stage_name(stage), percentile(ms, 50), percentile(ms, 95),
+			percentile(ms, 99), ms.empty() ? 0.0 : *std::max_element(ms.begin(), ms.end()));
+	}
+	print_cascade_stats(report.cascade);
+	if (!report.traces.empty())
+		print_trace_summary(report.traces);
+}
+
+struct BatchImage
+{
+	std::string path;
+	std::filesystem::path output_name;
+	cv::Mat image;
+	std::vector<Logo> logos;
+	CascadeStats cascade;
+	FrameTrace trace;
+	Clock::time_point stage_start[Stage_Count];
+	Clock::time_point stage_end[Stage_Count];
+	bool failed = false;
+};
+
+// Decode -> detect -> annotate/encode as separate tasks on a work-stealing pool. At most
+// max_in_flight images (2 per worker by default) are decoded and not yet written at any time;
+// the caller blocks before decoding the next one. When there are fewer images than threads the
+// spare threads go to the tiled per-frame stages. The boxes are drawn into the decoded image
+// itself, and written under the name batch_output_names gives it; with a JSON or CSV output
+// format there is no encode stage and the image is dropped right after detection. An image that
+// fails to decode, detect or encode is reported and counted as failed, and the batch goes on.
+inline BatchReport run_batch(const BatchOptions& options)
+{
+	std::vector<std::string> files = collect_batch_inputs(options.inputs);
+	int threads = std::max(1, options.threads);
+	int workers = std::max(1, std::min(threads, (int)files.size()));
+	int frame_threads = std::max(1, threads / workers);
+	int max_in_flight = options.max_in_flight > 0 ? options.max_in_flight : 2 * workers;
+	bool trace_images = trace_enabled && !options.trace_path.empty();
+	if (!trace_enabled && !options.trace_path.empty())
+		fprintf(stderr, "built with LOGO_NO_TRACE, no trace is written\n");
+	// A directory that cannot be created shows up as the outputs that cannot be written into it.
+	std::error_code directory_error;
+	if (!options.output_dir.empty())
+		std::filesystem::create_directories(options.output_dir, directory_error);
+
+	LogoDetectorConfig config;
+	config.classifier = options.classifier;
+	config.threads = frame_threads;
+	config.pyramid_factor = options.pyramid_factor;
+	config.lut = options.lut;
+	std::vector<std::unique_ptr<LogoDetector>> detectors;
+	for (int i = 0; i < workers; i++)
+	{
+		detectors.emplace_back(new LogoDetector(config));
+	}
+
+	std::vector<std::filesystem::path> output_names = batch_output_names(files);
+	std::vector<std::shared_ptr<BatchImage>> images(files.size());
+	InFlightLimit limit(max_in_flight);
+	auto start = Clock::now();
+	{
+		WorkStealingPool pool(workers);
+		for (size_t i = 0; i < files.size(); i++)
+		{
+			limit.acquire();
+			std::shared_ptr<BatchImage> item = std::make_shared<BatchImage>();
+			item->path = files[i];
+			item->output_name = output_names[i];
+			images[i] = item;
+			pool.submit([&, item](int worker)
+			{
+				item->stage_start[Stage_Decode] = Clock::now();
+				try
+				{
+					item->image = cv::imread(item->path);
+				}
+				catch (const std::exception& error)
+				{
+					fprintf(stderr, "%s: %s\n", item->path.c_str(), error.what());
+					item->image.release();
+				}
+				item->stage_end[Stage_Decode] = Clock::now();
+				if (item->image.empty())
+				{
+					fprintf(stderr, "%s: cannot read image\n", item->path.c_str());
+					item->failed = true;
+					limit.release();
+					return;
+				}
+
+				pool.submit([&, item](int worker)
+				{
+					item->stage_start[Stage_Detect] = Clock::now();
+					try
+					{
+						item->trace.image = item->path;
+						item->trace.thread = worker;
+						item->logos = detectors[worker]->detect(item->image, &item->cascade, trace_images ? &item->trace : nullptr);
+					}
+					catch (const std::exception& error)
+					{
+						fprintf(stderr, "%s: %s\n", item->path.c_str(), error.what());
+						item->failed = true;
+						item->image.release();
+						limit.release();
+						return;
+					}
+					item->stage_end[Stage_Detect] = Clock::now();
+					if (options.output_format != Output_Images)
+					{
+						item->image.release();
+						item->stage_start[Stage_Encode] = item->stage_end[Stage_Encode] = item->stage_end[Stage_Detect];
+						limit.release();
+						return;
+					}
+
+					pool.submit([&, item](int)
+					{
+						item->stage_start[Stage_Encode] = Clock::now();
+						try
+						{
+							std::filesystem::path output_path = std::filesystem::path(options.output_dir) / item->output_name;
+							if (item->output_name.has_parent_path())
+								std::filesystem::create_directories(output_path.parent_path());
+							draw_bounding_boxes_for_logos_in_place(item->image, item->logos);
+							if (!cv::imwrite(output_path.string(), item->image))
+							{
+								fprintf(stderr, "%s: cannot write result\n", item->path.c_str());
+								item->failed = true;
+							}
+						}
+						catch (const std::exception& error)
+						{
+							fprintf(stderr, "%s: %s\n", item->path.c_str(), error.what());
+							item->failed = true;
+						}
+						item->image.release();
+						item->stage_end[Stage_Encode] = Clock::now();
+						limit.release();
+					}, worker);
+				}, worker);
+			});
+		}
+		pool.wait_idle();
+	}
+
+	BatchReport report;
+	report.seconds = elapsed_ms(start, Clock::now()) / 1000;
+	for (const auto& item : images)
+	{
+		if (item->failed)
+		{
+			report.failed++;
+			continue;
+		}
+		report.images++;
+		report.logos += (int)item->logos.size();
+		report.cascade.add(item->cascade);
+		for (int stage = 0; stage < Stage_Total; stage++)
+		{
+			report.stage_ms[stage].push_back(elapsed_ms(item->stage_start[stage], item->stage_end[stage]));
+		}
+		report.stage_ms[Stage_Total].push_back(elapsed_ms(item->stage_start[Stage_Decode], item->stage_end[Stage_Encode]));
+		if (trace_images)
+		{
+			for (int stage = 0; stage < Stage_Total; stage++)
+				item->trace.spans.push_back(TraceSpan{ batch_stage_name(stage), item->stage_start[stage], item->stage_end[stage] });
+			report.traces.push_back(std::move(item->trace));
+		}
+	}
+
+	if (trace_images)
+	{
+		std::ofstream file(options.trace_path);
+		write_chrome_trace(file, report.traces, start);
+		if (!file)
+		{
+			fprintf(stderr, "%s: cannot write trace\n", options.trace_path.c_str());
+			report.output_failed = true;
+		}
+	}
+
+	if (options.output_format != Output_Images)
+	{
+		std::vector<ImageDetections> detections;
+		for (const auto& item : images)
+		{
+			if (item->failed)
+				continue;
+			ImageDetections image{ item->path, {} };
+			for (const auto& logo : item->logos)
+				image.boxes.push_back(logo_box(logo));
+			detections.push_back(image);
+		}
+		if (!write_detections_file(options.output_dir, options.output_format, detections))
+			report.output_failed = true;
+	}
+	return report;
+}
+
+#endif
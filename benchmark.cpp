@@ -0,0 +1,363 @@
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <random>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <opencv2/core/core.hpp>
+#include <opencv2/highgui/highgui.hpp>
+#include <opencv2/imgproc/imgproc.hpp>
+
+#include "colors.h"
+#include "contours.h"
+#include "color_bands.h"
+#include "segments.h"
+#include "filters.h"
+#include "moments.h"
+#include "shape_matching.h"
+#include "logo.h"
+#include "bounding_boxes.h"
+#include "thread_pool.h"
+#include "tiling.h"
+#include "detection.h"
+#include "detections_output.h"
+#include "pyramid.h"
+#include "static_pipeline.h"
+#include "timing.h"
+#include "allocation_counter.h"
+#include "synthetic_image.h"
+
+// Benchmark of the detection pipeline and of each of its stages in isolation. Every stage gets
+// its input from one untimed run of the pipeline, is run warmup times untimed and then
+// repetitions times timed. Results are written as JSON.
+//
+// "pyramid_logos" is the number of logos detect_logos_pyramid finds, to be compared with "logos".
+// "steady_state_allocations" is the mean number of heap allocations of one detect_logos call
+// reusing warmed-up FrameBuffers, as in the "pipeline_buffers" stage.
+// "contour_hu_mismatches" is the number of filtered segments whose invariants from their traced
+// contours differ from hu_moments of their pixels; it should be 0.
+// The "_static" stages run the kernels generated for LogoPipeline, to be compared with the
+// runtime-configured stage of the same name and with "pipeline_buffers".
+//
+// Usage: benchmark [--sizes 1,4,12,48] [--warmup n] [--repetitions n] [-j threads] [--seed n]
+//                  [--pyramid factor] [-o results.json] [image]...
+
+struct BenchmarkOptions
+{
+	std::vector<double> megapixels{ 1, 4, 12, 48 };
+	std::vector<std::string> images;
+	int warmup = 1;
+	int repetitions = 5;
+	int threads = default_thread_count();
+	unsigned int seed = 1;
+	int pyramid_factor = 4;
+	std::string output;
+};
+
+struct StageResult
+{
+	std::string name;
+	std::vector<double> ms;
+};
+
+struct BenchmarkInput
+{
+	std::string name;
+	cv::Mat image;
+};
+
+StageResult measure(const std::string& name, const BenchmarkOptions& options, const std::function<void()>& body)
+{
+	StageResult result{ name, {} };
+	for (int i = 0; i < options.warmup; i++)
+	{
+		body();
+	}
+	for (int i = 0; i < options.repetitions; i++)
+	{
+		Clock::time_point start = Clock::now();
+		body();
+		result.ms.push_back(elapsed_ms(start, Clock::now()));
+	}
+	return result;
+}
+
+std::vector<StageResult> benchmark_image(const cv::Mat& input, const BenchmarkOptions& options, ThreadPool& pool, size_t& logo_count, size_t& pyramid_logo_count, CascadeStats& cascade, double& steady_state_allocations, size_t& contour_hu_mismatches)
+{
+	cv::Mat image = input;
+	std::vector<ColorBand> bands = logo_color_bands();
+
+	// Untimed reference run providing the input of every stage.
+	cv::Mat hsv = bgr2hsv(image);
+	cv::Mat red_mask_1 = inRange(hsv, cv::Vec3b(0, 50, 100), cv::Vec3b(15, 255, 255));
+	cv::Mat red_mask_2 = inRange(hsv, cv::Vec3b(160, 50, 50), cv::Vec3b(179, 255, 255));
+	std::map<std::string, BinaryMask> masks = classify_color_bands(image, bands, pool, Mask_Bits);
+	BinaryMask yellow_filtered = dilation_filter(masks["yellow"], 3, 1, pool);
+	std::vector<Segment> blue_segments = segment_mask(masks["blue"], pool);
+	std::vector<Segment> red_segments = segment_mask(masks["red"], pool);
+	std::vector<Segment> yellow_segments = segment_mask(yellow_filtered, pool);
+	std::vector<Segment> blue_filtered = filter_out_segments(blue_segments, 7, 5, 150, 150);
+	std::vector<Segment> red_filtered = filter_out_segments(red_segments, 5, 5, 150, 150);
+	std::vector<Segment> yellow_filtered_segments = filter_out_segments(yellow_segments, 15, 30, 500, 500);
+	std::sort(blue_filtered.begin(), blue_filtered.end(), compare_segments_by_x);
+	std::sort(red_filtered.begin(), red_filtered.end(), compare_segments_by_y);
+	std::vector<std::vector<std::pair<int, int>>> segment_pixels;
+	std::vector<std::vector<Contour>> segment_contours;
+	for (const auto* segments : { &blue_filtered, &red_filtered, &yellow_filtered_segments })
+	{
+		for (const auto& segment : *segments)
+		{
+			segment_pixels.push_back(segment.pixel_coordinates());
+			segment_contours.push_back(trace_contours(segment));
+		}
+	}
+	contour_hu_mismatches = 0;
+	for (size_t k = 0; k < segment_pixels.size(); k++)
+	{
+		RotationInvariants pixels = hu_moments(segment_pixels[k]);
+		RotationInvariants contours = hu_moments(segment_contours[k]);
+		if (pixels.M1 != contours.M1 || pixels.M2 != contours.M2 || pixels.M3 != contours.M3 || pixels.M4 != contours.M4
+			|| pixels.M5 != contours.M5 || pixels.M6 != contours.M6 || pixels.M7 != contours.M7)
+			contour_hu_mismatches++;
+	}
+	std::vector<Logo> logos = build_logos(yellow_filtered_segments, blue_filtered, red_filtered, &cascade);
+	logo_count = logos.size();
+	pyramid_logo_count = detect_logos_pyramid(image, bands, pool, options.pyramid_factor).size();
+
+	std::vector<StageResult> results;
+	results.push_back(measure("bgr2hsv", options, [&] { bgr2hsv(image); }));
+	results.push_back(measure("inRange", options, [&]
+	{
+		inRange(hsv, cv::Vec3b(80, 40, 30), cv::Vec3b(130, 255, 225));
+		inRange(hsv, cv::Vec3b(0, 50, 100), cv::Vec3b(15, 255, 255));
+		inRange(hsv, cv::Vec3b(160, 50, 50), cv::Vec3b(179, 255, 255));
+		inRange(hsv, cv::Vec3b(20, 100, 100), cv::Vec3b(30, 255, 255));
+	}));
+	results.push_back(measure("mask_or", options, [&] { mask_or(red_mask_1, red_mask_2); }));
+	results.push_back(measure("classify_color_bands", options, [&] { classify_color_bands(image, bands, pool, Mask_Bits); }));
+	ColorBandBuffers color_band_buffers;
+	for (BgrLutMode mode : { Lut_Full, Lut_Quantized })
+	{
+		BgrLut lut = build_bgr_lut(bands, mode, pool);
+		results.push_back(measure(mode == Lut_Full ? "classify_color_bands_lut_full" : "classify_color_bands_lut_quantized", options, [&]
+		{
+			classify_color_bands(image, bands, pool, color_band_buffers, Mask_Bits, best_hsv_conversion_method(), &lut);
+		}));
+	}
+	BinaryMask static_masks[3];
+	for (auto& mask : static_masks)
+		mask.create(image.rows, image.cols, Mask_Bits);
+	std::vector<RowTile> static_tiles = split_row_tiles(image.rows, 3 * (size_t)image.cols, pool.size());
+	results.push_back(measure("classify_color_bands_static", options, [&]
+	{
+		pool.parallel_for((int)static_tiles.size(), [&](int t)
+		{
+			classify_static_rows<LogoPipeline>(image, static_tiles[t].row_begin, static_tiles[t].row_end, static_masks[0], static_masks[1], static_masks[2], best_hsv_conversion_method());
+		});
+	}));
+	results.push_back(measure("dilation_filter", options, [&] { dilation_filter(masks["yellow"], 3, 1, pool); }));
+	BinaryMask dilated_static(image.rows, image.cols, Mask_Bits);
+	std::vector<RowTile> dilation_tiles = split_row_tiles(image.rows, 8 * (size_t)dilated_static.words_per_row, pool.size(), 12);
+	std::vector<std::vector<uint64_t>> dilation_rows(dilation_tiles.size());
+	results.push_back(measure("dilation_filter_static", options, [&]
+	{
+		pool.parallel_for((int)dilation_tiles.size(), [&](int t)
+		{
+			dilate_static_rows<1, 1>(masks["yellow"], dilated_static, dilation_tiles[t].row_begin, dilation_tiles[t].row_end, dilation_rows[t]);
+		});
+	}));
+	results.push_back(measure("segment_mask", options, [&]
+	{
+		segment_mask(masks["blue"], pool);
+		segment_mask(masks["red"], pool);
+		segment_mask(yellow_filtered, pool);
+	}));
+	results.push_back(measure("filter_out_segments", options, [&]
+	{
+		filter_out_segments(blue_segments, 7, 5, 150, 150);
+		filter_out_segments(red_segments, 5, 5, 150, 150);
+		filter_out_segments(yellow_segments, 15, 30, 500, 500);
+	}));
+	results.push_back(measure("hu_moments", options, [&]
+	{
+		for (const auto& pixels : segment_pixels)
+			hu_moments(pixels);
+	}));
+	results.push_back(measure("trace_contours", options, [&]
+	{
+		for (const auto* segments : { &blue_filtered, &red_filtered, &yellow_filtered_segments })
+		{
+			for (const auto& segment : *segments)
+				trace_contours(segment);
+		}
+	}));
+	results.push_back(measure("contour_hu_moments", options, [&]
+	{
+		for (const auto& contours : segment_contours)
+			hu_moments(contours);
+	}));
+	results.push_back(measure("build_logos", options, [&] { build_logos(yellow_filtered_segments, blue_filtered, red_filtered); }));
+	results.push_back(measure("draw_bounding_boxes_for_logos", options, [&] { draw_bounding_boxes_for_logos(image, logos); }));
+	cv::Mat annotated = image.clone();
+	results.push_back(measure("draw_bounding_boxes_in_place", options, [&] { draw_bounding_boxes_for_logos_in_place(annotated, logos); }));
+	results.push_back(measure("pipeline", options, [&]
+	{
+		std::vector<Logo> found = detect_logos(image, bands, pool);
+		draw_bounding_boxes_for_logos(image, found);
+	}));
+	results.push_back(measure("pipeline_pyramid", options, [&]
+	{
+		std::vector<Logo> found = detect_logos_pyramid(image, bands, pool, options.pyramid_factor);
+		draw_bounding_boxes_for_logos(image, found);
+	}));
+	FrameBuffers buffers;
+	results.push_back(measure("pipeline_buffers", options, [&] { detect_logos(image, bands, pool, buffers); }));
+
+	int runs = std::max(1, options.repetitions);
+	long long allocations = heap_allocations();
+	for (int i = 0; i < runs; i++)
+	{
+		detect_logos(image, bands, pool, buffers);
+	}
+	steady_state_allocations = (heap_allocations() - allocations) / (double)runs;
+
+	FrameBuffers static_buffers;
+	results.push_back(measure("pipeline_static", options, [&] { detect_logos_static<LogoPipeline>(image, pool, static_buffers); }));
+
+	FrameBuffers traced_buffers;
+	FrameTrace trace;
+	traced_buffers.trace = &trace;
+	results.push_back(measure("pipeline_traced", options, [&]
+	{
+		trace.spans.clear();
+		trace.counters.clear();
+		detect_logos(image, bands, pool, traced_buffers);
+	}));
+	return results;
+}
+
+void write_stage_json(std::ostream& out, const StageResult& stage)
+{
+	out << "        \"" << json_escape(stage.name) << "\": { \"median_ms\": " << percentile(stage.ms, 50)
+		<< ", \"p95_ms\": " << percentile(stage.ms, 95)
+		<< ", \"min_ms\": " << percentile(stage.ms, 0)
+		<< ", \"max_ms\": " << percentile(stage.ms, 100) << " }";
+}
+
+void write_cascade_json(std::ostream& out, const CascadeStats& stats)
+{
+	out << "      \"cascade\": { \"yellow_candidates\": " << stats.yellow_candidates
+		<< ", \"rejected_aspect_ratio\": " << stats.rejected_aspect_ratio
+		<< ", \"rejected_fill_ratio\": " << stats.rejected_fill_ratio
+		<< ", \"rejected_containment\": " << stats.rejected_containment
+		<< ", \"rejected_second_order\": " << stats.rejected_second_order
+		<< ", \"rejected_hu\": " << stats.rejected_hu
+		<< ", \"letter_candidates\": " << stats.letter_candidates
+		<< ", \"letters_rejected_second_order\": " << stats.letters_rejected_second_order
+		<< ", \"letters_rejected_hu\": " << stats.letters_rejected_hu
+		<< ", \"hu_computed\": " << stats.hu_computed << " },\n";
+}
+
+std::vector<double> parse_sizes(const std::string& list)
+{
+	std::vector<double> sizes;
+	std::stringstream stream(list);
+	std::string item;
+	while (std::getline(stream, item, ','))
+	{
+		if (!item.empty())
+			sizes.push_back(std::atof(item.c_str()));
+	}
+	return sizes;
+}
+
+int main(int argc, char** argv)
+{
+	BenchmarkOptions options;
+	for (int i = 1; i < argc; i++)
+	{
+		std::string argument = argv[i];
+		if (argument == "--sizes" && i + 1 < argc)
+			options.megapixels = parse_sizes(argv[++i]);
+		else if (argument == "--warmup" && i + 1 < argc)
+			options.warmup = std::atoi(argv[++i]);
+		else if (argument == "--repetitions" && i + 1 < argc)
+			options.repetitions = std::max(1, std::atoi(argv[++i]));
+		else if (argument == "-j" && i + 1 < argc)
+			options.threads = std::atoi(argv[++i]);
+		else if (argument == "--seed" && i + 1 < argc)
+			options.seed = (unsigned int)std::atoi(argv[++i]);
+		else if (argument == "--pyramid" && i + 1 < argc)
+			options.pyramid_factor = std::atoi(argv[++i]);
+		else if (argument == "-o" && i + 1 < argc)
+			options.output = argv[++i];
+		else
+			options.images.push_back(argument);
+	}
+
+	std::vector<BenchmarkInput> inputs;
+	for (const std::string& path : options.images)
+	{
+		cv::Mat image = cv::imread(path);
+		if (image.empty())
+		{
+			fprintf(stderr, "%s: cannot read image\n", path.c_str());
+			return 1;
+		}
+		inputs.push_back(BenchmarkInput{ path, image });
+	}
+	if (options.images.empty())
+	{
+		for (double mp : options.megapixels)
+		{
+			std::ostringstream name;
+			name << "synthetic_" << mp << "mp";
+			inputs.push_back(BenchmarkInput{ name.str(), synthetic_image(mp, options.seed) });
+		}
+	}
+
+	ThreadPool pool(std::max(1, options.threads));
+	std::ostringstream json;
+	json << "{\n  \"threads\": " << pool.size() << ",\n  \"warmup\": " << options.warmup
+		<< ",\n  \"repetitions\": " << options.repetitions << ",\n  \"inputs\": [\n";
+	for (size_t k = 0; k < inputs.size(); k++)
+	{
+		const BenchmarkInput& input = inputs[k];
+		fprintf(stderr, "%s (%dx%d)\n", input.name.c_str(), input.image.cols, input.image.rows);
+		size_t logo_count = 0;
+		size_t pyramid_logo_count = 0;
+		CascadeStats cascade;
+		double steady_state_allocations = 0;
+		size_t contour_hu_mismatches = 0;
+		std::vector<StageResult> stages = benchmark_image(input.image, options, pool, logo_count, pyramid_logo_count, cascade, steady_state_allocations, contour_hu_mismatches);
+		json << "    {\n      \"name\": \"" << json_escape(input.name) << "\",\n      \"width\": " << input.image.cols
+			<< ",\n      \"height\": " << input.image.rows
+			<< ",\n      \"megapixels\": " << input.image.rows * (double)input.image.cols / 1e6
+			<< ",\n      \"logos\": " << logo_count << ",\n      \"pyramid_logos\": " << pyramid_logo_count
+			<< ",\n      \"steady_state_allocations\": " << steady_state_allocations
+			<< ",\n      \"contour_hu_mismatches\": " << contour_hu_mismatches << ",\n";
+		write_cascade_json(json, cascade);
+		json << "      \"stages\": {\n";
+		for (size_t s = 0; s < stages.size(); s++)
+		{
+			write_stage_json(json, stages[s]);
+			json << (s + 1 < stages.size() ? ",\n" : "\n");
+		}
+		json << "      }\n    }" << (k + 1 < inputs.size() ? ",\n" : "\n");
+	}
+	json << "  ]\n}\n";
+
+	if (options.output.empty())
+	{
+		std::cout << json.str();
+	}
+	else
+	{
+		std::ofstream file(options.output);
+		file << json.str();
+	}
+	return 0;
+}
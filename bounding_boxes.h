@@ -2,6 +2,7 @@
 #define BOUNDING_BOXES_H
 
 
+#include <algorithm>
 #include <cassert>
 #include <vector>
 #include <tuple>
@@ -15,63 +16,74 @@
 
 #define BOX_COLOR cv::Vec3b(4, 255, 16);
 
-void horizontal_line(cv::Mat& image, int y, int x_start, int x_end)
+// Three pixel thick line through row y from x_start to x_end. Pixels outside the image are
+// skipped, so boxes touching or crossing the border are drawn as far as they are visible.
+inline void horizontal_line(cv::Mat& image, int y, int x_start, int x_end)
 {
 	assert(x_start <= x_end);
-	for (int x = x_start; x <= x_end; x++) 
+	x_start = std::max(x_start, 0);
+	x_end = std::min(x_end, image.cols - 1);
+	for (int row = std::max(y - 1, 0); row <= std::min(y + 1, image.rows - 1); row++)
 	{
-		image.at<cv::Vec3b>(y, x) = BOX_COLOR;
-		image.at<cv::Vec3b>(y + 1, x) = BOX_COLOR;
-		image.at<cv::Vec3b>(y - 1, x) = BOX_COLOR;
+		cv::Vec3b* pixels = image.ptr<cv::Vec3b>(row);
+		for (int x = x_start; x <= x_end; x++)
+			pixels[x] = BOX_COLOR;
 	}
 }
 
-void vertical_line(cv::Mat& image, int x, int y_start, int y_end)
+inline void vertical_line(cv::Mat& image, int x, int y_start, int y_end)
 {
 	assert(y_start <= y_end);
-	for (int y = y_start; y <= y_end; y++) 
+	int col_begin = std::max(x - 1, 0);
+	int col_end = std::min(x + 1, image.cols - 1);
+	for (int y = std::max(y_start, 0); y <= std::min(y_end, image.rows - 1); y++)
 	{
-		image.at<cv::Vec3b>(y, x) = BOX_COLOR;
-		image.at<cv::Vec3b>(y, x - 1) = BOX_COLOR;
-		image.at<cv::Vec3b>(y, x + 1) = BOX_COLOR;
+		cv::Vec3b* pixels = image.ptr<cv::Vec3b>(y);
+		for (int col = col_begin; col <= col_end; col++)
+			pixels[col] = BOX_COLOR;
 	}
 }
 
-cv::Mat draw_bounding_boxes_for_segments(cv::Mat& image, std::vector<Segment> segments)
+inline void draw_box(cv::Mat& image, int x_start, int y_start, int x_end, int y_end)
+{
+	CV_Assert(image.type() == CV_8UC3);
+	horizontal_line(image, y_start, x_start, x_end);
+	horizontal_line(image, y_end, x_start, x_end);
+	vertical_line(image, x_start, y_start, y_end);
+	vertical_line(image, x_end, y_start, y_end);
+}
+
+// Draws into image itself, for callers that own the frame and do not need it unannotated.
+inline void draw_bounding_boxes_for_segments_in_place(cv::Mat& image, const std::vector<Segment>& segments)
 {
-	cv::Mat result = image.clone();
 	for (const auto& segment : segments)
 	{
-		int x_start = segment.col_min;
-		int y_start = segment.row_min;
-		int x_end = segment.col_max;
-		int y_end = segment.row_max;
-		horizontal_line(result, y_start, x_start, x_end);
-		horizontal_line(result, y_end, x_start, x_end);
-		vertical_line(result, x_start, y_start, y_end);
-		vertical_line(result, x_end, y_start, y_end);
+		draw_box(image, segment.col_min, segment.row_min, segment.col_max, segment.row_max);
 	}
-	return result;
 }
 
-cv::Mat draw_bounding_boxes_for_logos(cv::Mat& image, std::vector<Logo> logos)
+// The logo box padded by 4% of its size on every side.
+inline void draw_bounding_boxes_for_logos_in_place(cv::Mat& image, const std::vector<Logo>& logos)
 {
-	cv::Mat result = image.clone();
 	for (const auto& logo : logos)
 	{
 		double a = 0.04 * (logo.col_max - logo.col_min);
 		double b = 0.04 * (logo.row_max - logo.row_min);
-		
-		int x_start = logo.col_min - a;
-		int y_start = logo.row_min - b;
-		int x_end = logo.col_max + a;
-		int y_end = logo.row_max + b;
-		
-		horizontal_line(result, y_start, x_start, x_end);
-		horizontal_line(result, y_end, x_start, x_end);
-		vertical_line(result, x_start, y_start, y_end);
-		vertical_line(result, x_end, y_start, y_end);
+		draw_box(image, (int)(logo.col_min - a), (int)(logo.row_min - b), (int)(logo.col_max + a), (int)(logo.row_max + b));
 	}
+}
+
+inline cv::Mat draw_bounding_boxes_for_segments(const cv::Mat& image, const std::vector<Segment>& segments)
+{
+	cv::Mat result = image.clone();
+	draw_bounding_boxes_for_segments_in_place(result, segments);
+	return result;
+}
+
+inline cv::Mat draw_bounding_boxes_for_logos(const cv::Mat& image, const std::vector<Logo>& logos)
+{
+	cv::Mat result = image.clone();
+	draw_bounding_boxes_for_logos_in_place(result, logos);
 	return result;
 }
 
@@ -0,0 +1,184 @@
+#ifndef COLOR_BANDS_H
+#define COLOR_BANDS_H
+
+#include <algorithm>
+#include <cassert>
+#include <map>
+#include <string>
+#include <vector>
+#include <opencv2/core/core.hpp>
+
+#include "hsv_conversion.h"
+#include "mask.h"
+
+// Inclusive HSV box. A range with lower[0] > upper[0] wraps around the hue circle,
+// e.g. (160, ...) - (15, ...) covers hues 160..179 and 0..15.
+struct HsvRange
+{
+	cv::Vec3b lower;
+	cv::Vec3b upper;
+};
+
+struct ColorBand
+{
+	std::string name;
+	std::vector<HsvRange> ranges;
+};
+
+// Per-channel lookup tables with one bit per range; a pixel is inside range k
+// when bit k is set in hue[h] & saturation[s] & value[v].
+struct BandClassifier
+{
+	std::vector<unsigned int> hue;
+	std::vector<unsigned int> saturation;
+	std::vector<unsigned int> value;
+	std::vector<unsigned int> band_ranges;
+};
+
+inline void build_band_classifier(const std::vector<ColorBand>& bands, BandClassifier& classifier)
+{
+	classifier.hue.assign(256, 0);
+	classifier.saturation.assign(256, 0);
+	classifier.value.assign(256, 0);
+	classifier.band_ranges.clear();
+
+	int bit = 0;
+	for (const auto& band : bands)
+	{
+		unsigned int band_bits = 0;
+		for (const auto& range : band.ranges)
+		{
+			assert(bit < 32);
+			unsigned int range_bit = 1u << bit++;
+			bool wraps = range.lower[0] > range.upper[0];
+			for (int x = 0; x < 256; x++)
+			{
+				bool in_hue = wraps ? (x >= range.lower[0] || x <= range.upper[0]) : (x >= range.lower[0] && x <= range.upper[0]);
+				if (in_hue)
+					classifier.hue[x] |= range_bit;
+				if (x >= range.lower[1] && x <= range.upper[1])
+					classifier.saturation[x] |= range_bit;
+				if (x >= range.lower[2] && x <= range.upper[2])
+					classifier.value[x] |= range_bit;
+			}
+			band_bits |= range_bit;
+		}
+		classifier.band_ranges.push_back(band_bits);
+	}
+}
+
+inline BandClassifier build_band_classifier(const std::vector<ColorBand>& bands)
+{
+	BandClassifier classifier;
+	build_band_classifier(bands, classifier);
+	return classifier;
+}
+
+// Writes row of every mask b: pixel j is set when bits[j] shares a bit with band_bits[b].
+inline void pack_band_masks(const unsigned int* bits, int width, const unsigned int* band_bits, std::vector<BinaryMask*>& masks, int row)
+{
+	for (size_t b = 0; b < masks.size(); b++)
+	{
+		unsigned int band = band_bits[b];
+		BinaryMask& mask = *masks[b];
+		if (mask.storage == Mask_Bits)
+		{
+			uint64_t* out = mask.word_row(row);
+			for (int w = 0; w < mask.words_per_row; w++)
+			{
+				uint64_t word = 0;
+				int end = std::min(64, width - 64 * w);
+				for (int k = 0; k < end; k++)
+				{
+					word |= uint64_t((bits[64 * w + k] & band) != 0) << k;
+				}
+				out[w] = word;
+			}
+		}
+		else
+		{
+			uchar* out = mask.byte_row(row);
+			for (int j = 0; j < width; j++)
+			{
+				out[j] = (bits[j] & band) ? 255 : 0;
+			}
+		}
+	}
+}
+
+inline void classify_hsv_row(const BandClassifier& classifier, const uchar* hsv, int width, std::vector<unsigned int>& range_bits, std::vector<BinaryMask*>& masks, int row)
+{
+	const unsigned int* hue = classifier.hue.data();
+	const unsigned int* saturation = classifier.saturation.data();
+	const unsigned int* value = classifier.value.data();
+	unsigned int* bits = range_bits.data();
+	for (int j = 0; j < width; j++, hsv += 3)
+	{
+		bits[j] = hue[hsv[0]] & saturation[hsv[1]] & value[hsv[2]];
+	}
+	pack_band_masks(bits, width, classifier.band_ranges.data(), masks, row);
+}
+
+inline std::vector<BinaryMask*> allocate_band_masks(std::map<std::string, BinaryMask>& masks, const std::vector<ColorBand>& bands, int rows, int cols, MaskStorage storage)
+{
+	std::vector<BinaryMask*> band_masks;
+	for (const auto& band : bands)
+	{
+		BinaryMask& mask = masks[band.name];
+		mask.create(rows, cols, storage);
+		band_masks.push_back(&mask);
+	}
+	return band_masks;
+}
+
+// Classifies an HSV image into one mask per band in a single pass.
+inline std::map<std::string, BinaryMask> classify_hsv_bands(const cv::Mat& hsv, const std::vector<ColorBand>& bands, MaskStorage storage = Mask_Bits)
+{
+	CV_Assert(hsv.type() == CV_8UC3);
+	BandClassifier classifier = build_band_classifier(bands);
+	std::map<std::string, BinaryMask> masks;
+	std::vector<BinaryMask*> band_masks = allocate_band_masks(masks, bands, hsv.rows, hsv.cols, storage);
+	std::vector<unsigned int> range_bits(hsv.cols);
+	for (int i = 0; i < hsv.rows; i++)
+	{
+		classify_hsv_row(classifier, hsv.ptr<uchar>(i), hsv.cols, range_bits, band_masks, i);
+	}
+	return masks;
+}
+
+struct BandRowBuffers
+{
+	std::vector<uchar> hsv_row;
+	std::vector<unsigned int> range_bits;
+};
+
+// Converts each BGR row of [row_begin, row_end) to HSV into a single row buffer and classifies
+// it right away, so the HSV image is never materialized.
+inline void classify_color_band_rows(const BandClassifier& classifier, const cv::Mat& image, int row_begin, int row_end, std::vector<BinaryMask*>& masks, HsvConversionMethod method, BandRowBuffers& buffers)
+{
+	buffers.hsv_row.resize(3 * (size_t)image.cols);
+	buffers.range_bits.resize(image.cols);
+	for (int i = row_begin; i < row_end; i++)
+	{
+		bgr2hsv_row(image.ptr<uchar>(i), buffers.hsv_row.data(), image.cols, method);
+		classify_hsv_row(classifier, buffers.hsv_row.data(), image.cols, buffers.range_bits, masks, i);
+	}
+}
+
+inline void classify_color_band_rows(const BandClassifier& classifier, const cv::Mat& image, int row_begin, int row_end, std::vector<BinaryMask*>& masks, HsvConversionMethod method)
+{
+	BandRowBuffers buffers;
+	classify_color_band_rows(classifier, image, row_begin, row_end, masks, method, buffers);
+}
+
+inline std::map<std::string, BinaryMask> classify_color_bands(const cv::Mat& image, const std::vector<ColorBand>& bands, MaskStorage storage = Mask_Bits, HsvConversionMethod method = best_hsv_conversion_method())
+{
+	CV_Assert(image.type() == CV_8UC3);
+	BandClassifier classifier = build_band_classifier(bands);
+	std::map<std::string, BinaryMask> masks;
+	std::vector<BinaryMask*> band_masks = allocate_band_masks(masks, bands, image.rows, image.cols, storage);
+	classify_color_band_rows(classifier, image, 0, image.rows, band_masks, method);
+	return masks;
+}
+
+#endif
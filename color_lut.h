@@ -0,0 +1,288 @@
+#ifndef COLOR_LUT_H
+#define COLOR_LUT_H
+
+#include <cstdint>
+#include <fstream>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+#include <opencv2/core/core.hpp>
+
+#include "color_bands.h"
+#include "hsv_conversion.h"
+#include "mask.h"
+#include "thread_pool.h"
+
+// A band set compiled into a table indexed by the BGR bytes of a pixel, holding bit b for every
+// band b the pixel falls in, so classification needs no HSV conversion. Lut_Full has one entry
+// per BGR value (16 MB). Lut_Quantized has one per cube of 8x8x8 BGR values; only the cubes cut
+// by a band boundary get a block of exact per-value entries, the others store the bits of the
+// whole cube (about 2.4 MB for the logo bands).
+enum BgrLutMode
+{
+	Lut_None,
+	Lut_Full,
+	Lut_Quantized
+};
+
+const int max_lut_bands = 8;
+const int lut_cell_shift = 3;
+const int lut_cell_bits = 8 - lut_cell_shift;
+const int lut_block_size = 1 << (3 * lut_cell_shift);
+// Set in a quantized cell whose low bits are the number of its block rather than band bits.
+const uint16_t lut_block_flag = 0x8000;
+
+struct BgrLut
+{
+	BgrLutMode mode = Lut_None;
+	std::vector<ColorBand> bands;
+	std::vector<unsigned int> band_bits;
+	// Lut_Full: band bits per BGR value.
+	std::vector<uint8_t> table;
+	// Lut_Quantized: band bits or block number per cube, and the blocks.
+	std::vector<uint16_t> cells;
+	std::vector<uint8_t> blocks;
+};
+
+inline size_t full_lut_index(int b, int g, int r)
+{
+	return ((size_t)b << 16) | ((size_t)g << 8) | (size_t)r;
+}
+
+inline size_t lut_cell_index(int b, int g, int r)
+{
+	return ((size_t)(b >> lut_cell_shift) << (2 * lut_cell_bits)) | ((size_t)(g >> lut_cell_shift) << lut_cell_bits) | (size_t)(r >> lut_cell_shift);
+}
+
+inline size_t lut_block_offset(int b, int g, int r)
+{
+	const int low = (1 << lut_cell_shift) - 1;
+	return ((size_t)(b & low) << (2 * lut_cell_shift)) | ((size_t)(g & low) << lut_cell_shift) | (size_t)(r & low);
+}
+
+// Band bits of one BGR pixel, through the same HSV conversion as the other paths.
+inline unsigned int exact_band_bits(const BandClassifier& classifier, const uchar* bgr)
+{
+	uchar hsv[3];
+	pixel_bgr2hsv_integer(bgr, hsv);
+	unsigned int range_bits = classifier.hue[hsv[0]] & classifier.saturation[hsv[1]] & classifier.value[hsv[2]];
+	unsigned int bits = 0;
+	for (size_t b = 0; b < classifier.band_ranges.size(); b++)
+	{
+		if (range_bits & classifier.band_ranges[b])
+			bits |= 1u << b;
+	}
+	return bits;
+}
+
+inline bool same_bands(const std::vector<ColorBand>& a, const std::vector<ColorBand>& b)
+{
+	if (a.size() != b.size())
+		return false;
+	for (size_t k = 0; k < a.size(); k++)
+	{
+		if (a[k].name != b[k].name || a[k].ranges.size() != b[k].ranges.size())
+			return false;
+		for (size_t r = 0; r < a[k].ranges.size(); r++)
+		{
+			for (int c = 0; c < 3; c++)
+			{
+				if (a[k].ranges[r].lower[c] != b[k].ranges[r].lower[c] || a[k].ranges[r].upper[c] != b[k].ranges[r].upper[c])
+					return false;
+			}
+		}
+	}
+	return true;
+}
+
+inline void set_lut_bands(BgrLut& lut, const std::vector<ColorBand>& bands, BgrLutMode mode)
+{
+	if (bands.size() > (size_t)max_lut_bands)
+		throw std::runtime_error("too many color bands for a lookup table");
+	lut.mode = mode;
+	lut.bands = bands;
+	lut.band_bits.clear();
+	for (size_t b = 0; b < bands.size(); b++)
+		lut.band_bits.push_back(1u << b);
+}
+
+// The full table is filled one blue value per task of pool, and the quantized one first as a
+// full block per cube, which is kept only when its entries differ.
+inline BgrLut build_bgr_lut(const std::vector<ColorBand>& bands, BgrLutMode mode, ThreadPool& pool)
+{
+	CV_Assert(mode == Lut_Full || mode == Lut_Quantized);
+	BgrLut lut;
+	set_lut_bands(lut, bands, mode);
+	BandClassifier classifier = build_band_classifier(bands);
+	if (mode == Lut_Full)
+	{
+		lut.table.assign((size_t)1 << 24, 0);
+		pool.parallel_for(256, [&](int b)
+		{
+			uchar bgr[3] = { (uchar)b, 0, 0 };
+			for (int g = 0; g < 256; g++)
+			{
+				bgr[1] = (uchar)g;
+				for (int r = 0; r < 256; r++)
+				{
+					bgr[2] = (uchar)r;
+					lut.table[full_lut_index(b, g, r)] = (uint8_t)exact_band_bits(classifier, bgr);
+				}
+			}
+		});
+		return lut;
+	}
+
+	int cells = 1 << lut_cell_bits;
+	int cell_size = 1 << lut_cell_shift;
+	std::vector<std::vector<uint8_t>> cell_blocks((size_t)1 << (3 * lut_cell_bits));
+	pool.parallel_for(cells, [&](int cell_b)
+	{
+		for (int cell_g = 0; cell_g < cells; cell_g++)
+		{
+			for (int cell_r = 0; cell_r < cells; cell_r++)
+			{
+				std::vector<uint8_t> block(lut_block_size);
+				bool uniform = true;
+				for (int b = cell_b * cell_size; b < (cell_b + 1) * cell_size; b++)
+				{
+					for (int g = cell_g * cell_size; g < (cell_g + 1) * cell_size; g++)
+					{
+						for (int r = cell_r * cell_size; r < (cell_r + 1) * cell_size; r++)
+						{
+							uchar bgr[3] = { (uchar)b, (uchar)g, (uchar)r };
+							uint8_t bits = (uint8_t)exact_band_bits(classifier, bgr);
+							block[lut_block_offset(b, g, r)] = bits;
+							uniform = uniform && bits == block[0];
+						}
+					}
+				}
+				if (!uniform)
+					cell_blocks[lut_cell_index(cell_b * cell_size, cell_g * cell_size, cell_r * cell_size)] = std::move(block);
+			}
+		}
+	});
+
+	lut.cells.assign(cell_blocks.size(), 0);
+	for (size_t cell = 0; cell < cell_blocks.size(); cell++)
+	{
+		if (cell_blocks[cell].empty())
+		{
+			int b = (int)(cell >> (2 * lut_cell_bits)) << lut_cell_shift;
+			int g = (int)((cell >> lut_cell_bits) & (cells - 1)) << lut_cell_shift;
+			int r = (int)(cell & (cells - 1)) << lut_cell_shift;
+			uchar bgr[3] = { (uchar)b, (uchar)g, (uchar)r };
+			lut.cells[cell] = (uint16_t)exact_band_bits(classifier, bgr);
+			continue;
+		}
+		lut.cells[cell] = (uint16_t)(lut_block_flag | (lut.blocks.size() / lut_block_size));
+		lut.blocks.insert(lut.blocks.end(), cell_blocks[cell].begin(), cell_blocks[cell].end());
+	}
+	return lut;
+}
+
+// Fraction of the quantized cells that need a block of their own.
+inline double mixed_lut_cell_fraction(const BgrLut& lut)
+{
+	return lut.cells.empty() ? 0 : (double)(lut.blocks.size() / lut_block_size) / lut.cells.size();
+}
+
+inline std::string bgr_lut_signature(const std::vector<ColorBand>& bands, BgrLutMode mode)
+{
+	std::ostringstream signature;
+	signature << (mode == Lut_Full ? "full" : "quantized");
+	for (const auto& band : bands)
+	{
+		signature << ' ' << band.name;
+		for (const auto& range : band.ranges)
+		{
+			for (int c = 0; c < 3; c++)
+				signature << ' ' << (int)range.lower[c] << ' ' << (int)range.upper[c];
+		}
+		signature << ';';
+	}
+	return signature.str();
+}
+
+// The table cached in path: read from there when it was built for the same bands and mode,
+// otherwise built and written there. Throws std::runtime_error when it cannot be written.
+inline BgrLut load_or_build_bgr_lut(const std::string& path, const std::vector<ColorBand>& bands, BgrLutMode mode, ThreadPool& pool)
+{
+	const std::string magic = "bgr-lut 2";
+	std::string signature = bgr_lut_signature(bands, mode);
+	{
+		std::ifstream file(path, std::ios::binary);
+		std::string file_magic;
+		std::string file_signature;
+		std::string size_line;
+		if (file && std::getline(file, file_magic) && std::getline(file, file_signature) && std::getline(file, size_line)
+			&& file_magic == magic && file_signature == signature)
+		{
+			BgrLut lut;
+			set_lut_bands(lut, bands, mode);
+			size_t table_size = 0;
+			size_t cell_count = 0;
+			size_t block_bytes = 0;
+			std::istringstream(size_line) >> table_size >> cell_count >> block_bytes;
+			bool sizes_match = mode == Lut_Full
+				? table_size == ((size_t)1 << 24) && cell_count == 0 && block_bytes == 0
+				: table_size == 0 && cell_count == ((size_t)1 << (3 * lut_cell_bits)) && block_bytes % lut_block_size == 0;
+			if (sizes_match)
+			{
+				lut.table.resize(table_size);
+				lut.cells.resize(cell_count);
+				lut.blocks.resize(block_bytes);
+				file.read((char*)lut.table.data(), (std::streamsize)lut.table.size());
+				file.read((char*)lut.cells.data(), (std::streamsize)(lut.cells.size() * sizeof(uint16_t)));
+				file.read((char*)lut.blocks.data(), (std::streamsize)lut.blocks.size());
+				if (file)
+					return lut;
+			}
+		}
+	}
+
+	BgrLut lut = build_bgr_lut(bands, mode, pool);
+	std::ofstream file(path, std::ios::binary);
+	file << magic << '\n' << signature << '\n' << lut.table.size() << ' ' << lut.cells.size() << ' ' << lut.blocks.size() << '\n';
+	file.write((const char*)lut.table.data(), (std::streamsize)lut.table.size());
+	file.write((const char*)lut.cells.data(), (std::streamsize)(lut.cells.size() * sizeof(uint16_t)));
+	file.write((const char*)lut.blocks.data(), (std::streamsize)lut.blocks.size());
+	if (!file)
+		throw std::runtime_error(path + ": cannot write lookup table");
+	return lut;
+}
+
+// Band bits of a row of BGR pixels into bits.
+inline void lookup_band_bits_row(const BgrLut& lut, const uchar* bgr, int width, unsigned int* bits)
+{
+	if (lut.mode == Lut_Full)
+	{
+		const uint8_t* table = lut.table.data();
+		for (int j = 0; j < width; j++, bgr += 3)
+		{
+			bits[j] = table[full_lut_index(bgr[0], bgr[1], bgr[2])];
+		}
+		return;
+	}
+	const uint16_t* cells = lut.cells.data();
+	const uint8_t* blocks = lut.blocks.data();
+	for (int j = 0; j < width; j++, bgr += 3)
+	{
+		unsigned int cell = cells[lut_cell_index(bgr[0], bgr[1], bgr[2])];
+		bits[j] = (cell & lut_block_flag) ? blocks[(cell & ~lut_block_flag) * (size_t)lut_block_size + lut_block_offset(bgr[0], bgr[1], bgr[2])] : cell;
+	}
+}
+
+// classify_color_band_rows through the table.
+inline void classify_lut_rows(const BgrLut& lut, const cv::Mat& image, int row_begin, int row_end, std::vector<BinaryMask*>& masks, BandRowBuffers& buffers)
+{
+	buffers.range_bits.resize(image.cols);
+	for (int i = row_begin; i < row_end; i++)
+	{
+		lookup_band_bits_row(lut, image.ptr<uchar>(i), image.cols, buffers.range_bits.data());
+		pack_band_masks(buffers.range_bits.data(), image.cols, lut.band_bits.data(), masks, i);
+	}
+}
+
+#endif
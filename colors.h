@@ -6,7 +6,9 @@
 #include <opencv2/highgui/highgui.hpp>
 #include <opencv2/imgproc/imgproc.hpp>
 
-cv::Vec3b pixel_bgr2hsv(cv::Vec3b& bgr_pixel)
+#include "hsv_conversion.h"
+
+inline cv::Vec3b pixel_bgr2hsv(cv::Vec3b& bgr_pixel)
 {
     double r = bgr_pixel[2];
     double g = bgr_pixel[1];
@@ -53,28 +55,21 @@ cv::Vec3b pixel_bgr2hsv(cv::Vec3b& bgr_pixel)
     return cv::Vec3b(h, s, v);
 }
 
-cv::Mat bgr2hsv(cv::Mat& image)
+inline cv::Mat bgr2hsv(cv::Mat& image, HsvConversionMethod method = best_hsv_conversion_method())
 {
-    cv::Mat hsv = cv::Mat::zeros(image.rows, image.cols, image.type());
-    for (int i = 0; i < image.rows; i++)
-    {
-        for (int j = 0; j < image.cols; j++)
-        {
-            cv::Vec3b bgr_pixel = image.at<cv::Vec3b>(i, j);
-            hsv.at<cv::Vec3b>(i, j) = pixel_bgr2hsv(bgr_pixel);
-        }
-    }
+    cv::Mat hsv;
+    bgr2hsv_into(image, hsv, method);
     return hsv;
 }
 
-bool inRangeInner(cv::Vec3b pixel, cv::Vec3b lower, cv::Vec3b upper)
+inline bool inRangeInner(cv::Vec3b pixel, cv::Vec3b lower, cv::Vec3b upper)
 {
     return pixel[0] >= lower[0] && pixel[0] <= upper[0] &&
         pixel[1] >= lower[1] && pixel[1] <= upper[1] &&
         pixel[2] >= lower[2] && pixel[2] <= upper[2];
 }
 
-cv::Mat inRange(cv::Mat& image, cv::Vec3b lower, cv::Vec3b upper)
+inline cv::Mat inRange(cv::Mat& image, cv::Vec3b lower, cv::Vec3b upper)
 {
     cv::Mat result = cv::Mat::zeros(image.rows, image.cols, image.type());
     for (int i = 0; i < image.rows; i++)
@@ -88,7 +83,7 @@ cv::Mat inRange(cv::Mat& image, cv::Vec3b lower, cv::Vec3b upper)
     return result;
 }
 
-cv::Mat mask_or(cv::Mat& mask1, cv::Mat& mask2)
+inline cv::Mat mask_or(cv::Mat& mask1, cv::Mat& mask2)
 {
     assert(mask1.rows == mask2.rows && mask1.cols == mask2.cols);
     cv::Mat result = cv::Mat::zeros(mask1.rows, mask1.cols, mask1.type());
@@ -104,7 +99,7 @@ cv::Mat mask_or(cv::Mat& mask1, cv::Mat& mask2)
     return result;
 }
 
-cv::Mat mask_and(cv::Mat& mask1, cv::Mat& mask2)
+inline cv::Mat mask_and(cv::Mat& mask1, cv::Mat& mask2)
 {
     assert(mask1.rows == mask2.rows && mask1.cols == mask2.cols);
     cv::Mat result = cv::Mat::zeros(mask1.rows, mask1.cols, mask1.type());
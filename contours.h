@@ -0,0 +1,174 @@
+#ifndef CONTOURS_H
+#define CONTOURS_H
+
+#include <algorithm>
+#include <cstdint>
+#include <vector>
+
+#include "moments.h"
+#include "segments.h"
+
+// Steps of a crack code: a contour runs along the edges between pixels, from corner to corner.
+// Corner (row, col) is the top-left corner of pixel (row, col).
+enum CrackStep
+{
+	Crack_Right,
+	Crack_Down,
+	Crack_Left,
+	Crack_Up
+};
+
+// A closed contour with the segment on the right of every step, so outer contours go clockwise
+// and holes counterclockwise on screen. Steps are packed four to a byte.
+struct Contour
+{
+	int start_row = 0;
+	int start_col = 0;
+	bool hole = false;
+	size_t length = 0;
+	std::vector<uint8_t> codes;
+
+	CrackStep step(size_t k) const
+	{
+		return (CrackStep)((codes[k >> 2] >> (2 * (k & 3))) & 3);
+	}
+
+	void push_step(CrackStep step)
+	{
+		if ((length & 3) == 0)
+			codes.push_back(0);
+		codes.back() |= (uint8_t)(step << (2 * (length & 3)));
+		length++;
+	}
+};
+
+// Runs of a segment indexed by row, with the vertical edges a trace has passed.
+struct SegmentRows
+{
+	const Segment* segment;
+	std::vector<size_t> row_begin;
+	std::vector<bool> begin_visited;
+	std::vector<bool> end_visited;
+
+	explicit SegmentRows(const Segment& s)
+		: segment(&s), row_begin(s.get_height() + 1, s.runs.size()), begin_visited(s.runs.size(), false), end_visited(s.runs.size(), false)
+	{
+		for (size_t k = s.runs.size(); k-- > 0; )
+		{
+			row_begin[s.runs[k].row - s.row_min] = k;
+		}
+		for (int r = s.get_height() - 1; r >= 0; r--)
+		{
+			row_begin[r] = std::min(row_begin[r], row_begin[r + 1]);
+		}
+	}
+
+	// Index of the run of row holding col, or -1.
+	int run_at(int row, int col) const
+	{
+		if (row < segment->row_min || row > segment->row_max)
+			return -1;
+		const std::vector<SegmentRun>& runs = segment->runs;
+		size_t begin = row_begin[row - segment->row_min];
+		size_t end = row_begin[row - segment->row_min + 1];
+		size_t k = std::upper_bound(runs.begin() + begin, runs.begin() + end, col, [](int c, const SegmentRun& run) { return c < run.col_end; }) - runs.begin();
+		return k < end && runs[k].col_begin <= col ? (int)k : -1;
+	}
+
+	bool covers(int row, int col) const
+	{
+		return run_at(row, col) >= 0;
+	}
+};
+
+// Follows the contour through the vertical edge a trace starts on. At every corner the segment
+// pixels ahead decide the turn; two pixels touching only at a corner are kept apart, matching
+// the 4-connectivity of the labeling.
+inline Contour trace_contour(SegmentRows& rows, int start_row, int start_col, CrackStep start_step, bool hole)
+{
+	Contour contour;
+	contour.start_row = start_row;
+	contour.start_col = start_col;
+	contour.hole = hole;
+	int row = start_row;
+	int col = start_col;
+	CrackStep step = start_step;
+	do
+	{
+		contour.push_step(step);
+		switch (step)
+		{
+		case Crack_Right: col++; break;
+		case Crack_Down: rows.end_visited[rows.run_at(row, col - 1)] = true; row++; break;
+		case Crack_Left: col--; break;
+		case Crack_Up: row--; rows.begin_visited[rows.run_at(row, col)] = true; break;
+		}
+		// The pixels ahead of the corner, on the left and on the right of the current direction.
+		bool ahead_left = false;
+		bool ahead_right = false;
+		switch (step)
+		{
+		case Crack_Right: ahead_left = rows.covers(row - 1, col); ahead_right = rows.covers(row, col); break;
+		case Crack_Down: ahead_left = rows.covers(row, col); ahead_right = rows.covers(row, col - 1); break;
+		case Crack_Left: ahead_left = rows.covers(row, col - 1); ahead_right = rows.covers(row - 1, col - 1); break;
+		case Crack_Up: ahead_left = rows.covers(row - 1, col - 1); ahead_right = rows.covers(row - 1, col); break;
+		}
+		if (!ahead_right)
+			step = (CrackStep)((step + 1) & 3);
+		else if (ahead_left)
+			step = (CrackStep)((step + 3) & 3);
+	} while (row != start_row || col != start_col || step != start_step);
+	return contour;
+}
+
+// Outer contour first, then one contour per hole, found at the first run edge in raster order
+// no earlier contour passed.
+inline std::vector<Contour> trace_contours(const Segment& segment)
+{
+	std::vector<Contour> contours;
+	if (segment.runs.empty())
+		return contours;
+	SegmentRows rows(segment);
+	const SegmentRun& first = segment.runs[0];
+	contours.push_back(trace_contour(rows, first.row, first.col_begin, Crack_Right, false));
+	for (size_t k = 0; k < segment.runs.size(); k++)
+	{
+		const SegmentRun& run = segment.runs[k];
+		if (!rows.begin_visited[k])
+			contours.push_back(trace_contour(rows, run.row + 1, run.col_begin, Crack_Up, true));
+		if (!rows.end_visited[k])
+			contours.push_back(trace_contour(rows, run.row, run.col_end, Crack_Down, true));
+	}
+	return contours;
+}
+
+// Discrete Green's theorem: every row of a segment is the sum of its pixels left of the edges
+// where contours go down minus those left of the edges where they go up. The sums are exact, so
+// the result equals Segment::raw_moments at a cost of the contour length.
+inline RawMoments contour_moments(const std::vector<Contour>& contours)
+{
+	RawMoments raw;
+	for (const auto& contour : contours)
+	{
+		int row = contour.start_row;
+		int col = contour.start_col;
+		for (size_t k = 0; k < contour.length; k++)
+		{
+			switch (contour.step(k))
+			{
+			case Crack_Right: col++; break;
+			case Crack_Down: raw.add_edge(row, col, 1); row++; break;
+			case Crack_Left: col--; break;
+			case Crack_Up: row--; raw.add_edge(row, col, -1); break;
+			}
+		}
+	}
+	return raw;
+}
+
+inline RotationInvariants hu_moments(const std::vector<Contour>& contours)
+{
+	return hu_moments(mu_table(contour_moments(contours)));
+}
+
+#endif
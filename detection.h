@@ -0,0 +1,237 @@
+#ifndef DETECTION_H
+#define DETECTION_H
+
+#include <algorithm>
+#include <map>
+#include <string>
+#include <vector>
+#include <opencv2/core/core.hpp>
+
+#include "color_bands.h"
+#include "filters.h"
+#include "logo.h"
+#include "segments.h"
+#include "shape_classifier.h"
+#include "shape_matching.h"
+#include "thread_pool.h"
+#include "tiling.h"
+#include "trace.h"
+
+inline std::vector<ColorBand> logo_color_bands()
+{
+	return {
+			{ "blue", { { cv::Vec3b(80, 40, 30), cv::Vec3b(130, 255, 225) } } },
+			{ "red", { { cv::Vec3b(0, 50, 100), cv::Vec3b(15, 255, 255) }, { cv::Vec3b(160, 50, 50), cv::Vec3b(179, 255, 255) } } },
+			{ "yellow", { { cv::Vec3b(20, 100, 100), cv::Vec3b(30, 255, 255) } } }
+	};
+}
+
+// Size limits of the letters and of the yellow disc around them, and the dilation that closes
+// gaps in the disc before it is segmented.
+struct DetectionLimits
+{
+	SegmentLimits blue{ 7, 5, 150, 150 };
+	SegmentLimits red{ 5, 5, 150, 150 };
+	SegmentLimits yellow{ 15, 30, 500, 500 };
+	int dilation_size = 3;
+	int dilation_iterations = 1;
+};
+
+// Everything detect_logos allocates for one frame. Passing the same FrameBuffers to the next
+// call reuses all of it: masks, labeling, segments and logos keep their storage and are only
+// overwritten, so after the first frames of a given size no heap allocation is left.
+struct FrameBuffers
+{
+	ColorBandBuffers color_bands;
+	FilterBuffers filter;
+	BinaryMask dilated_yellow;
+	LabelingBuffers labeling_buffers;
+	Labeling labeling;
+	// One per color, so every color keeps the run vectors sized after its own components.
+	SegmentBuffers blue_segment_buffers;
+	SegmentBuffers red_segment_buffers;
+	SegmentBuffers yellow_segment_buffers;
+	std::vector<Segment> blue_segments;
+	std::vector<Segment> red_segments;
+	std::vector<Segment> yellow_segments;
+	LogoBuffers logo_buffers;
+	std::vector<Logo> logos;
+	// Where detect_logos records its stages and counters, if anywhere.
+	FrameTrace* trace = nullptr;
+	// Lookup table for the color bands, compiled from the bands passed to detect_logos.
+	const BgrLut* lut = nullptr;
+};
+
+inline int band_index(const std::vector<ColorBand>& bands, const std::string& name)
+{
+	for (size_t b = 0; b < bands.size(); b++)
+	{
+		if (bands[b].name == name)
+			return (int)b;
+	}
+	CV_Error(cv::Error::StsBadArg, "no color band named " + name);
+	return -1;
+}
+
+inline void segment_mask(const BinaryMask& mask, ThreadPool& pool, FrameBuffers& buffers, std::vector<Segment>& segments, SegmentBuffers& segment_buffers)
+{
+	label_runs(mask, pool, buffers.labeling, buffers.labeling_buffers);
+	segments_from_labeling(buffers.labeling, segments, segment_buffers);
+}
+
+// segment_mask and filter_segments_in_place as the span stage, counting the segments before
+// filtering as found and after it as kept.
+inline void segment_and_filter(const BinaryMask& mask, ThreadPool& pool, FrameBuffers& buffers, std::vector<Segment>& segments, SegmentBuffers& segment_buffers, const SegmentLimits& limits, const char* stage, const char* found, const char* kept)
+{
+	TraceScope scope(buffers.trace, stage);
+	segment_mask(mask, pool, buffers, segments, segment_buffers);
+	if (tracing(buffers.trace))
+		buffers.trace->count(found, (long long)segments.size());
+	filter_segments_in_place(segments, limits, segment_buffers.spare);
+	if (tracing(buffers.trace))
+		buffers.trace->count(kept, (long long)segments.size());
+}
+
+inline void trace_cascade(FrameTrace& trace, const CascadeStats& stats)
+{
+	trace.count("yellow_candidates", stats.yellow_candidates);
+	trace.count("rejected_aspect_ratio", stats.rejected_aspect_ratio);
+	trace.count("rejected_fill_ratio", stats.rejected_fill_ratio);
+	trace.count("rejected_containment", stats.rejected_containment);
+	trace.count("rejected_second_order", stats.rejected_second_order);
+	trace.count("rejected_hu", stats.rejected_hu);
+	trace.count("letter_candidates", stats.letter_candidates);
+	trace.count("letters_rejected_second_order", stats.letters_rejected_second_order);
+	trace.count("letters_rejected_hu", stats.letters_rejected_hu);
+	trace.count("hu_moments", stats.hu_computed);
+	trace.count("logos", stats.logos);
+}
+
+// For every class in classes, the classified segments whose second-order bounds failed and
+// those that passed them but failed on the full invariants.
+inline void trace_class_rejections(FrameTrace& trace, const ShapeClassifier& classifier, const SegmentClasses& result, ShapeMask classes)
+{
+	for (int k = 0; k < classifier.size(); k++)
+	{
+		ShapeMask bit = ShapeMask(1) << k;
+		if (!(classes & bit))
+			continue;
+		long long second_order = 0;
+		long long hu = 0;
+		for (size_t i = 0; i < result.second_order.size(); i++)
+		{
+			if (!result.classified[i])
+				continue;
+			if (!(result.second_order[i] & bit))
+				second_order++;
+			else if (!(result.full[i] & bit))
+				hu++;
+		}
+		trace.count(classifier.second_order_counters[k], second_order);
+		trace.count(classifier.hu_counters[k], hu);
+	}
+}
+
+// The whole per-frame pipeline; the tiled stages run on pool. The result lives in buffers and
+// is overwritten by the next call with the same buffers.
+inline const std::vector<Logo>& detect_logos(const cv::Mat& image, const std::vector<ColorBand>& bands, ThreadPool& pool, FrameBuffers& buffers, CascadeStats* stats = nullptr, const ShapeClassifier& classifier = logo_shape_classifier(), const DetectionLimits& limits = DetectionLimits())
+{
+	FrameTrace* trace = tracing(buffers.trace) ? buffers.trace : nullptr;
+	{
+		TraceScope scope(trace, "classify_color_bands");
+		classify_color_bands(image, bands, pool, buffers.color_bands, Mask_Bits, best_hsv_conversion_method(), buffers.lut);
+	}
+	std::vector<BinaryMask>& masks = buffers.color_bands.masks;
+	if (trace)
+	{
+		trace->count("pixels", (long long)image.rows * image.cols);
+		trace->count("blue_pixels", mask_area(masks[band_index(bands, "blue")]));
+		trace->count("red_pixels", mask_area(masks[band_index(bands, "red")]));
+		trace->count("yellow_pixels", mask_area(masks[band_index(bands, "yellow")]));
+	}
+
+
+	std::vector<Segment>& blue_segments = buffers.blue_segments;
+	segment_and_filter(masks[band_index(bands, "blue")], pool, buffers, blue_segments, buffers.blue_segment_buffers, limits.blue, "segment_blue", "blue_segments", "blue_segments_kept");
+	std::sort(blue_segments.begin(), blue_segments.end(), compare_segments_by_x);
+
+	std::vector<Segment>& red_segments = buffers.red_segments;
+	segment_and_filter(masks[band_index(bands, "red")], pool, buffers, red_segments, buffers.red_segment_buffers, limits.red, "segment_red", "red_segments", "red_segments_kept");
+	std::sort(red_segments.begin(), red_segments.end(), compare_segments_by_y);
+
+
+	std::vector<Segment>& yellow_segments = buffers.yellow_segments;
+	{
+		TraceScope scope(trace, "dilation_filter");
+		dilation_filter(masks[band_index(bands, "yellow")], limits.dilation_size, limits.dilation_iterations, pool, buffers.dilated_yellow, buffers.filter);
+	}
+	segment_and_filter(buffers.dilated_yellow, pool, buffers, yellow_segments, buffers.yellow_segment_buffers, limits.yellow, "segment_yellow", "yellow_segments", "yellow_segments_kept");
+
+
+	CascadeStats frame_stats;
+	{
+		TraceScope scope(trace, "build_logos");
+		build_logos(yellow_segments, blue_segments, red_segments, buffers.logos, buffers.logo_buffers, trace ? &frame_stats : stats, classifier);
+	}
+	if (!trace)
+		return buffers.logos;
+	if (stats)
+		stats->add(frame_stats);
+	trace_cascade(*trace, frame_stats);
+	trace_class_rejections(*trace, classifier, buffers.logo_buffers.yellow, classifier.mask_of(Yellow_Circle));
+	trace_class_rejections(*trace, classifier, buffers.logo_buffers.blue, classifier.mask_of(Letter_L) | classifier.mask_of(Letter_D));
+	trace_class_rejections(*trace, classifier, buffers.logo_buffers.red, classifier.mask_of(Red_Dot) | classifier.mask_of(Letter_I) | classifier.mask_of(Letter_I_With_Dot));
+	return buffers.logos;
+}
+
+inline std::vector<Logo> detect_logos(const cv::Mat& image, const std::vector<ColorBand>& bands, ThreadPool& pool, CascadeStats* stats = nullptr, const ShapeClassifier& classifier = logo_shape_classifier(), const DetectionLimits& limits = DetectionLimits())
+{
+	FrameBuffers buffers;
+	detect_logos(image, bands, pool, buffers, stats, classifier, limits);
+	return std::move(buffers.logos);
+}
+
+// Overlapping regions are replaced by their bounding box until no two regions overlap, so
+// no logo is searched for twice.
+inline std::vector<cv::Rect> merge_regions(std::vector<cv::Rect> regions)
+{
+	regions.erase(std::remove_if(regions.begin(), regions.end(), [](const cv::Rect& r) { return r.empty(); }), regions.end());
+	bool merged = true;
+	while (merged)
+	{
+		merged = false;
+		for (size_t a = 0; a < regions.size() && !merged; a++)
+		{
+			for (size_t b = a + 1; b < regions.size() && !merged; b++)
+			{
+				if (!(regions[a] & regions[b]).empty())
+				{
+					regions[a] = regions[a] | regions[b];
+					regions.erase(regions.begin() + b);
+					merged = true;
+				}
+			}
+		}
+	}
+	return regions;
+}
+
+// detect_logos on the view image(region), with the logos moved back into image coordinates.
+inline const std::vector<Logo>& detect_logos_in_region(const cv::Mat& image, const cv::Rect& region, const std::vector<ColorBand>& bands, ThreadPool& pool, FrameBuffers& buffers, CascadeStats* stats = nullptr, const ShapeClassifier& classifier = logo_shape_classifier(), const DetectionLimits& limits = DetectionLimits())
+{
+	detect_logos(image(region), bands, pool, buffers, stats, classifier, limits);
+	for (auto& logo : buffers.logos)
+	{
+		translate_logo(logo, region.y, region.x);
+	}
+	return buffers.logos;
+}
+
+inline std::vector<Logo> detect_logos_in_region(const cv::Mat& image, const cv::Rect& region, const std::vector<ColorBand>& bands, ThreadPool& pool, CascadeStats* stats = nullptr, const ShapeClassifier& classifier = logo_shape_classifier(), const DetectionLimits& limits = DetectionLimits())
+{
+	FrameBuffers buffers;
+	detect_logos_in_region(image, region, bands, pool, buffers, stats, classifier, limits);
+	return std::move(buffers.logos);
+}
+
+#endif
@@ -0,0 +1,112 @@
+#ifndef DETECTIONS_OUTPUT_H
+#define DETECTIONS_OUTPUT_H
+
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <ostream>
+#include <string>
+#include <vector>
+#include <opencv2/core/core.hpp>
+
+#include "logo.h"
+
+// What run_batch writes: annotated copies of the images, or a single detections.json /
+// detections.csv with the logo boxes of every image and no image data at all.
+enum OutputFormat
+{
+	Output_Images,
+	Output_Json,
+	Output_Csv
+};
+
+struct ImageDetections
+{
+	std::string path;
+	std::vector<cv::Rect> boxes;
+};
+
+// Quotes and backslashes get a backslash, control characters become \u00XX.
+inline std::string json_escape(const std::string& text)
+{
+	std::string escaped;
+	for (char c : text)
+	{
+		if ((unsigned char)c < 0x20)
+		{
+			char code[8];
+			snprintf(code, sizeof(code), "\\u%04x", (unsigned char)c);
+			escaped += code;
+			continue;
+		}
+		if (c == '"' || c == '\\')
+			escaped += '\\';
+		escaped += c;
+	}
+	return escaped;
+}
+
+// Quoted when it contains a separator, a quote or a line break, with quotes doubled.
+inline std::string csv_field(const std::string& text)
+{
+	if (text.find_first_of(",\"\r\n") == std::string::npos)
+		return text;
+	std::string quoted = "\"";
+	for (char c : text)
+	{
+		if (c == '"')
+			quoted += '"';
+		quoted += c;
+	}
+	return quoted + "\"";
+}
+
+// One entry per image, images without logos included, boxes as x, y, width, height.
+inline void write_detections_json(std::ostream& out, const std::vector<ImageDetections>& images)
+{
+	out << "[\n";
+	for (size_t i = 0; i < images.size(); i++)
+	{
+		out << "  { \"image\": \"" << json_escape(images[i].path) << "\", \"logos\": [";
+		for (size_t k = 0; k < images[i].boxes.size(); k++)
+		{
+			const cv::Rect& box = images[i].boxes[k];
+			out << (k > 0 ? ", " : " ") << "{ \"x\": " << box.x << ", \"y\": " << box.y
+				<< ", \"width\": " << box.width << ", \"height\": " << box.height << " }";
+		}
+		out << (images[i].boxes.empty() ? "] }" : " ] }") << (i + 1 < images.size() ? ",\n" : "\n");
+	}
+	out << "]\n";
+}
+
+// One row per logo.
+inline void write_detections_csv(std::ostream& out, const std::vector<ImageDetections>& images)
+{
+	out << "image,x,y,width,height\n";
+	for (const auto& image : images)
+	{
+		for (const auto& box : image.boxes)
+			out << csv_field(image.path) << ',' << box.x << ',' << box.y << ',' << box.width << ',' << box.height << '\n';
+	}
+}
+
+// output_dir/detections.json or detections.csv; false, with a message, when it cannot be written.
+inline bool write_detections_file(const std::string& output_dir, OutputFormat format, const std::vector<ImageDetections>& images)
+{
+	std::error_code error;
+	std::filesystem::create_directories(output_dir, error);
+	std::string path = (std::filesystem::path(output_dir) / (format == Output_Json ? "detections.json" : "detections.csv")).string();
+	std::ofstream file(path);
+	if (format == Output_Json)
+		write_detections_json(file, images);
+	else
+		write_detections_csv(file, images);
+	if (!file)
+	{
+		fprintf(stderr, "%s: cannot write detections\n", path.c_str());
+		return false;
+	}
+	return true;
+}
+
+#endif
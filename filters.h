@@ -5,6 +5,8 @@
 #include <opencv2/highgui/highgui.hpp>
 #include <opencv2/imgproc/imgproc.hpp>
 
+#include "mask.h"
+
 enum FilterType
 {
 	Erosion,
@@ -12,54 +14,224 @@ enum FilterType
 	Dilation
 };
 
-int calculate_operation(std::vector<int> row, FilterType type)
+struct VanHerkBuffers
+{
+	std::vector<uchar> prefix;
+	std::vector<uchar> suffix;
+	std::vector<uchar> identity;
+};
+
+inline void combine_extremum(const uchar* a, const uchar* b, uchar* dst, int lanes, bool take_max)
+{
+	if (take_max)
+	{
+		for (int k = 0; k < lanes; ++k)
+			dst[k] = std::max(a[k], b[k]);
+	}
+	else
+	{
+		for (int k = 0; k < lanes; ++k)
+			dst[k] = std::min(a[k], b[k]);
+	}
+}
+
+// One van Herk/Gil-Werman pass over count elements of lanes bytes each: dst[x] becomes the min (max)
+// of src[x + window_begin .. x + window_begin + window_size - 1], elements outside the line being ignored.
+// The line, padded with window_size identity elements on both sides, is cut into blocks of window_size,
+// so every window is the suffix of one block joined with the prefix of the next: three comparisons per
+// element whatever the window size.
+inline void van_herk_pass(const uchar* src, size_t src_step, uchar* dst, size_t dst_step, int count, int lanes, int window_begin, int window_size, bool take_max, VanHerkBuffers& buffers)
+{
+	assert(window_begin <= 0 && window_begin >= -window_size);
+	int padded = count + 2 * window_size;
+	buffers.prefix.resize((size_t)padded * lanes);
+	buffers.suffix.resize((size_t)padded * lanes);
+	buffers.identity.assign(lanes, take_max ? 0 : 255);
+	uchar* prefix = buffers.prefix.data();
+	uchar* suffix = buffers.suffix.data();
+
+	for (int i = 0; i < padded; ++i)
+	{
+		int j = i - window_size;
+		const uchar* element = (j >= 0 && j < count) ? src + (size_t)j * src_step : buffers.identity.data();
+		uchar* out = prefix + (size_t)i * lanes;
+		if (i % window_size == 0)
+			std::copy(element, element + lanes, out);
+		else
+			combine_extremum(out - lanes, element, out, lanes, take_max);
+	}
+	for (int i = padded - 1; i >= 0; --i)
+	{
+		int j = i - window_size;
+		const uchar* element = (j >= 0 && j < count) ? src + (size_t)j * src_step : buffers.identity.data();
+		uchar* out = suffix + (size_t)i * lanes;
+		if (i == padded - 1 || (i + 1) % window_size == 0)
+			std::copy(element, element + lanes, out);
+		else
+			combine_extremum(out + lanes, element, out, lanes, take_max);
+	}
+	for (int x = 0; x < count; ++x)
+	{
+		int s = x + window_begin + window_size;
+		combine_extremum(suffix + (size_t)s * lanes, prefix + (size_t)(s + window_size - 1) * lanes, dst + (size_t)x * dst_step, lanes, take_max);
+	}
+}
+
+// Separable min/max of every channel over the rows and columns [x + window_begin, x + window_begin + window_size),
+// clipped to the image. Pixels closer than border to the image edge are set to 0.
+inline cv::Mat extremum_filter(const cv::Mat& src, int window_begin, int window_size, int border, FilterType type)
 {
-	switch (type)
+	CV_Assert(src.depth() == CV_8U && (type == Erosion || type == Dilation));
+	cv::Mat dst = cv::Mat::zeros(src.rows, src.cols, src.type());
+	if (src.rows <= 2 * border || src.cols <= 2 * border)
+		return dst;
+
+	bool take_max = type == Dilation;
+	int channels = src.channels();
+	VanHerkBuffers buffers;
+	cv::Mat horizontal(src.rows, src.cols, src.type());
+	for (int x = 0; x < src.rows; ++x)
+	{
+		van_herk_pass(src.ptr<uchar>(x), channels, horizontal.ptr<uchar>(x), channels, src.cols, channels, window_begin, window_size, take_max, buffers);
+	}
+
+	// The vertical pass runs on strips of whole rows, each row of the strip being one vector of lanes.
+	const int strip_width = 256;
+	int row_bytes = src.cols * channels;
+	for (int b = 0; b < row_bytes; b += strip_width)
 	{
-	case Erosion:
-		return *std::min_element(row.begin(), row.end());
-	case Median:
-		std::sort(row.begin(), row.end());
-		return row[row.size() / 2];
-	case Dilation:
-		return *std::max_element(row.begin(), row.end());
-	default:
-		return 0;
+		van_herk_pass(horizontal.ptr<uchar>(0) + b, horizontal.step, dst.ptr<uchar>(0) + b, dst.step, src.rows, std::min(strip_width, row_bytes - b), window_begin, window_size, take_max, buffers);
 	}
+
+	for (int x = 0; x < src.rows; ++x)
+	{
+		uchar* row = dst.ptr<uchar>(x);
+		if (x < border || x >= src.rows - border)
+		{
+			std::fill(row, row + row_bytes, 0);
+			continue;
+		}
+		std::fill(row, row + border * channels, 0);
+		std::fill(row + row_bytes - border * channels, row + row_bytes, 0);
+	}
+	return dst;
 }
 
-cv::Mat rank_filter(cv::Mat& src, int filter_size, FilterType type)
+// Constant-time median (Perreault and Hebert): one 256-bin histogram per column covers the filter_size
+// rows of the window and slides down one row at a time, and the window histogram slides along the row
+// by adding one column histogram and removing another, so the cost does not depend on filter_size.
+// A 16-bin coarse histogram next to each fine one narrows the median search to 32 bins.
+inline cv::Mat median_filter(const cv::Mat& src, int filter_size)
 {
+	CV_Assert(src.depth() == CV_8U && filter_size >= 1 && filter_size <= 255);
 	cv::Mat dst = cv::Mat::zeros(src.rows, src.cols, src.type());
 	int offset = filter_size / 2;
-	std::vector<std::vector<int>> acc(3, std::vector<int>(filter_size * filter_size, 0));
-	for (int x = offset; x < src.rows - offset; ++x)
+	if (src.rows <= 2 * offset || src.cols <= 2 * offset)
+		return dst;
+
+	int channels = src.channels();
+	int rank = filter_size * filter_size / 2;
+	std::vector<uint16_t> fine_columns((size_t)src.cols * 256);
+	std::vector<uint16_t> coarse_columns((size_t)src.cols * 16);
+	uint16_t fine[256];
+	uint16_t coarse[16];
+	for (int c = 0; c < channels; ++c)
 	{
-		for (int y = offset; y < src.cols - offset; ++y)
+		std::fill(fine_columns.begin(), fine_columns.end(), 0);
+		std::fill(coarse_columns.begin(), coarse_columns.end(), 0);
+		for (int x = 0; x < filter_size - 1; ++x)
+		{
+			const uchar* row = src.ptr<uchar>(x);
+			for (int y = 0; y < src.cols; ++y)
+			{
+				uchar v = row[y * channels + c];
+				fine_columns[(size_t)y * 256 + v]++;
+				coarse_columns[(size_t)y * 16 + (v >> 4)]++;
+			}
+		}
+
+		for (int x = offset; x < src.rows - offset; ++x)
 		{
-			for (int a = 0; a < filter_size; ++a)
+			const uchar* entering = src.ptr<uchar>(x - offset + filter_size - 1);
+			for (int y = 0; y < src.cols; ++y)
 			{
-				for (int b = 0; b < filter_size; ++b)
+				uchar v = entering[y * channels + c];
+				fine_columns[(size_t)y * 256 + v]++;
+				coarse_columns[(size_t)y * 16 + (v >> 4)]++;
+			}
+
+			std::fill(fine, fine + 256, 0);
+			std::fill(coarse, coarse + 16, 0);
+			for (int y = 0; y < filter_size - 1; ++y)
+			{
+				for (int v = 0; v < 256; ++v)
+					fine[v] += fine_columns[(size_t)y * 256 + v];
+				for (int v = 0; v < 16; ++v)
+					coarse[v] += coarse_columns[(size_t)y * 16 + v];
+			}
+
+			uchar* out = dst.ptr<uchar>(x);
+			for (int y = offset; y < src.cols - offset; ++y)
+			{
+				const uint16_t* added = &fine_columns[(size_t)(y - offset + filter_size - 1) * 256];
+				const uint16_t* added_coarse = &coarse_columns[(size_t)(y - offset + filter_size - 1) * 16];
+				for (int v = 0; v < 256; ++v)
+					fine[v] += added[v];
+				for (int v = 0; v < 16; ++v)
+					coarse[v] += added_coarse[v];
+
+				int bin = 0;
+				int seen = coarse[0];
+				while (seen <= rank)
+					seen += coarse[++bin];
+				seen -= coarse[bin];
+				int median = 16 * bin;
+				for (seen += fine[median]; seen <= rank; seen += fine[++median])
 				{
-					int xn = x + a - offset;
-					int yn = y + b - offset;
-					cv::Vec3b p = src.at<cv::Vec3b>(xn, yn);
-					acc[0][a * filter_size + b] = p[0];
-					acc[1][a * filter_size + b] = p[1];
-					acc[2][a * filter_size + b] = p[2];
 				}
+				out[y * channels + c] = (uchar)median;
+
+				const uint16_t* removed = &fine_columns[(size_t)(y - offset) * 256];
+				const uint16_t* removed_coarse = &coarse_columns[(size_t)(y - offset) * 16];
+				for (int v = 0; v < 256; ++v)
+					fine[v] -= removed[v];
+				for (int v = 0; v < 16; ++v)
+					coarse[v] -= removed_coarse[v];
+			}
 
+			const uchar* leaving = src.ptr<uchar>(x - offset);
+			for (int y = 0; y < src.cols; ++y)
+			{
+				uchar v = leaving[y * channels + c];
+				fine_columns[(size_t)y * 256 + v]--;
+				coarse_columns[(size_t)y * 16 + (v >> 4)]--;
 			}
-			dst.at<cv::Vec3b>(x, y)[0] = calculate_operation(acc[0], type);
-			dst.at<cv::Vec3b>(x, y)[1] = calculate_operation(acc[1], type);
-			dst.at<cv::Vec3b>(x, y)[2] = calculate_operation(acc[2], type);
 		}
 	}
 	return dst;
 }
 
-cv::Mat erosion_filter(cv::Mat& src, int filter_size, int num_iter)
+// Window of filter_size x filter_size pixels starting filter_size / 2 above and left of the pixel;
+// pixels closer than filter_size / 2 to the image border are left at 0.
+inline cv::Mat rank_filter(const cv::Mat& src, int filter_size, FilterType type)
+{
+	CV_Assert(filter_size >= 1);
+	if (type == Median)
+		return median_filter(src, filter_size);
+	int offset = filter_size / 2;
+	return extremum_filter(src, -offset, filter_size, offset, type);
+}
+
+// num_iter passes of an odd filter_size min/max filter equal a single pass with a window of
+// num_iter * (filter_size - 1) + 1. The zeroed border of an erosion grows by filter_size / 2 per pass,
+// while a dilation keeps the border of one pass and clips the larger window to the image.
+inline cv::Mat erosion_filter(const cv::Mat& src, int filter_size, int num_iter)
 {
+	if (num_iter > 1 && filter_size % 2 == 1)
+	{
+		int radius = num_iter * (filter_size / 2);
+		return extremum_filter(src, -radius, 2 * radius + 1, radius, Erosion);
+	}
 	cv::Mat result = src.clone();
 	for (int i = 0; i < num_iter; ++i)
 	{
@@ -68,8 +240,13 @@ cv::Mat erosion_filter(cv::Mat& src, int filter_size, int num_iter)
 	return result;
 }
 
-cv::Mat dilation_filter(cv::Mat& src, int filter_size, int num_iter)
+inline cv::Mat dilation_filter(const cv::Mat& src, int filter_size, int num_iter)
 {
+	if (num_iter > 1 && filter_size % 2 == 1)
+	{
+		int radius = num_iter * (filter_size / 2);
+		return extremum_filter(src, -radius, 2 * radius + 1, filter_size / 2, Dilation);
+	}
 	cv::Mat result = src.clone();
 	for (int i = 0; i < num_iter; ++i)
 	{
@@ -78,4 +255,189 @@ cv::Mat dilation_filter(cv::Mat& src, int filter_size, int num_iter)
 	return result;
 }
 
+// The binary filters grow their window by doubling: afterwards element j holds the AND (OR) of elements
+// j .. j + span - 1 for the largest power of two span <= window_size, and any window of window_size
+// elements is the union of two overlapping spans. Elements past the end read as 0.
+inline int double_bit_span(uint64_t* words, int count, int window_size, bool dilate)
+{
+	int span = 1;
+	for (; 2 * span <= window_size; span *= 2)
+	{
+		for (int w = 0; w < count; ++w)
+		{
+			uint64_t shifted = shifted_mask_word(words, count, w, span);
+			words[w] = dilate ? (words[w] | shifted) : (words[w] & shifted);
+		}
+	}
+	return span;
+}
+
+inline int double_byte_span(uchar* bytes, int count, int window_size, bool dilate)
+{
+	int span = 1;
+	for (; 2 * span <= window_size; span *= 2)
+	{
+		for (int j = 0; j < count; ++j)
+		{
+			uchar next = j + span < count ? bytes[j + span] : 0;
+			bytes[j] = dilate ? (bytes[j] | next) : (bytes[j] & next);
+		}
+	}
+	return span;
+}
+
+inline int double_row_span(BinaryMask& mask, int window_size, bool dilate)
+{
+	int span = 1;
+	for (; 2 * span <= window_size; span *= 2)
+	{
+		for (int x = 0; x < mask.rows; ++x)
+		{
+			uint64_t* row = mask.word_row(x);
+			if (x + span >= mask.rows)
+			{
+				if (!dilate)
+					std::fill(row, row + mask.words_per_row, 0);
+				continue;
+			}
+			const uint64_t* next = mask.word_row(x + span);
+			for (int w = 0; w < mask.words_per_row; ++w)
+				row[w] = dilate ? (row[w] | next[w]) : (row[w] & next[w]);
+		}
+	}
+	return span;
+}
+
+// Padded row and row-range buffers of extremum_filter_rows, kept to be reused.
+struct ExtremumBuffers
+{
+	std::vector<uint64_t> line;
+	BinaryMask horizontal;
+};
+
+// Binary erosion/dilation of rows [row_begin, row_end) of dst over the rows and columns
+// [x + window_begin, x + window_begin + window_size), clipped to the image, in O(log window_size) word
+// operations per word. Only the source rows within the window of the range are read, so disjoint
+// ranges can be filtered concurrently. Pixels closer than border to the image edge are set to 0.
+inline void extremum_filter_rows(const BinaryMask& src, BinaryMask& dst, int row_begin, int row_end, int window_begin, int window_size, int border, FilterType type, ExtremumBuffers& buffers)
+{
+	CV_Assert(type == Erosion || type == Dilation);
+	assert(window_begin <= 0 && window_begin >= -window_size);
+	assert(dst.rows == src.rows && dst.cols == src.cols && dst.storage == src.storage);
+	bool dilate = type == Dilation;
+	for (int x = row_begin; x < row_end; ++x)
+	{
+		std::fill(dst.word_row(x), dst.word_row(x) + dst.words_per_row, 0);
+	}
+	if (src.rows <= 2 * border || src.cols <= 2 * border)
+		return;
+
+	// Each row is padded with whole zero words, and the range with zero rows, window_size wide on each side.
+	int per_word = src.storage == Mask_Bits ? 64 : 8;
+	int pad_words = (window_size + per_word - 1) / per_word;
+	std::vector<uint64_t>& line = buffers.line;
+	line.resize(src.words_per_row + 2 * pad_words);
+	int first_row = row_begin - window_size;
+	BinaryMask& horizontal = buffers.horizontal;
+	horizontal.create(row_end - row_begin + 2 * window_size, src.cols, src.storage);
+	int span = 1;
+	for (int x = std::max(first_row, 0); x < std::min(row_end + window_size, src.rows); ++x)
+	{
+		std::fill(line.begin(), line.end(), 0);
+		std::copy(src.word_row(x), src.word_row(x) + src.words_per_row, line.begin() + pad_words);
+		uint64_t* out = horizontal.word_row(x - first_row);
+		if (src.storage == Mask_Bits)
+		{
+			span = double_bit_span(line.data(), (int)line.size(), window_size, dilate);
+			for (int w = 0; w < src.words_per_row; ++w)
+			{
+				uint64_t a = shifted_mask_word(line.data(), (int)line.size(), w + pad_words, window_begin);
+				uint64_t b = shifted_mask_word(line.data(), (int)line.size(), w + pad_words, window_begin + window_size - span);
+				out[w] = dilate ? (a | b) : (a & b);
+			}
+			out[src.words_per_row - 1] &= src.tail_mask();
+		}
+		else
+		{
+			uchar* bytes = (uchar*)line.data();
+			span = double_byte_span(bytes, 8 * (int)line.size(), window_size, dilate);
+			uchar* out_bytes = (uchar*)out;
+			for (int y = 0; y < src.cols; ++y)
+			{
+				uchar a = bytes[8 * pad_words + y + window_begin];
+				uchar b = bytes[8 * pad_words + y + window_begin + window_size - span];
+				out_bytes[y] = dilate ? (a | b) : (a & b);
+			}
+		}
+	}
+
+	span = double_row_span(horizontal, window_size, dilate);
+	for (int x = std::max(row_begin, border); x < std::min(row_end, src.rows - border); ++x)
+	{
+		const uint64_t* a = horizontal.word_row(x + window_begin - first_row);
+		const uint64_t* b = horizontal.word_row(x + window_begin + window_size - span - first_row);
+		uint64_t* out = dst.word_row(x);
+		for (int w = 0; w < src.words_per_row; ++w)
+		{
+			out[w] = dilate ? (a[w] | b[w]) : (a[w] & b[w]);
+		}
+		for (int y = 0; y < border; ++y)
+		{
+			dst.set(x, y, false);
+			dst.set(x, src.cols - 1 - y, false);
+		}
+	}
+}
+
+inline void extremum_filter_rows(const BinaryMask& src, BinaryMask& dst, int row_begin, int row_end, int window_begin, int window_size, int border, FilterType type)
+{
+	ExtremumBuffers buffers;
+	extremum_filter_rows(src, dst, row_begin, row_end, window_begin, window_size, border, type, buffers);
+}
+
+inline BinaryMask extremum_filter(const BinaryMask& src, int window_begin, int window_size, int border, FilterType type)
+{
+	BinaryMask dst(src.rows, src.cols, src.storage);
+	extremum_filter_rows(src, dst, 0, src.rows, window_begin, window_size, border, type);
+	return dst;
+}
+
+// Same window and border as the cv::Mat rank_filter.
+inline BinaryMask rank_filter(const BinaryMask& src, int filter_size, FilterType type)
+{
+	CV_Assert(filter_size >= 1);
+	int offset = filter_size / 2;
+	return extremum_filter(src, -offset, filter_size, offset, type);
+}
+
+inline BinaryMask erosion_filter(const BinaryMask& src, int filter_size, int num_iter)
+{
+	if (num_iter > 1 && filter_size % 2 == 1)
+	{
+		int radius = num_iter * (filter_size / 2);
+		return extremum_filter(src, -radius, 2 * radius + 1, radius, Erosion);
+	}
+	BinaryMask result = src;
+	for (int i = 0; i < num_iter; ++i)
+	{
+		result = rank_filter(result, filter_size, Erosion);
+	}
+	return result;
+}
+
+inline BinaryMask dilation_filter(const BinaryMask& src, int filter_size, int num_iter)
+{
+	if (num_iter > 1 && filter_size % 2 == 1)
+	{
+		int radius = num_iter * (filter_size / 2);
+		return extremum_filter(src, -radius, 2 * radius + 1, filter_size / 2, Dilation);
+	}
+	BinaryMask result = src;
+	for (int i = 0; i < num_iter; ++i)
+	{
+		result = rank_filter(result, filter_size, Dilation);
+	}
+	return result;
+}
+
 #endif
@@ -0,0 +1,377 @@
+#ifndef HSV_CONVERSION_H
+#define HSV_CONVERSION_H
+
+#include <algorithm>
+#include <vector>
+#include <opencv2/core/core.hpp>
+
+#if defined(__x86_64__) || defined(__i386__) || defined(_M_X64) || defined(_M_IX86)
+#define HSV_CONVERSION_X86
+#include <immintrin.h>
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+#endif
+
+#if defined(__GNUC__)
+#define HSV_TARGET(isa) __attribute__((target(isa)))
+#else
+#define HSV_TARGET(isa)
+#endif
+
+// All paths produce exactly the bytes of pixel_bgr2hsv: H = floor((30 * diff + offset * delta) / delta),
+// S = floor(255 * delta / Cmax), V = Cmax, with the same Cmax == r / g / b precedence.
+enum HsvConversionMethod
+{
+	Hsv_Scalar,
+	Hsv_Table,
+	Hsv_Sse41,
+	Hsv_Avx2
+};
+
+inline void pixel_bgr2hsv_integer(const uchar* bgr, uchar* hsv)
+{
+	int b = bgr[0];
+	int g = bgr[1];
+	int r = bgr[2];
+	int cmax = std::max(std::max(r, g), b);
+	int cmin = std::min(std::min(r, g), b);
+	int delta = cmax - cmin;
+	int h = 0;
+
+	if (delta != 0)
+	{
+		if (cmax == r)
+			h = 30 * (g - b) + (g < b ? 180 * delta : 0);
+		else if (cmax == g)
+			h = 30 * (b - r) + 60 * delta;
+		else
+			h = 30 * (r - g) + 120 * delta;
+		h /= delta;
+	}
+
+	hsv[0] = (uchar)h;
+	hsv[1] = cmax == 0 ? 0 : (uchar)(255 * delta / cmax);
+	hsv[2] = (uchar)cmax;
+}
+
+struct HsvTables
+{
+	// hue_step[delta][diff + 255] = floor(30 * diff / delta)
+	std::vector<signed char> hue_step;
+	// saturation[cmax][delta] = floor(255 * delta / cmax)
+	std::vector<uchar> saturation;
+};
+
+inline const HsvTables& hsv_tables()
+{
+	static const HsvTables tables = []()
+	{
+		HsvTables t;
+		t.hue_step.assign(256 * 511, 0);
+		t.saturation.assign(256 * 256, 0);
+		for (int delta = 1; delta < 256; delta++)
+		{
+			for (int diff = -delta; diff <= delta; diff++)
+			{
+				int n = 30 * diff;
+				int q = n >= 0 ? n / delta : -((-n + delta - 1) / delta);
+				t.hue_step[delta * 511 + diff + 255] = (signed char)q;
+			}
+		}
+		for (int cmax = 1; cmax < 256; cmax++)
+		{
+			for (int delta = 0; delta <= cmax; delta++)
+			{
+				t.saturation[cmax * 256 + delta] = (uchar)(255 * delta / cmax);
+			}
+		}
+		return t;
+	}();
+	return tables;
+}
+
+inline void bgr2hsv_row_scalar(const uchar* bgr, uchar* hsv, int width)
+{
+	for (int j = 0; j < width; j++)
+	{
+		pixel_bgr2hsv_integer(bgr + 3 * j, hsv + 3 * j);
+	}
+}
+
+inline void bgr2hsv_row_table(const uchar* bgr, uchar* hsv, int width)
+{
+	const HsvTables& tables = hsv_tables();
+	const signed char* hue_step = tables.hue_step.data();
+	const uchar* saturation = tables.saturation.data();
+	for (int j = 0; j < width; j++, bgr += 3, hsv += 3)
+	{
+		int b = bgr[0];
+		int g = bgr[1];
+		int r = bgr[2];
+		int cmax = std::max(std::max(r, g), b);
+		int cmin = std::min(std::min(r, g), b);
+		int delta = cmax - cmin;
+		int diff;
+		int offset;
+		if (cmax == r)
+		{
+			diff = g - b;
+			offset = g < b ? 180 : 0;
+		}
+		else if (cmax == g)
+		{
+			diff = b - r;
+			offset = 60;
+		}
+		else
+		{
+			diff = r - g;
+			offset = 120;
+		}
+
+		hsv[0] = delta == 0 ? 0 : (uchar)(offset + hue_step[delta * 511 + diff + 255]);
+		hsv[1] = saturation[cmax * 256 + delta];
+		hsv[2] = (uchar)cmax;
+	}
+}
+
+#ifdef HSV_CONVERSION_X86
+
+HSV_TARGET("sse4.1")
+inline void hsv_deinterleave_sse41(const uchar* bgr, __m128i& b, __m128i& g, __m128i& r)
+{
+	__m128i a0 = _mm_loadu_si128((const __m128i*)bgr);
+	__m128i a1 = _mm_loadu_si128((const __m128i*)(bgr + 16));
+	__m128i a2 = _mm_loadu_si128((const __m128i*)(bgr + 32));
+
+	b = _mm_or_si128(_mm_or_si128(
+		_mm_shuffle_epi8(a0, _mm_setr_epi8(0, 3, 6, 9, 12, 15, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1)),
+		_mm_shuffle_epi8(a1, _mm_setr_epi8(-1, -1, -1, -1, -1, -1, 2, 5, 8, 11, 14, -1, -1, -1, -1, -1))),
+		_mm_shuffle_epi8(a2, _mm_setr_epi8(-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, 1, 4, 7, 10, 13)));
+	g = _mm_or_si128(_mm_or_si128(
+		_mm_shuffle_epi8(a0, _mm_setr_epi8(1, 4, 7, 10, 13, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1)),
+		_mm_shuffle_epi8(a1, _mm_setr_epi8(-1, -1, -1, -1, -1, 0, 3, 6, 9, 12, 15, -1, -1, -1, -1, -1))),
+		_mm_shuffle_epi8(a2, _mm_setr_epi8(-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, 2, 5, 8, 11, 14)));
+	r = _mm_or_si128(_mm_or_si128(
+		_mm_shuffle_epi8(a0, _mm_setr_epi8(2, 5, 8, 11, 14, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1)),
+		_mm_shuffle_epi8(a1, _mm_setr_epi8(-1, -1, -1, -1, -1, 1, 4, 7, 10, 13, -1, -1, -1, -1, -1, -1))),
+		_mm_shuffle_epi8(a2, _mm_setr_epi8(-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, 0, 3, 6, 9, 12, 15)));
+}
+
+HSV_TARGET("sse4.1")
+inline void hsv_interleave_sse41(__m128i h, __m128i s, __m128i v, uchar* hsv)
+{
+	__m128i o0 = _mm_or_si128(_mm_or_si128(
+		_mm_shuffle_epi8(h, _mm_setr_epi8(0, -1, -1, 1, -1, -1, 2, -1, -1, 3, -1, -1, 4, -1, -1, 5)),
+		_mm_shuffle_epi8(s, _mm_setr_epi8(-1, 0, -1, -1, 1, -1, -1, 2, -1, -1, 3, -1, -1, 4, -1, -1))),
+		_mm_shuffle_epi8(v, _mm_setr_epi8(-1, -1, 0, -1, -1, 1, -1, -1, 2, -1, -1, 3, -1, -1, 4, -1)));
+	__m128i o1 = _mm_or_si128(_mm_or_si128(
+		_mm_shuffle_epi8(h, _mm_setr_epi8(-1, -1, 6, -1, -1, 7, -1, -1, 8, -1, -1, 9, -1, -1, 10, -1)),
+		_mm_shuffle_epi8(s, _mm_setr_epi8(5, -1, -1, 6, -1, -1, 7, -1, -1, 8, -1, -1, 9, -1, -1, 10))),
+		_mm_shuffle_epi8(v, _mm_setr_epi8(-1, 5, -1, -1, 6, -1, -1, 7, -1, -1, 8, -1, -1, 9, -1, -1)));
+	__m128i o2 = _mm_or_si128(_mm_or_si128(
+		_mm_shuffle_epi8(h, _mm_setr_epi8(-1, 11, -1, -1, 12, -1, -1, 13, -1, -1, 14, -1, -1, 15, -1, -1)),
+		_mm_shuffle_epi8(s, _mm_setr_epi8(-1, -1, 11, -1, -1, 12, -1, -1, 13, -1, -1, 14, -1, -1, 15, -1))),
+		_mm_shuffle_epi8(v, _mm_setr_epi8(10, -1, -1, 11, -1, -1, 12, -1, -1, 13, -1, -1, 14, -1, -1, 15)));
+
+	_mm_storeu_si128((__m128i*)hsv, o0);
+	_mm_storeu_si128((__m128i*)(hsv + 16), o1);
+	_mm_storeu_si128((__m128i*)(hsv + 32), o2);
+}
+
+// The quotients are below 2^16 and at least 1/255 away from the next integer,
+// so a single-precision divide followed by truncation is exact.
+HSV_TARGET("sse4.1")
+inline void hsv_core_sse41(__m128i b, __m128i g, __m128i r, __m128i& h, __m128i& s)
+{
+	const __m128i zero = _mm_setzero_si128();
+	const __m128i one = _mm_set1_epi16(1);
+	__m128i cmax = _mm_max_epi16(_mm_max_epi16(r, g), b);
+	__m128i cmin = _mm_min_epi16(_mm_min_epi16(r, g), b);
+	__m128i delta = _mm_sub_epi16(cmax, cmin);
+	__m128i is_r = _mm_cmpeq_epi16(cmax, r);
+	__m128i is_g = _mm_andnot_si128(is_r, _mm_cmpeq_epi16(cmax, g));
+
+	__m128i diff = _mm_sub_epi16(r, g);
+	diff = _mm_blendv_epi8(diff, _mm_sub_epi16(b, r), is_g);
+	diff = _mm_blendv_epi8(diff, _mm_sub_epi16(g, b), is_r);
+	__m128i offset = _mm_set1_epi16(120);
+	offset = _mm_blendv_epi8(offset, _mm_set1_epi16(60), is_g);
+	offset = _mm_blendv_epi8(offset, _mm_and_si128(_mm_cmplt_epi16(g, b), _mm_set1_epi16(180)), is_r);
+
+	const __m128i thirty = _mm_set1_epi16(30);
+	__m128i hue_num_lo = _mm_madd_epi16(_mm_unpacklo_epi16(diff, delta), _mm_unpacklo_epi16(thirty, offset));
+	__m128i hue_num_hi = _mm_madd_epi16(_mm_unpackhi_epi16(diff, delta), _mm_unpackhi_epi16(thirty, offset));
+	__m128i hue_den = _mm_max_epi16(delta, one);
+	__m128i hue_lo = _mm_cvttps_epi32(_mm_div_ps(_mm_cvtepi32_ps(hue_num_lo), _mm_cvtepi32_ps(_mm_unpacklo_epi16(hue_den, zero))));
+	__m128i hue_hi = _mm_cvttps_epi32(_mm_div_ps(_mm_cvtepi32_ps(hue_num_hi), _mm_cvtepi32_ps(_mm_unpackhi_epi16(hue_den, zero))));
+	h = _mm_packs_epi32(hue_lo, hue_hi);
+
+	const __m128i k255 = _mm_set1_epi32(255);
+	__m128i sat_num_lo = _mm_madd_epi16(_mm_unpacklo_epi16(delta, zero), k255);
+	__m128i sat_num_hi = _mm_madd_epi16(_mm_unpackhi_epi16(delta, zero), k255);
+	__m128i sat_den = _mm_max_epi16(cmax, one);
+	__m128i sat_lo = _mm_cvttps_epi32(_mm_div_ps(_mm_cvtepi32_ps(sat_num_lo), _mm_cvtepi32_ps(_mm_unpacklo_epi16(sat_den, zero))));
+	__m128i sat_hi = _mm_cvttps_epi32(_mm_div_ps(_mm_cvtepi32_ps(sat_num_hi), _mm_cvtepi32_ps(_mm_unpackhi_epi16(sat_den, zero))));
+	s = _mm_packs_epi32(sat_lo, sat_hi);
+}
+
+HSV_TARGET("sse4.1")
+inline void bgr2hsv_row_sse41(const uchar* bgr, uchar* hsv, int width)
+{
+	const __m128i zero = _mm_setzero_si128();
+	int j = 0;
+	for (; j + 16 <= width; j += 16)
+	{
+		__m128i b, g, r;
+		hsv_deinterleave_sse41(bgr + 3 * j, b, g, r);
+
+		__m128i h_lo, s_lo, h_hi, s_hi;
+		hsv_core_sse41(_mm_unpacklo_epi8(b, zero), _mm_unpacklo_epi8(g, zero), _mm_unpacklo_epi8(r, zero), h_lo, s_lo);
+		hsv_core_sse41(_mm_unpackhi_epi8(b, zero), _mm_unpackhi_epi8(g, zero), _mm_unpackhi_epi8(r, zero), h_hi, s_hi);
+		__m128i v = _mm_max_epu8(_mm_max_epu8(r, g), b);
+
+		hsv_interleave_sse41(_mm_packus_epi16(h_lo, h_hi), _mm_packus_epi16(s_lo, s_hi), v, hsv + 3 * j);
+	}
+	bgr2hsv_row_scalar(bgr + 3 * j, hsv + 3 * j, width - j);
+}
+
+HSV_TARGET("avx2")
+inline void hsv_core_avx2(__m256i b, __m256i g, __m256i r, __m256i& h, __m256i& s)
+{
+	const __m256i zero = _mm256_setzero_si256();
+	const __m256i one = _mm256_set1_epi16(1);
+	__m256i cmax = _mm256_max_epi16(_mm256_max_epi16(r, g), b);
+	__m256i cmin = _mm256_min_epi16(_mm256_min_epi16(r, g), b);
+	__m256i delta = _mm256_sub_epi16(cmax, cmin);
+	__m256i is_r = _mm256_cmpeq_epi16(cmax, r);
+	__m256i is_g = _mm256_andnot_si256(is_r, _mm256_cmpeq_epi16(cmax, g));
+
+	__m256i diff = _mm256_sub_epi16(r, g);
+	diff = _mm256_blendv_epi8(diff, _mm256_sub_epi16(b, r), is_g);
+	diff = _mm256_blendv_epi8(diff, _mm256_sub_epi16(g, b), is_r);
+	__m256i offset = _mm256_set1_epi16(120);
+	offset = _mm256_blendv_epi8(offset, _mm256_set1_epi16(60), is_g);
+	offset = _mm256_blendv_epi8(offset, _mm256_and_si256(_mm256_cmpgt_epi16(b, g), _mm256_set1_epi16(180)), is_r);
+
+	const __m256i thirty = _mm256_set1_epi16(30);
+	__m256i hue_num_lo = _mm256_madd_epi16(_mm256_unpacklo_epi16(diff, delta), _mm256_unpacklo_epi16(thirty, offset));
+	__m256i hue_num_hi = _mm256_madd_epi16(_mm256_unpackhi_epi16(diff, delta), _mm256_unpackhi_epi16(thirty, offset));
+	__m256i hue_den = _mm256_max_epi16(delta, one);
+	__m256i hue_lo = _mm256_cvttps_epi32(_mm256_div_ps(_mm256_cvtepi32_ps(hue_num_lo), _mm256_cvtepi32_ps(_mm256_unpacklo_epi16(hue_den, zero))));
+	__m256i hue_hi = _mm256_cvttps_epi32(_mm256_div_ps(_mm256_cvtepi32_ps(hue_num_hi), _mm256_cvtepi32_ps(_mm256_unpackhi_epi16(hue_den, zero))));
+	h = _mm256_packs_epi32(hue_lo, hue_hi);
+
+	const __m256i k255 = _mm256_set1_epi32(255);
+	__m256i sat_num_lo = _mm256_madd_epi16(_mm256_unpacklo_epi16(delta, zero), k255);
+	__m256i sat_num_hi = _mm256_madd_epi16(_mm256_unpackhi_epi16(delta, zero), k255);
+	__m256i sat_den = _mm256_max_epi16(cmax, one);
+	__m256i sat_lo = _mm256_cvttps_epi32(_mm256_div_ps(_mm256_cvtepi32_ps(sat_num_lo), _mm256_cvtepi32_ps(_mm256_unpacklo_epi16(sat_den, zero))));
+	__m256i sat_hi = _mm256_cvttps_epi32(_mm256_div_ps(_mm256_cvtepi32_ps(sat_num_hi), _mm256_cvtepi32_ps(_mm256_unpackhi_epi16(sat_den, zero))));
+	s = _mm256_packs_epi32(sat_lo, sat_hi);
+}
+
+HSV_TARGET("avx2")
+inline void bgr2hsv_row_avx2(const uchar* bgr, uchar* hsv, int width)
+{
+	int j = 0;
+	for (; j + 16 <= width; j += 16)
+	{
+		__m128i b, g, r;
+		hsv_deinterleave_sse41(bgr + 3 * j, b, g, r);
+
+		__m256i h16, s16;
+		hsv_core_avx2(_mm256_cvtepu8_epi16(b), _mm256_cvtepu8_epi16(g), _mm256_cvtepu8_epi16(r), h16, s16);
+		__m128i h = _mm_packus_epi16(_mm256_castsi256_si128(h16), _mm256_extracti128_si256(h16, 1));
+		__m128i s = _mm_packus_epi16(_mm256_castsi256_si128(s16), _mm256_extracti128_si256(s16, 1));
+		__m128i v = _mm_max_epu8(_mm_max_epu8(r, g), b);
+
+		hsv_interleave_sse41(h, s, v, hsv + 3 * j);
+	}
+	bgr2hsv_row_scalar(bgr + 3 * j, hsv + 3 * j, width - j);
+}
+
+#endif
+
+inline bool hsv_conversion_supported(HsvConversionMethod method)
+{
+	switch (method)
+	{
+	case Hsv_Scalar:
+	case Hsv_Table:
+		return true;
+#if defined(HSV_CONVERSION_X86) && defined(__GNUC__)
+	case Hsv_Sse41:
+		return __builtin_cpu_supports("sse4.1");
+	case Hsv_Avx2:
+		return __builtin_cpu_supports("avx2");
+#elif defined(HSV_CONVERSION_X86) && defined(_MSC_VER)
+	case Hsv_Sse41:
+	{
+		int info[4];
+		__cpuid(info, 1);
+		return (info[2] & (1 << 19)) != 0;
+	}
+	case Hsv_Avx2:
+	{
+		int info[4];
+		__cpuid(info, 1);
+		bool os_saves_ymm = (info[2] & (1 << 27)) != 0 && (_xgetbv(0) & 6) == 6;
+		__cpuidex(info, 7, 0);
+		return os_saves_ymm && (info[1] & (1 << 5)) != 0;
+	}
+#endif
+	default:
+		return false;
+	}
+}
+
+inline HsvConversionMethod best_hsv_conversion_method()
+{
+	static const HsvConversionMethod method =
+		hsv_conversion_supported(Hsv_Avx2) ? Hsv_Avx2 :
+		hsv_conversion_supported(Hsv_Sse41) ? Hsv_Sse41 :
+		Hsv_Table;
+	return method;
+}
+
+inline void bgr2hsv_row(const uchar* bgr, uchar* hsv, int width, HsvConversionMethod method)
+{
+	switch (method)
+	{
+#ifdef HSV_CONVERSION_X86
+	case Hsv_Avx2:
+		bgr2hsv_row_avx2(bgr, hsv, width);
+		break;
+	case Hsv_Sse41:
+		bgr2hsv_row_sse41(bgr, hsv, width);
+		break;
+#endif
+	case Hsv_Table:
+		bgr2hsv_row_table(bgr, hsv, width);
+		break;
+	default:
+		bgr2hsv_row_scalar(bgr, hsv, width);
+		break;
+	}
+}
+
+inline void bgr2hsv_into(const cv::Mat& image, cv::Mat& hsv, HsvConversionMethod method)
+{
+	CV_Assert(image.type() == CV_8UC3);
+	hsv.create(image.rows, image.cols, CV_8UC3);
+	int rows = image.rows;
+	int width = image.cols;
+	if (image.isContinuous() && hsv.isContinuous())
+	{
+		width *= rows;
+		rows = 1;
+	}
+	for (int i = 0; i < rows; i++)
+	{
+		bgr2hsv_row(image.ptr<uchar>(i), hsv.ptr<uchar>(i), width, method);
+	}
+}
+
+#endif
@@ -0,0 +1,204 @@
+#ifndef LABELING_H
+#define LABELING_H
+
+#include <algorithm>
+#include <vector>
+#include <opencv2/core/core.hpp>
+
+#include "mask.h"
+#include "moments.h"
+
+struct LabelRun
+{
+	int row;
+	int col_begin;
+	int col_end;
+	int label;
+};
+
+struct ComponentStats
+{
+	int row_min;
+	int row_max;
+	int col_min;
+	int col_max;
+	long long area;
+	long long border_count;
+	RawMoments moments;
+};
+
+// Runs are stored in raster order. Labels start at 1 and follow the raster order of each
+// component's first pixel, which is the order segment_mask has always reported segments in.
+// A border pixel is a foreground pixel on the image edge or with a 4-neighbour in the background.
+struct Labeling
+{
+	std::vector<LabelRun> runs;
+	std::vector<ComponentStats> components;
+	BinaryMask border;
+};
+
+inline int find_label_root(std::vector<int>& parent, int label)
+{
+	while (parent[label] != label)
+	{
+		parent[label] = parent[parent[label]];
+		label = parent[label];
+	}
+	return label;
+}
+
+inline void union_labels(std::vector<int>& parent, int a, int b)
+{
+	a = find_label_root(parent, a);
+	b = find_label_root(parent, b);
+	if (a < b)
+		parent[b] = a;
+	else if (b < a)
+		parent[a] = b;
+}
+
+inline int count_bits_in_range(const uint64_t* row, int begin, int end)
+{
+	int count = 0;
+	while (begin < end)
+	{
+		int w = begin >> 6;
+		int bit = begin & 63;
+		int n = std::min(64 - bit, end - begin);
+		uint64_t range = (n == 64 ? ~uint64_t(0) : ((uint64_t(1) << n) - 1)) << bit;
+		count += popcount64(row[w] & range);
+		begin += n;
+	}
+	return count;
+}
+
+inline void compute_border_row(const BinaryMask& mask, int row, uint64_t* border)
+{
+	const uint64_t* cur = mask.word_row(row);
+	const uint64_t* up = row > 0 ? mask.word_row(row - 1) : nullptr;
+	const uint64_t* down = row + 1 < mask.rows ? mask.word_row(row + 1) : nullptr;
+	for (int w = 0; w < mask.words_per_row; w++)
+	{
+		uint64_t interior = (up ? up[w] : 0) & (down ? down[w] : 0) &
+			shifted_mask_word(cur, mask.words_per_row, w, -1) &
+			shifted_mask_word(cur, mask.words_per_row, w, 1);
+		border[w] = cur[w] & ~interior;
+	}
+}
+
+// First pass of the labeling over rows [row_begin, row_end): each run gets a provisional label,
+// an index into parent, and is linked through union-find to the overlapping runs of the previous
+// row of the range. Provisional labels are created in raster order.
+inline void label_row_range(const BinaryMask& mask, int row_begin, int row_end, std::vector<LabelRun>& runs, std::vector<int>& parent, BinaryMask& border)
+{
+	int prev_begin = (int)runs.size();
+	int prev_end = prev_begin;
+	for (int i = row_begin; i < row_end; i++)
+	{
+		compute_border_row(mask, i, border.word_row(i));
+		int current_begin = (int)runs.size();
+		int p = prev_begin;
+		for (int start = next_set_column(mask, i, 0); start < mask.cols; )
+		{
+			int end = next_clear_column(mask, i, start);
+
+			while (p < prev_end && runs[p].col_end <= start)
+			{
+				p++;
+			}
+			int label = -1;
+			for (int q = p; q < prev_end && runs[q].col_begin < end; q++)
+			{
+				if (label < 0)
+					label = runs[q].label;
+				else
+					union_labels(parent, label, runs[q].label);
+			}
+			if (label < 0)
+			{
+				label = (int)parent.size();
+				parent.push_back(label);
+			}
+			runs.push_back(LabelRun{ i, start, end, label });
+			start = next_set_column(mask, i, end);
+		}
+		prev_begin = current_begin;
+		prev_end = (int)runs.size();
+	}
+}
+
+// Second pass: numbers the union-find roots and accumulates the component statistics. Roots are the
+// smallest provisional label of their component, so the final labels follow the raster order of
+// each component's first pixel.
+inline void resolve_labels(Labeling& labeling, std::vector<int>& parent, int rows, int cols, std::vector<int>& final_label)
+{
+	final_label.resize(parent.size());
+	int count = 0;
+	for (size_t l = 0; l < parent.size(); l++)
+	{
+		int root = find_label_root(parent, (int)l);
+		final_label[l] = root == (int)l ? ++count : final_label[root];
+	}
+
+	labeling.components.assign(count, ComponentStats{ rows, 0, cols, 0, 0, 0, RawMoments() });
+	for (auto& run : labeling.runs)
+	{
+		run.label = final_label[run.label];
+		ComponentStats& c = labeling.components[run.label - 1];
+		c.row_min = std::min(c.row_min, run.row);
+		c.row_max = std::max(c.row_max, run.row);
+		c.col_min = std::min(c.col_min, run.col_begin);
+		c.col_max = std::max(c.col_max, run.col_end - 1);
+		c.area += run.col_end - run.col_begin;
+		c.border_count += count_bits_in_range(labeling.border.word_row(run.row), run.col_begin, run.col_end);
+		c.moments.add_run(run.row, run.col_begin, run.col_end);
+	}
+}
+
+inline void resolve_labels(Labeling& labeling, std::vector<int>& parent, int rows, int cols)
+{
+	std::vector<int> final_label;
+	resolve_labels(labeling, parent, rows, cols, final_label);
+}
+
+// Two-pass run-based labeling with 4-connectivity: the first pass links each run to the
+// overlapping runs of the previous row through union-find, the second resolves the roots.
+inline Labeling label_runs(const BinaryMask& input)
+{
+	BinaryMask converted;
+	if (input.storage != Mask_Bits)
+		converted = convert_mask(input, Mask_Bits);
+	const BinaryMask& mask = input.storage == Mask_Bits ? input : converted;
+
+	Labeling labeling;
+	labeling.border.create(mask.rows, mask.cols, Mask_Bits);
+	std::vector<int> parent;
+	label_row_range(mask, 0, mask.rows, labeling.runs, parent, labeling.border);
+	resolve_labels(labeling, parent, mask.rows, mask.cols);
+	return labeling;
+}
+
+// CV_32SC1 image with 0 for background and the component label elsewhere.
+inline cv::Mat label_image(const Labeling& labeling, int rows, int cols)
+{
+	cv::Mat labels = cv::Mat::zeros(rows, cols, CV_32SC1);
+	for (const auto& run : labeling.runs)
+	{
+		int* row = labels.ptr<int>(run.row);
+		for (int j = run.col_begin; j < run.col_end; j++)
+		{
+			row[j] = run.label;
+		}
+	}
+	return labels;
+}
+
+inline int label_components(const BinaryMask& mask, cv::Mat& labels, std::vector<ComponentStats>& stats)
+{
+	Labeling labeling = label_runs(mask);
+	labels = label_image(labeling, mask.rows, mask.cols);
+	stats = labeling.components;
+	return (int)stats.size();
+}
+
+#endif
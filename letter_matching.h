@@ -0,0 +1,331 @@
+#ifndef LETTER_MATCHING_H
+#define LETTER_MATCHING_H
+
+#include <algorithm>
+#include <limits>
+#include <utility>
+#include <vector>
+
+#include "segments.h"
+#include "shape_classifier.h"
+
+// The blue letters of a logo sit on one line: their tops differ by at most this many rows.
+const int logo_max_letter_row_spread = 30;
+
+// A segment inside a yellow candidate that passed at least one letter class.
+struct LetterCandidate
+{
+	int index;
+	ShapeMask classes;
+};
+
+// Ids of a fixed set of keys, of which a growing subset is present. Predecessor and successor
+// among the present keys take O(log n) through a Fenwick tree of counts over the key ranks.
+struct RankSet
+{
+	std::vector<std::pair<int, int>> keys;
+	std::vector<int> tree;
+	int present = 0;
+
+	// Sorts keys, given as (key, id) pairs, and empties the set.
+	void reset()
+	{
+		std::sort(keys.begin(), keys.end());
+		tree.assign(keys.size() + 1, 0);
+		present = 0;
+	}
+
+	void insert(int rank)
+	{
+		present++;
+		for (int i = rank + 1; i < (int)tree.size(); i += i & -i)
+			tree[i]++;
+	}
+
+	// Present keys among the first count ranks.
+	int count_below(int count) const
+	{
+		int result = 0;
+		for (int i = count; i > 0; i -= i & -i)
+			result += tree[i];
+		return result;
+	}
+
+	// Rank of the k-th present key, counting from 1.
+	int kth(int k) const
+	{
+		int rank = 0;
+		int step = 1;
+		while (step * 2 < (int)tree.size())
+			step *= 2;
+		for (; step > 0; step /= 2)
+		{
+			if (rank + step < (int)tree.size() && tree[rank + step] < k)
+			{
+				rank += step;
+				k -= tree[rank];
+			}
+		}
+		return rank;
+	}
+
+	// Id of the largest present key <= value, or -1.
+	int predecessor(int value) const
+	{
+		int count = count_below((int)(std::upper_bound(keys.begin(), keys.end(), std::make_pair(value, std::numeric_limits<int>::max())) - keys.begin()));
+		return count > 0 ? keys[kth(count)].second : -1;
+	}
+
+	// Id of the smallest present key >= value, or -1.
+	int successor(int value) const
+	{
+		int count = count_below((int)(std::lower_bound(keys.begin(), keys.end(), std::make_pair(value, std::numeric_limits<int>::min())) - keys.begin()));
+		return count < present ? keys[kth(count + 1)].second : -1;
+	}
+};
+
+// The letters of one L-I-D-L match, as indices into the blue and red segments. dot is -1 when
+// the I is a single Letter_I_With_Dot segment.
+struct LetterMatch
+{
+	int first_l = -1;
+	int d = -1;
+	int second_l = -1;
+	int i = -1;
+	int dot = -1;
+};
+
+// Role lists and sweep state of match_logo_letters, kept from one yellow candidate to the next.
+struct LetterMatchBuffers
+{
+	std::vector<int> ls;
+	std::vector<int> ds;
+	std::vector<int> stems;
+	std::vector<int> stem_dot;
+	std::vector<int> dots;
+	std::vector<std::pair<int, int>> dot_tree;
+	std::vector<std::pair<int, int>> is;
+	std::vector<int> i_of;
+	std::vector<int> order;
+	std::vector<int> other_order;
+	std::vector<int> l_rank;
+	RankSet before;
+	RankSet after;
+	std::vector<int> before_near[2];
+	std::vector<int> after_near[2];
+};
+
+// Fills stem_dot with, for every segment in stems, a dot ahead of it in compare_segments_by_y
+// order whose columns lie within its columns, or -1. The stems are swept in y order while the
+// dots before them enter a Fenwick tree of the minimum col_max over descending col_min, so one
+// prefix query finds the narrowest dot starting at or right of the stem.
+inline void find_dots(const std::vector<Segment>& red_segments, const std::vector<LetterCandidate>& red, ShapeMask dot_classes, LetterMatchBuffers& buffers)
+{
+	std::vector<int>& stems = buffers.stems;
+	std::vector<int>& dots = buffers.dots;
+	buffers.stem_dot.assign(stems.size(), -1);
+	dots.clear();
+	for (const auto& letter : red)
+	{
+		if (letter.classes & dot_classes)
+			dots.push_back(letter.index);
+	}
+	if (dots.empty() || stems.empty())
+		return;
+	std::sort(dots.begin(), dots.end(), [&](int a, int b) { return red_segments[a].col_min > red_segments[b].col_min; });
+	std::vector<int>& dot_order = buffers.order;
+	dot_order.resize(dots.size());
+	for (size_t k = 0; k < dots.size(); k++)
+		dot_order[k] = (int)k;
+	std::sort(dot_order.begin(), dot_order.end(), [&](int a, int b) { return compare_segments_by_y(red_segments[dots[a]], red_segments[dots[b]]); });
+	std::vector<int>& stem_order = buffers.other_order;
+	stem_order.resize(stems.size());
+	for (size_t k = 0; k < stems.size(); k++)
+		stem_order[k] = (int)k;
+	std::sort(stem_order.begin(), stem_order.end(), [&](int a, int b) { return compare_segments_by_y(red_segments[stems[a]], red_segments[stems[b]]); });
+
+	std::vector<std::pair<int, int>>& tree = buffers.dot_tree;
+	tree.assign(dots.size() + 1, std::make_pair(std::numeric_limits<int>::max(), -1));
+	size_t next = 0;
+	for (int k : stem_order)
+	{
+		const Segment& stem = red_segments[stems[k]];
+		for (; next < dot_order.size() && compare_segments_by_y(red_segments[dots[dot_order[next]]], stem); next++)
+		{
+			int rank = dot_order[next];
+			std::pair<int, int> entry(red_segments[dots[rank]].col_max, dots[rank]);
+			for (int t = rank + 1; t < (int)tree.size(); t += t & -t)
+				tree[t] = std::min(tree[t], entry);
+		}
+		int count = (int)(std::upper_bound(dots.begin(), dots.end(), stem.col_min, [&](int col, int dot) { return col > red_segments[dot].col_min; }) - dots.begin());
+		std::pair<int, int> best(std::numeric_limits<int>::max(), -1);
+		for (int t = count; t > 0; t -= t & -t)
+			best = std::min(best, tree[t]);
+		if (best.second >= 0 && best.first <= stem.col_max)
+			buffers.stem_dot[k] = best.second;
+	}
+}
+
+// Searches the letters of a yellow candidate for L, I, D, L from left to right. The Ls and the
+// D follow each other in column order with their tops within logo_max_letter_row_spread rows.
+// The I starts between the end of the first L and the start of the D. It is either one
+// Letter_I_With_Dot or a Letter_I with a Red_Dot ahead of it in y order and within its columns.
+// A segment passing several classes may take any one of its roles, and the letters outside the
+// match are ignored. Letters are at least two columns wide, as DetectionLimits ensures, so the
+// column order alone keeps the first L, the D and the second L three different segments.
+//
+// Every D keeps the I that starts last before it, which leaves the most room for the first L.
+// The first Ls come from a sweep over the Ds in order of that bound, inserting the Ls that end
+// before it into a RankSet over their tops; the second Ls from a sweep in reverse column order.
+// Moving an L towards the top of the D never widens the spread, so only the nearest L above
+// and below that top are tried on each side. O(n log n) for n letters; the leftmost D with a
+// match wins. Ties are broken by segment index, so the match does not depend on the order of
+// blue and red. tests/letter_matching.cpp checks all this against brute force.
+inline bool match_logo_letters(const std::vector<Segment>& blue_segments, const std::vector<Segment>& red_segments, const std::vector<LetterCandidate>& blue, const std::vector<LetterCandidate>& red, const ShapeClassifier& classifier, LetterMatchBuffers& buffers, LetterMatch& match)
+{
+	ShapeMask l_classes = classifier.mask_of(Letter_L);
+	ShapeMask d_classes = classifier.mask_of(Letter_D);
+	std::vector<int>& ls = buffers.ls;
+	std::vector<int>& ds = buffers.ds;
+	ls.clear();
+	ds.clear();
+	for (const auto& letter : blue)
+	{
+		if (letter.classes & l_classes)
+			ls.push_back(letter.index);
+		if (letter.classes & d_classes)
+			ds.push_back(letter.index);
+	}
+	if (ls.size() < 2 || ds.empty())
+		return false;
+	std::sort(ls.begin(), ls.end());
+
+	// The Is as (segment, dot) pairs in column order; a segment that may be a Letter_I_With_Dot
+	// is taken as one and needs no dot.
+	ShapeMask i_with_dot_classes = classifier.mask_of(Letter_I_With_Dot);
+	ShapeMask i_classes = classifier.mask_of(Letter_I);
+	std::vector<std::pair<int, int>>& is = buffers.is;
+	std::vector<int>& stems = buffers.stems;
+	is.clear();
+	stems.clear();
+	for (const auto& letter : red)
+	{
+		if (letter.classes & i_with_dot_classes)
+			is.push_back(std::make_pair(letter.index, -1));
+		else if (letter.classes & i_classes)
+			stems.push_back(letter.index);
+	}
+	find_dots(red_segments, red, classifier.mask_of(Red_Dot), buffers);
+	for (size_t k = 0; k < stems.size(); k++)
+	{
+		if (buffers.stem_dot[k] >= 0)
+			is.push_back(std::make_pair(stems[k], buffers.stem_dot[k]));
+	}
+	if (is.empty())
+		return false;
+	std::sort(is.begin(), is.end(), [&](const std::pair<int, int>& a, const std::pair<int, int>& b)
+	{
+		int a_col = red_segments[a.first].col_min;
+		int b_col = red_segments[b.first].col_min;
+		return a_col < b_col || (a_col == b_col && a > b);
+	});
+
+	// The I of every D, the last of equal starts being the one with the lowest index; a D
+	// without one cannot match.
+	std::vector<int>& i_of = buffers.i_of;
+	i_of.resize(ds.size());
+	for (size_t d = 0; d < ds.size(); d++)
+	{
+		int col = blue_segments[ds[d]].col_min;
+		i_of[d] = (int)(std::upper_bound(is.begin(), is.end(), col, [&](int c, const std::pair<int, int>& i) { return c < red_segments[i.first].col_min; }) - is.begin()) - 1;
+	}
+
+	RankSet& before = buffers.before;
+	RankSet& after = buffers.after;
+	before.keys.clear();
+	for (size_t l = 0; l < ls.size(); l++)
+		before.keys.push_back(std::make_pair(blue_segments[ls[l]].row_min, (int)l));
+	before.reset();
+	after.keys = before.keys;
+	after.reset();
+	std::vector<int>& l_rank = buffers.l_rank;
+	l_rank.resize(ls.size());
+	for (size_t r = 0; r < before.keys.size(); r++)
+		l_rank[before.keys[r].second] = (int)r;
+	for (int side = 0; side < 2; side++)
+	{
+		buffers.before_near[side].assign(ds.size(), -1);
+		buffers.after_near[side].assign(ds.size(), -1);
+	}
+
+	std::vector<int>& d_order = buffers.order;
+	std::vector<int>& l_order = buffers.other_order;
+	d_order.clear();
+	for (size_t d = 0; d < ds.size(); d++)
+	{
+		if (i_of[d] >= 0)
+			d_order.push_back((int)d);
+	}
+	l_order.resize(ls.size());
+	for (size_t l = 0; l < ls.size(); l++)
+		l_order[l] = (int)l;
+
+	// First Ls: those ending at or before the start of the I of the D.
+	auto bound = [&](int d) { return red_segments[is[i_of[d]].first].col_min; };
+	std::sort(d_order.begin(), d_order.end(), [&](int a, int b) { return bound(a) < bound(b); });
+	std::sort(l_order.begin(), l_order.end(), [&](int a, int b) { return blue_segments[ls[a]].col_max < blue_segments[ls[b]].col_max; });
+	size_t next = 0;
+	for (int d : d_order)
+	{
+		for (; next < l_order.size() && blue_segments[ls[l_order[next]]].col_max <= bound(d); next++)
+			before.insert(l_rank[l_order[next]]);
+		buffers.before_near[0][d] = before.predecessor(blue_segments[ds[d]].row_min);
+		buffers.before_near[1][d] = before.successor(blue_segments[ds[d]].row_min);
+	}
+
+	// Second Ls: those starting at or after the end of the D.
+	std::sort(d_order.begin(), d_order.end(), [&](int a, int b) { return blue_segments[ds[a]].col_max > blue_segments[ds[b]].col_max; });
+	std::sort(l_order.begin(), l_order.end(), [&](int a, int b) { return blue_segments[ls[a]].col_min > blue_segments[ls[b]].col_min; });
+	next = 0;
+	for (int d : d_order)
+	{
+		for (; next < l_order.size() && blue_segments[ls[l_order[next]]].col_min >= blue_segments[ds[d]].col_max; next++)
+			after.insert(l_rank[l_order[next]]);
+		buffers.after_near[0][d] = after.predecessor(blue_segments[ds[d]].row_min);
+		buffers.after_near[1][d] = after.successor(blue_segments[ds[d]].row_min);
+	}
+
+	std::sort(d_order.begin(), d_order.end(), [&](int a, int b)
+	{
+		const Segment& d_a = blue_segments[ds[a]];
+		const Segment& d_b = blue_segments[ds[b]];
+		return compare_segments_by_x(d_a, d_b) || (!compare_segments_by_x(d_b, d_a) && ds[a] < ds[b]);
+	});
+	for (int d : d_order)
+	{
+		const Segment& letter_d = blue_segments[ds[d]];
+		for (int first_side = 0; first_side < 2; first_side++)
+		{
+			for (int second_side = 0; second_side < 2; second_side++)
+			{
+				int first = buffers.before_near[first_side][d];
+				int second = buffers.after_near[second_side][d];
+				if (first < 0 || second < 0)
+					continue;
+				int top_min = std::min(std::min(blue_segments[ls[first]].row_min, letter_d.row_min), blue_segments[ls[second]].row_min);
+				int top_max = std::max(std::max(blue_segments[ls[first]].row_min, letter_d.row_min), blue_segments[ls[second]].row_min);
+				if (top_max - top_min > logo_max_letter_row_spread)
+					continue;
+				match.first_l = ls[first];
+				match.d = ds[d];
+				match.second_l = ls[second];
+				match.i = is[i_of[d]].first;
+				match.dot = is[i_of[d]].second;
+				return true;
+			}
+		}
+	}
+	return false;
+}
+
+#endif
@@ -14,4 +14,26 @@ struct Logo
 	std::vector<Segment> red_segments;
 };
 
+inline cv::Rect logo_box(const Logo& logo)
+{
+	return cv::Rect(logo.col_min, logo.row_min, logo.col_max - logo.col_min + 1, logo.row_max - logo.row_min + 1);
+}
+
+inline void translate_logo(Logo& logo, int rows, int cols)
+{
+	logo.row_min += rows;
+	logo.row_max += rows;
+	logo.col_min += cols;
+	logo.col_max += cols;
+	logo.yellow_segment.translate(rows, cols);
+	for (auto& segment : logo.blue_segments)
+	{
+		segment.translate(rows, cols);
+	}
+	for (auto& segment : logo.red_segments)
+	{
+		segment.translate(rows, cols);
+	}
+}
+
 #endif
\ No newline at end of file
@@ -0,0 +1,28 @@
+#include <algorithm>
+
+#include "logo_detector.h"
+
+LogoDetector::LogoDetector(const LogoDetectorConfig& detector_config)
+	: config(detector_config), pool(std::max(1, detector_config.threads))
+{
+	for (const char* name : { "blue", "red", "yellow" })
+	{
+		band_index(config.bands, name);
+	}
+	CV_Assert(config.limits.dilation_size >= 1);
+	CV_Assert(!config.lut || same_bands(config.lut->bands, config.bands));
+	buffers.lut = config.lut.get();
+	specialized = !config.lut && config.pyramid_factor < 2 && matches_static_pipeline<LogoPipeline>(config.bands, config.limits);
+}
+
+std::vector<Logo> LogoDetector::detect(const cv::Mat& image, CascadeStats* stats, FrameTrace* trace)
+{
+	if (specialized && !tracing(trace))
+		return detect_logos_static<LogoPipeline>(image, pool, buffers, stats, config.classifier);
+	buffers.trace = trace;
+	std::vector<Logo> logos = config.pyramid_factor >= 2
+		? detect_logos_pyramid(image, config.bands, pool, config.pyramid_factor, buffers, stats, config.classifier, config.limits)
+		: detect_logos(image, config.bands, pool, buffers, stats, config.classifier, config.limits);
+	buffers.trace = nullptr;
+	return logos;
+}
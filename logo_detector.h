@@ -0,0 +1,53 @@
+#ifndef LOGO_DETECTOR_H
+#define LOGO_DETECTOR_H
+
+#include <memory>
+#include <vector>
+#include <opencv2/core/core.hpp>
+
+#include "color_bands.h"
+#include "color_lut.h"
+#include "detection.h"
+#include "logo.h"
+#include "pyramid.h"
+#include "shape_classifier.h"
+#include "static_pipeline.h"
+#include "thread_pool.h"
+
+// Everything a LogoDetector is configured with. The defaults are the settings of main.
+struct LogoDetectorConfig
+{
+	std::vector<ColorBand> bands = logo_color_bands();
+	DetectionLimits limits;
+	ShapeClassifier classifier = logo_shape_classifier();
+	int threads = default_thread_count();
+	int pyramid_factor = 0;
+	// Compiled from bands, shared by all detectors built from copies of the config.
+	std::shared_ptr<const BgrLut> lut;
+};
+
+// The detection pipeline behind one object, for programs that link it in rather than run main.
+// The configuration is checked once, and the thread pool and the per-frame buffers live as long
+// as the detector, so frames of a size seen before are processed without reallocating them.
+// One detector serves one thread at a time. A configuration equal to LogoPipeline runs the
+// kernels generated for it unless a lookup table, the pyramid or a trace is asked for. The
+// constructor and detect are compiled once, into the logo_detector library.
+struct LogoDetector
+{
+	LogoDetectorConfig config;
+	ThreadPool pool;
+	FrameBuffers buffers;
+	bool specialized = false;
+
+	explicit LogoDetector(const LogoDetectorConfig& detector_config = LogoDetectorConfig());
+
+	LogoDetector(const LogoDetector&) = delete;
+	LogoDetector& operator=(const LogoDetector&) = delete;
+
+	// Logos in a CV_8UC3 BGR image, which is read in place; views into larger images work too.
+	// The cascade counters of the call are added to stats and its stages recorded in trace when
+	// given.
+	std::vector<Logo> detect(const cv::Mat& image, CascadeStats* stats = nullptr, FrameTrace* trace = nullptr);
+};
+
+#endif
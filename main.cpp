@@ -1,60 +1,183 @@
-﻿#include <iostream>
+﻿#include <cstdlib>
+#include <iostream>
+#include <string>
 #include <deque>
+#include <memory>
 #include <opencv2/core/core.hpp>
 #include <opencv2/highgui/highgui.hpp>
 #include <opencv2/imgproc/imgproc.hpp>
 
 #include "colors.h"
+#include "color_bands.h"
 #include "segments.h"
 #include "filters.h"
 #include "shape_matching.h"
+#include "shape_classifier.h"
 #include "logo.h"
 #include "bounding_boxes.h"
+#include "thread_pool.h"
+#include "tiling.h"
+#include "detection.h"
+#include "batch.h"
+#include "pyramid.h"
+#include "logo_detector.h"
+#include "color_lut.h"
+#include "streaming.h"
+#include "video.h"
 
 
-int main()
+// Without inputs the images in Resources/ are processed into out/. --classes replaces the built-in
+// shape class table, see load_shape_classifier for the format. --pyramid 4 or 8 looks for the yellow
+// discs on an image downsampled by that factor first, see detect_logos_pyramid. --format json or csv
+// writes the logo boxes of all images to output_dir/detections.json or .csv instead of annotated images.
+// --trace records the stages and counters of every image into a Chrome trace (chrome://tracing,
+// Perfetto) and prints a summary of them; building with LOGO_NO_TRACE compiles the recording out.
+// --lut classifies the colors through a BGR lookup table compiled from the bands at startup, or
+// read from the --lut-cache file when it was compiled for the same bands before.
+// --strip-rows reads and searches every image n rows at a time instead of decoding it whole, for
+// panoramas too large for memory; only the detections are written, as JSON unless --format csv.
+// An unknown option, or one missing its value, prints the usage and exits with 1.
+// The exit code is also 1 when an image failed or the trace or detections file was not written.
+const char* const usage =
+	"Usage: main [-j threads] [-o output_dir] [--in-flight n] [--classes file] [--pyramid factor] [--format images|json|csv]\n"
+	"            [--trace trace.json] [--lut full|quantized] [--lut-cache file] [--strip-rows n] [directory | list.txt | image]...\n"
+	"       main --video file [-j threads] [-o output_dir] [--classes file] [--keyframe n] [--slices n] [--realtime] [--verify n]\n";
+
+bool takes_value(const std::string& option)
 {
-	std::vector<std::string> files{
-			"Resources/1.jpg",
-			"Resources/2.jpg",
-			"Resources/3.jpg",
-			"Resources/4.jpg",
-			"Resources/5.jpg",
-			"Resources/6.jpg",
-			"Resources/7.jpg"
-	};
-
-	for (std::string filename : files)
+	const char* options[] = { "-j", "-o", "--in-flight", "--pyramid", "--format", "--lut", "--lut-cache", "--strip-rows",
+		"--trace", "--video", "--keyframe", "--slices", "--verify", "--classes" };
+	for (const char* name : options)
 	{
-		cv::Mat image = cv::imread(filename);
-
-		cv::Mat hsv_image = bgr2hsv(image);
-
-
-		cv::Mat blue_mask = inRange(hsv_image, cv::Vec3b(80, 40, 30), cv::Vec3b(130, 255, 225));
-		std::vector<Segment> blue_segments = segment_mask(blue_mask);
-		blue_segments = filter_out_segments(blue_segments, 7, 5, 150, 150);
-		std::sort(blue_segments.begin(), blue_segments.end(), compare_segments_by_x);
-
-		cv::Mat red_mask_1 = inRange(hsv_image, cv::Vec3b(0, 50, 100), cv::Vec3b(15, 255, 255));
-		cv::Mat red_mask_2 = inRange(hsv_image, cv::Vec3b(160, 50, 50), cv::Vec3b(179, 255, 255));
-		cv::Mat red_mask = mask_or(red_mask_1, red_mask_2);
-		std::vector<Segment> red_segments = segment_mask(red_mask);
-		red_segments = filter_out_segments(red_segments, 5, 5, 150, 150);
-		std::sort(red_segments.begin(), red_segments.end(), compare_segments_by_y);
-
+		if (option == name)
+			return true;
+	}
+	return false;
+}
 
-		cv::Mat yellow_mask = inRange(hsv_image, cv::Vec3b(20, 100, 100), cv::Vec3b(30, 255, 255));
-		cv::Mat yellow_mask_filtered = dilation_filter(yellow_mask, 3, 1);
-		std::vector<Segment> yellow_segments = segment_mask(yellow_mask_filtered);
-		yellow_segments = filter_out_segments(yellow_segments, 15, 30, 500, 500);
+int main(int argc, char** argv)
+{
+	BatchOptions options;
+	VideoOptions video;
+	BgrLutMode lut_mode = Lut_None;
+	std::string lut_cache;
+	int strip_rows = 0;
+	for (int i = 1; i < argc; i++)
+	{
+		std::string argument = argv[i];
+		if (argument == "-j" && i + 1 < argc)
+			options.threads = std::atoi(argv[++i]);
+		else if (argument == "-o" && i + 1 < argc)
+			options.output_dir = argv[++i];
+		else if (argument == "--in-flight" && i + 1 < argc)
+			options.max_in_flight = std::atoi(argv[++i]);
+		else if (argument == "--pyramid" && i + 1 < argc)
+			options.pyramid_factor = std::atoi(argv[++i]);
+		else if (argument == "--format" && i + 1 < argc)
+		{
+			std::string format = argv[++i];
+			if (format == "json")
+				options.output_format = Output_Json;
+			else if (format == "csv")
+				options.output_format = Output_Csv;
+			else if (format == "images")
+				options.output_format = Output_Images;
+			else
+			{
+				std::cerr << format << ": unknown output format" << std::endl;
+				return 1;
+			}
+		}
+		else if (argument == "--lut" && i + 1 < argc)
+		{
+			std::string mode = argv[++i];
+			if (mode == "full")
+				lut_mode = Lut_Full;
+			else if (mode == "quantized")
+				lut_mode = Lut_Quantized;
+			else
+			{
+				std::cerr << mode << ": unknown lookup table mode" << std::endl;
+				return 1;
+			}
+		}
+		else if (argument == "--lut-cache" && i + 1 < argc)
+			lut_cache = argv[++i];
+		else if (argument == "--strip-rows" && i + 1 < argc)
+			strip_rows = std::atoi(argv[++i]);
+		else if (argument == "--trace" && i + 1 < argc)
+			options.trace_path = argv[++i];
+		else if (argument == "--video" && i + 1 < argc)
+			video.input = argv[++i];
+		else if (argument == "--keyframe" && i + 1 < argc)
+			video.keyframe_interval = std::atoi(argv[++i]);
+		else if (argument == "--slices" && i + 1 < argc)
+			video.scan_slices = std::atoi(argv[++i]);
+		else if (argument == "--realtime")
+			video.realtime = true;
+		else if (argument == "--verify" && i + 1 < argc)
+			video.verify_interval = std::atoi(argv[++i]);
+		else if (argument == "--classes" && i + 1 < argc)
+		{
+			try
+			{
+				options.classifier = load_shape_classifier(argv[++i]);
+			}
+			catch (const std::exception& error)
+			{
+				std::cerr << error.what() << std::endl;
+				return 1;
+			}
+		}
+		else if (argument.size() > 1 && argument[0] == '-')
+		{
+			std::cerr << argument << (takes_value(argument) ? ": missing value" : ": unknown option") << std::endl << usage;
+			return 1;
+		}
+		else
+			options.inputs.push_back(argument);
+	}
 
+	if (lut_mode != Lut_None)
+	{
+		try
+		{
+			ThreadPool pool(std::max(1, options.threads));
+			std::vector<ColorBand> bands = logo_color_bands();
+			options.lut = std::make_shared<const BgrLut>(lut_cache.empty() ? build_bgr_lut(bands, lut_mode, pool) : load_or_build_bgr_lut(lut_cache, bands, lut_mode, pool));
+		}
+		catch (const std::exception& error)
+		{
+			std::cerr << error.what() << std::endl;
+			return 1;
+		}
+		video.lut = options.lut;
+	}
 
-		std::vector<Logo> found_logos = build_logos(yellow_segments, blue_segments, red_segments);
+	if (!video.input.empty())
+	{
+		video.threads = options.threads;
+		video.output_dir = options.output_dir;
+		video.classifier = options.classifier;
+		VideoReport report = run_video(video);
+		print_video_report(report);
+		return report.frames_processed > 0 ? 0 : 1;
+	}
 
-		cv::Mat result = draw_bounding_boxes_for_logos(image, found_logos);
-		cv::imwrite("out/" + filename.substr(10, filename.length() - 10), result);
+	if (options.inputs.empty())
+	{
+		options.inputs = {
+				"Resources/1.jpg",
+				"Resources/2.jpg",
+				"Resources/3.jpg",
+				"Resources/4.jpg",
+				"Resources/5.jpg",
+				"Resources/6.jpg",
+				"Resources/7.jpg"
+		};
 	}
-	
-	return 0;
-}
\ No newline at end of file
+
+	BatchReport report = strip_rows > 0 ? run_streaming_batch(options, strip_rows) : run_batch(options);
+	print_batch_report(report);
+	return report.failed == 0 && !report.output_failed ? 0 : 1;
+}
@@ -0,0 +1,288 @@
+#ifndef MASK_H
+#define MASK_H
+
+#include <algorithm>
+#include <cassert>
+#include <cstdint>
+#include <vector>
+#include <opencv2/core/core.hpp>
+
+enum MaskStorage
+{
+	Mask_Bytes,
+	Mask_Bits
+};
+
+// Single-channel binary mask. Mask_Bytes keeps one 0/255 byte per pixel, Mask_Bits one bit
+// per pixel (bit j of word w is column 64 * w + j). Rows are padded to whole 64-bit words
+// and the padding is always zero, so both layouts can be combined word by word.
+struct BinaryMask
+{
+	int rows = 0;
+	int cols = 0;
+	MaskStorage storage = Mask_Bytes;
+	int words_per_row = 0;
+	std::vector<uint64_t> words;
+
+	BinaryMask() {}
+
+	BinaryMask(int rows, int cols, MaskStorage storage)
+	{
+		create(rows, cols, storage);
+	}
+
+	void create(int new_rows, int new_cols, MaskStorage new_storage)
+	{
+		rows = new_rows;
+		cols = new_cols;
+		storage = new_storage;
+		words_per_row = storage == Mask_Bits ? (cols + 63) / 64 : (cols + 7) / 8;
+		words.assign((size_t)rows * words_per_row, 0);
+	}
+
+	uint64_t* word_row(int row)
+	{
+		return words.data() + (size_t)row * words_per_row;
+	}
+
+	const uint64_t* word_row(int row) const
+	{
+		return words.data() + (size_t)row * words_per_row;
+	}
+
+	uchar* byte_row(int row)
+	{
+		assert(storage == Mask_Bytes);
+		return (uchar*)word_row(row);
+	}
+
+	const uchar* byte_row(int row) const
+	{
+		assert(storage == Mask_Bytes);
+		return (const uchar*)word_row(row);
+	}
+
+	bool get(int row, int col) const
+	{
+		if (storage == Mask_Bits)
+			return (word_row(row)[col >> 6] >> (col & 63)) & 1;
+		return byte_row(row)[col] != 0;
+	}
+
+	void set(int row, int col, bool value)
+	{
+		if (storage == Mask_Bits)
+		{
+			uint64_t bit = uint64_t(1) << (col & 63);
+			uint64_t& word = word_row(row)[col >> 6];
+			word = value ? (word | bit) : (word & ~bit);
+		}
+		else
+		{
+			byte_row(row)[col] = value ? 255 : 0;
+		}
+	}
+
+	// Mask of the valid (non-padding) part of the last word of each row.
+	uint64_t tail_mask() const
+	{
+		int used = storage == Mask_Bits ? cols - 64 * (words_per_row - 1) : 8 * (cols - 8 * (words_per_row - 1));
+		return used >= 64 ? ~uint64_t(0) : (uint64_t(1) << used) - 1;
+	}
+};
+
+inline int popcount64(uint64_t x)
+{
+#if defined(__GNUC__)
+	return __builtin_popcountll(x);
+#else
+	x = x - ((x >> 1) & 0x5555555555555555ULL);
+	x = (x & 0x3333333333333333ULL) + ((x >> 2) & 0x3333333333333333ULL);
+	x = (x + (x >> 4)) & 0x0F0F0F0F0F0F0F0FULL;
+	return (int)((x * 0x0101010101010101ULL) >> 56);
+#endif
+}
+
+inline int count_trailing_zeros64(uint64_t x)
+{
+#if defined(__GNUC__)
+	return __builtin_ctzll(x);
+#else
+	int n = 0;
+	while (!(x & 1))
+	{
+		x >>= 1;
+		n++;
+	}
+	return n;
+#endif
+}
+
+// First foreground column >= from in the given row, or mask.cols if there is none.
+inline int next_set_column(const BinaryMask& mask, int row, int from)
+{
+	if (from >= mask.cols)
+		return mask.cols;
+	if (mask.storage == Mask_Bits)
+	{
+		const uint64_t* words = mask.word_row(row);
+		int w = from >> 6;
+		uint64_t word = words[w] & (~uint64_t(0) << (from & 63));
+		while (word == 0)
+		{
+			if (++w == mask.words_per_row)
+				return mask.cols;
+			word = words[w];
+		}
+		return 64 * w + count_trailing_zeros64(word);
+	}
+	const uchar* bytes = mask.byte_row(row);
+	int j = from;
+	while (j < mask.cols && bytes[j] == 0)
+	{
+		j++;
+	}
+	return j;
+}
+
+// First background column >= from in the given row, or mask.cols if there is none.
+inline int next_clear_column(const BinaryMask& mask, int row, int from)
+{
+	if (from >= mask.cols)
+		return mask.cols;
+	if (mask.storage == Mask_Bits)
+	{
+		const uint64_t* words = mask.word_row(row);
+		int w = from >> 6;
+		uint64_t word = ~words[w] & (~uint64_t(0) << (from & 63));
+		while (word == 0)
+		{
+			if (++w == mask.words_per_row)
+				return mask.cols;
+			word = ~words[w];
+		}
+		return std::min(mask.cols, 64 * w + count_trailing_zeros64(word));
+	}
+	const uchar* bytes = mask.byte_row(row);
+	int j = from;
+	while (j < mask.cols && bytes[j] != 0)
+	{
+		j++;
+	}
+	return j;
+}
+
+// Bit k of the result is column 64 * w + k + shift of the row; columns outside the row read as 0.
+inline uint64_t shifted_mask_word(const uint64_t* row, int words_per_row, int w, int shift)
+{
+	int base = 64 * w + shift;
+	int q = base >= 0 ? base / 64 : -((-base + 63) / 64);
+	int r = base - 64 * q;
+	uint64_t lo = (q >= 0 && q < words_per_row) ? row[q] : 0;
+	uint64_t hi = (q + 1 >= 0 && q + 1 < words_per_row) ? row[q + 1] : 0;
+	return r == 0 ? lo : (lo >> r) | (hi << (64 - r));
+}
+
+inline long long mask_area(const BinaryMask& mask)
+{
+	long long bits = 0;
+	for (uint64_t word : mask.words)
+	{
+		bits += popcount64(word);
+	}
+	return mask.storage == Mask_Bits ? bits : bits / 8;
+}
+
+inline BinaryMask mask_and(const BinaryMask& mask1, const BinaryMask& mask2)
+{
+	assert(mask1.rows == mask2.rows && mask1.cols == mask2.cols && mask1.storage == mask2.storage);
+	BinaryMask result = mask1;
+	for (size_t i = 0; i < result.words.size(); i++)
+	{
+		result.words[i] &= mask2.words[i];
+	}
+	return result;
+}
+
+inline BinaryMask mask_or(const BinaryMask& mask1, const BinaryMask& mask2)
+{
+	assert(mask1.rows == mask2.rows && mask1.cols == mask2.cols && mask1.storage == mask2.storage);
+	BinaryMask result = mask1;
+	for (size_t i = 0; i < result.words.size(); i++)
+	{
+		result.words[i] |= mask2.words[i];
+	}
+	return result;
+}
+
+inline BinaryMask mask_not(const BinaryMask& mask)
+{
+	BinaryMask result = mask;
+	uint64_t tail = mask.tail_mask();
+	for (int i = 0; i < result.rows; i++)
+	{
+		uint64_t* row = result.word_row(i);
+		for (int w = 0; w < result.words_per_row; w++)
+		{
+			row[w] = ~row[w];
+		}
+		if (result.words_per_row > 0)
+			row[result.words_per_row - 1] &= tail;
+	}
+	return result;
+}
+
+inline BinaryMask convert_mask(const BinaryMask& mask, MaskStorage storage)
+{
+	if (mask.storage == storage)
+		return mask;
+	BinaryMask result(mask.rows, mask.cols, storage);
+	for (int i = 0; i < mask.rows; i++)
+	{
+		for (int j = 0; j < mask.cols; j++)
+		{
+			if (mask.get(i, j))
+				result.set(i, j, true);
+		}
+	}
+	return result;
+}
+
+// Any non-zero pixel of a 1- or 3-channel 8-bit image is foreground.
+inline BinaryMask mask_from_mat(const cv::Mat& image, MaskStorage storage)
+{
+	CV_Assert(image.type() == CV_8UC1 || image.type() == CV_8UC3);
+	BinaryMask result(image.rows, image.cols, storage);
+	int channels = image.channels();
+	for (int i = 0; i < image.rows; i++)
+	{
+		const uchar* src = image.ptr<uchar>(i);
+		for (int j = 0; j < image.cols; j++)
+		{
+			bool on = false;
+			for (int c = 0; c < channels; c++)
+			{
+				on = on || src[j * channels + c] != 0;
+			}
+			if (on)
+				result.set(i, j, true);
+		}
+	}
+	return result;
+}
+
+inline cv::Mat mask_to_mat(const BinaryMask& mask)
+{
+	cv::Mat result = cv::Mat::zeros(mask.rows, mask.cols, CV_8UC1);
+	for (int i = 0; i < mask.rows; i++)
+	{
+		uchar* dst = result.ptr<uchar>(i);
+		for (int j = 0; j < mask.cols; j++)
+		{
+			dst[j] = mask.get(i, j) ? 255 : 0;
+		}
+	}
+	return result;
+}
+
+#endif
@@ -0,0 +1,375 @@
+#ifndef MOMENTS_H
+#define MOMENTS_H
+
+#include <cmath>
+#include <cstdint>
+#include <limits>
+#include <vector>
+
+// Raw moments are sums of integer powers of pixel coordinates, so they are accumulated exactly;
+// mu_table centralizes them exactly as well and only its results are converted to double.
+// GCC and Clang sum in __int128. Compilers without it, MSVC among them, get Int128 below, which
+// gives the same results; LOGO_PORTABLE_MOMENT_SUM selects it everywhere, for testing it.
+#if defined(__SIZEOF_INT128__) && !defined(LOGO_PORTABLE_MOMENT_SUM)
+typedef __int128 MomentSum;
+#else
+
+// Two's complement 128-bit integer in two words, with the operations the moment sums need. Like
+// __int128 it wraps on overflow, division is only by small positive constants and the
+// conversions to floating point are correctly rounded.
+struct Int128
+{
+	uint64_t low = 0;
+	uint64_t high = 0;
+
+	Int128() {}
+
+	Int128(long long value)
+		: low((uint64_t)value), high(value < 0 ? ~uint64_t(0) : 0)
+	{
+	}
+
+	Int128(int value)
+		: Int128((long long)value)
+	{
+	}
+
+	bool negative() const
+	{
+		return (high >> 63) != 0;
+	}
+
+	Int128 operator-() const
+	{
+		Int128 result;
+		result.low = ~low + 1;
+		result.high = ~high + (result.low == 0);
+		return result;
+	}
+
+	Int128& operator+=(const Int128& other)
+	{
+		uint64_t sum = low + other.low;
+		high += other.high + (sum < low);
+		low = sum;
+		return *this;
+	}
+
+	Int128& operator-=(const Int128& other)
+	{
+		return *this += -other;
+	}
+
+	// Full 128-bit product of two words.
+	static Int128 multiply_words(uint64_t a, uint64_t b)
+	{
+		uint64_t a0 = a & 0xffffffffu;
+		uint64_t a1 = a >> 32;
+		uint64_t b0 = b & 0xffffffffu;
+		uint64_t b1 = b >> 32;
+		uint64_t p00 = a0 * b0;
+		uint64_t p01 = a0 * b1;
+		uint64_t p10 = a1 * b0;
+		uint64_t middle = (p00 >> 32) + (p01 & 0xffffffffu) + (p10 & 0xffffffffu);
+		Int128 result;
+		result.low = (p00 & 0xffffffffu) | (middle << 32);
+		result.high = a1 * b1 + (p01 >> 32) + (p10 >> 32) + (middle >> 32);
+		return result;
+	}
+
+	Int128& operator*=(const Int128& other)
+	{
+		Int128 result = multiply_words(low, other.low);
+		result.high += low * other.high + high * other.low;
+		return *this = result;
+	}
+
+	// Rounds towards zero, as integer division does.
+	Int128& operator/=(int divisor)
+	{
+		bool flip = negative() != (divisor < 0);
+		uint64_t d = divisor < 0 ? 0 - (uint64_t)(long long)divisor : (uint64_t)divisor;
+		Int128 magnitude = negative() ? -*this : *this;
+		uint64_t parts[4] = { magnitude.high >> 32, magnitude.high & 0xffffffffu, magnitude.low >> 32, magnitude.low & 0xffffffffu };
+		uint64_t remainder = 0;
+		for (auto& part : parts)
+		{
+			uint64_t current = (remainder << 32) | part;
+			part = current / d;
+			remainder = current % d;
+		}
+		magnitude.high = (parts[0] << 32) | parts[1];
+		magnitude.low = (parts[2] << 32) | parts[3];
+		return *this = flip ? -magnitude : magnitude;
+	}
+
+	// Rounds as converting the exact value would. A type with at most 62 significant bits gets the
+	// top 64 bits, the lowest of them set if any bit below them is; a wider one, such as the x87
+	// long double, gets the top 64 bits and the rest as two exact terms, and rounds once adding them.
+	template <typename Float>
+	Float to_floating() const
+	{
+		if (negative())
+			return -(-*this).to_floating<Float>();
+		if (high == 0)
+			return (Float)low;
+		int shift = 64;
+		while (shift > 0 && (high >> (shift - 1)) == 0)
+			shift--;
+		uint64_t top = shift == 64 ? high : (high << (64 - shift)) | (low >> shift);
+		uint64_t below = shift == 64 ? low : low << (64 - shift);
+		if (std::numeric_limits<Float>::digits > 62)
+			return std::ldexp((Float)top, shift) + std::ldexp((Float)below, shift - 64);
+		return std::ldexp((Float)(top | (below != 0)), shift);
+	}
+
+	explicit operator double() const
+	{
+		return to_floating<double>();
+	}
+
+	explicit operator long double() const
+	{
+		return to_floating<long double>();
+	}
+};
+
+inline Int128 operator+(Int128 a, const Int128& b) { return a += b; }
+inline Int128 operator-(Int128 a, const Int128& b) { return a -= b; }
+inline Int128 operator*(Int128 a, const Int128& b) { return a *= b; }
+inline Int128 operator/(Int128 a, int b) { return a /= b; }
+inline bool operator==(const Int128& a, const Int128& b) { return a.low == b.low && a.high == b.high; }
+inline bool operator!=(const Int128& a, const Int128& b) { return !(a == b); }
+inline bool operator<(const Int128& a, const Int128& b)
+{
+	if (a.high != b.high)
+		return (long long)a.high < (long long)b.high;
+	return a.low < b.low;
+}
+inline bool operator>(const Int128& a, const Int128& b) { return b < a; }
+
+typedef Int128 MomentSum;
+#endif
+
+// For a component of n pixels with coordinates below c, the raw sums of order k are at most
+// n * c^k, and the third-order numerators of mu_table, such as n^2 * m30 - 3 * n * m10 * m20 +
+// 2 * m10^3, stay below 8 * (n * c)^3 = 2^(3 + 3 * 41). They fit in 128 bits while n * c is
+// below this limit: a 500 x 500 component anywhere in an image up to 8 million pixels across, or
+// one covering a whole 13000 x 13000 image. Beyond it the sums of the third-order moments can
+// overflow.
+const int max_exact_moment_extent_bits = 41;
+const long long max_exact_moment_extent = 1LL << max_exact_moment_extent_bits;
+static_assert(sizeof(MomentSum) == 16 && 3 + 3 * max_exact_moment_extent_bits < 127, "third-order numerators overflow MomentSum");
+
+// Sum of x^k for x = 0..n (0 when n < 0).
+inline MomentSum power_sum(int k, MomentSum n)
+{
+	if (n < 0)
+		return 0;
+	MomentSum triangle = n * (n + 1) / 2;
+	switch (k)
+	{
+	case 0:
+		return n + 1;
+	case 1:
+		return triangle;
+	case 2:
+		return n * (n + 1) * (2 * n + 1) / 6;
+	default:
+		return triangle * triangle;
+	}
+}
+
+// m_ij = sum of x^i * y^j, where x is the column and y the row of a pixel.
+struct RawMoments
+{
+	MomentSum m00 = 0;
+	MomentSum m10 = 0;
+	MomentSum m01 = 0;
+	MomentSum m11 = 0;
+	MomentSum m20 = 0;
+	MomentSum m02 = 0;
+	MomentSum m21 = 0;
+	MomentSum m12 = 0;
+	MomentSum m30 = 0;
+	MomentSum m03 = 0;
+
+	void add_run(int row, int col_begin, int col_end)
+	{
+		MomentSum s0 = col_end - col_begin;
+		MomentSum s1 = power_sum(1, col_end - 1) - power_sum(1, col_begin - 1);
+		MomentSum s2 = power_sum(2, col_end - 1) - power_sum(2, col_begin - 1);
+		MomentSum s3 = power_sum(3, col_end - 1) - power_sum(3, col_begin - 1);
+		add_column_sums(row, s0, s1, s2, s3);
+	}
+
+	// Adds (sign 1) or removes (sign -1) the pixels [0, col) of row: a run is its end edge minus
+	// its begin edge, which is how moments are summed along a contour.
+	void add_edge(int row, int col, int sign)
+	{
+		add_column_sums(row, sign * power_sum(0, col - 1), sign * power_sum(1, col - 1), sign * power_sum(2, col - 1), sign * power_sum(3, col - 1));
+	}
+
+	// s_k is the sum of x^k over the pixels added in row.
+	void add_column_sums(int row, MomentSum s0, MomentSum s1, MomentSum s2, MomentSum s3)
+	{
+		MomentSum y = row;
+		MomentSum y2 = y * y;
+		m00 += s0;
+		m10 += s1;
+		m01 += y * s0;
+		m11 += y * s1;
+		m20 += s2;
+		m02 += y2 * s0;
+		m21 += y * s2;
+		m12 += y2 * s1;
+		m30 += s3;
+		m03 += y2 * y * s0;
+	}
+
+	void add_pixel(int row, int col)
+	{
+		add_run(row, col, col + 1);
+	}
+
+	void add(const RawMoments& other)
+	{
+		m00 += other.m00;
+		m10 += other.m10;
+		m01 += other.m01;
+		m11 += other.m11;
+		m20 += other.m20;
+		m02 += other.m02;
+		m21 += other.m21;
+		m12 += other.m12;
+		m30 += other.m30;
+		m03 += other.m03;
+	}
+};
+
+inline RawMoments raw_moments(const std::vector<std::pair<int, int>>& pixels)
+{
+	RawMoments raw;
+	for (const auto& pixel : pixels)
+	{
+		raw.add_pixel(pixel.first, pixel.second);
+	}
+	return raw;
+}
+
+// Raw moments can be much larger than the central moments they cancel down to, so the
+// centralization is done on the exact sums: m00 * mu_pq for second order and m00^2 * mu_pq for
+// third order are integers. Only those are converted to double.
+struct CentralMoments
+{
+	double mu00;
+	double mu01;
+	double mu10;
+	double mu11;
+	double mu20;
+	double mu02;
+	double mu21;
+	double mu12;
+	double mu30;
+	double mu03;
+};
+
+struct ScaleInvariants
+{
+	double eta11;
+	double eta20;
+	double eta02;
+	double eta21;
+	double eta12;
+	double eta30;
+	double eta03;
+};
+
+struct RotationInvariants
+{
+	double M1;
+	double M2;
+	double M3;
+	double M4;
+	double M5;
+	double M6;
+	double M7;
+};
+
+inline CentralMoments mu_table(const RawMoments& raw)
+{
+	CentralMoments moments{};
+	if (raw.m00 == 0)
+		return moments;
+	MomentSum n = raw.m00;
+	MomentSum x = raw.m10;
+	MomentSum y = raw.m01;
+	double second = (double)n;
+	double third = (double)n * (double)n;
+	moments.mu00 = (double)n;
+	moments.mu11 = (double)(n * raw.m11 - x * y) / second;
+	moments.mu20 = (double)(n * raw.m20 - x * x) / second;
+	moments.mu02 = (double)(n * raw.m02 - y * y) / second;
+	moments.mu21 = (double)(n * n * raw.m21 - 2 * n * x * raw.m11 - n * y * raw.m20 + 2 * x * x * y) / third;
+	moments.mu12 = (double)(n * n * raw.m12 - 2 * n * y * raw.m11 - n * x * raw.m02 + 2 * y * y * x) / third;
+	moments.mu30 = (double)(n * n * raw.m30 - 3 * n * x * raw.m20 + 2 * x * x * x) / third;
+	moments.mu03 = (double)(n * n * raw.m03 - 3 * n * y * raw.m02 + 2 * y * y * y) / third;
+	return moments;
+}
+
+// eta_pq = mu_pq / mu00^((p + q) / 2 + 1), with the exponent 2 for second and 2.5 for third order.
+inline ScaleInvariants eta_table(const CentralMoments& moments)
+{
+	ScaleInvariants eta_table;
+	double second = moments.mu00 * moments.mu00;
+	double third = second * std::sqrt(moments.mu00);
+	eta_table.eta11 = moments.mu11 / second;
+	eta_table.eta20 = moments.mu20 / second;
+	eta_table.eta02 = moments.mu02 / second;
+	eta_table.eta21 = moments.mu21 / third;
+	eta_table.eta12 = moments.mu12 / third;
+	eta_table.eta30 = moments.mu30 / third;
+	eta_table.eta03 = moments.mu03 / third;
+	return eta_table;
+}
+
+// M1, M2 and M7 only depend on the second-order moments; M3..M6 are left at 0.
+inline RotationInvariants second_order_invariants(const CentralMoments& moments)
+{
+	double second = moments.mu00 * moments.mu00;
+	double eta11 = moments.mu11 / second;
+	double eta20 = moments.mu20 / second;
+	double eta02 = moments.mu02 / second;
+	RotationInvariants i{};
+
+	double difference = eta20 - eta02;
+	i.M1 = eta20 + eta02;
+	i.M2 = difference * difference + 4.0 * eta11 * eta11;
+	i.M7 = eta20 * eta02 - eta11 * eta11;
+
+	return i;
+}
+
+inline RotationInvariants hu_moments(const CentralMoments& moments)
+{
+	ScaleInvariants e = eta_table(moments);
+	RotationInvariants i = second_order_invariants(moments);
+
+	double a = e.eta30 - 3.0 * e.eta12;
+	double b = 3.0 * e.eta21 - e.eta03;
+	double c = e.eta30 + e.eta12;
+	double d = e.eta21 + e.eta03;
+	i.M3 = a * a + b * b;
+	i.M4 = c * c + d * d;
+	i.M5 = a * c * (c * c - 3.0 * d * d) + b * d * (3.0 * c * c - d * d);
+	i.M6 = (e.eta20 - e.eta02) * (c * c - d * d) + 4.0 * e.eta11 * c * d;
+
+	return i;
+}
+
+inline RotationInvariants hu_moments(const std::vector<std::pair<int, int>>& pixels)
+{
+	return hu_moments(mu_table(raw_moments(pixels)));
+}
+
+#endif
@@ -0,0 +1,93 @@
+#ifndef PYRAMID_H
+#define PYRAMID_H
+
+#include <algorithm>
+#include <map>
+#include <string>
+#include <vector>
+#include <opencv2/core/core.hpp>
+
+#include "color_bands.h"
+#include "detection.h"
+#include "logo.h"
+#include "segments.h"
+#include "thread_pool.h"
+#include "tiling.h"
+#include "trace.h"
+
+// Every factor-th pixel of every factor-th row, taken from the centre of its block. Sampling
+// instead of averaging keeps the colors, so the HSV bands still apply.
+inline cv::Mat downsample_image(const cv::Mat& image, int factor)
+{
+	cv::Mat result((image.rows + factor - 1) / factor, (image.cols + factor - 1) / factor, image.type());
+	int channels = (int)image.elemSize();
+	for (int i = 0; i < result.rows; i++)
+	{
+		const uchar* src = image.ptr<uchar>(std::min(image.rows - 1, i * factor + factor / 2));
+		uchar* dst = result.ptr<uchar>(i);
+		for (int j = 0; j < result.cols; j++)
+		{
+			const uchar* pixel = src + std::min(image.cols - 1, j * factor + factor / 2) * channels;
+			for (int c = 0; c < channels; c++)
+				dst[j * channels + c] = pixel[c];
+		}
+	}
+	return result;
+}
+
+// Full-resolution boxes around the yellow segments found on the image downsampled by factor.
+// The size limits are divided by factor and loosened by a pixel either way, and each box is
+// padded by two blocks so the dilation and the sampling offset cannot cut the disc off.
+inline std::vector<cv::Rect> yellow_candidate_regions(const cv::Mat& image, const ColorBand& yellow, int factor, ThreadPool& pool, const DetectionLimits& limits = DetectionLimits())
+{
+	cv::Mat small = downsample_image(image, factor);
+	std::map<std::string, BinaryMask> masks = classify_color_bands(small, { yellow }, pool, Mask_Bits);
+	BinaryMask yellow_mask = dilation_filter(masks[yellow.name], limits.dilation_size, limits.dilation_iterations, pool);
+	std::vector<Segment> segments = segment_mask(yellow_mask, pool);
+	segments = filter_out_segments(segments, std::max(1, limits.yellow.min_height / factor - 1), std::max(1, limits.yellow.min_width / factor - 1),
+		limits.yellow.max_height / factor + 2, limits.yellow.max_width / factor + 2);
+
+	cv::Rect whole(0, 0, image.cols, image.rows);
+	int pad = 2 * factor + 2;
+	std::vector<cv::Rect> regions;
+	for (const auto& segment : segments)
+	{
+		cv::Rect box(segment.col_min * factor - pad, segment.row_min * factor - pad,
+			segment.get_width() * factor + 2 * pad, segment.get_height() * factor + 2 * pad);
+		regions.push_back(box & whole);
+	}
+	return merge_regions(regions);
+}
+
+// Coarse-to-fine detection: the yellow mask is built at 1 / factor resolution and the whole
+// pipeline then runs at full resolution inside the candidate regions only. Without a band named
+// "yellow" or with factor < 2 this is detect_logos. The full-resolution passes use buffers.
+inline std::vector<Logo> detect_logos_pyramid(const cv::Mat& image, const std::vector<ColorBand>& bands, ThreadPool& pool, int factor, FrameBuffers& buffers, CascadeStats* stats = nullptr, const ShapeClassifier& classifier = logo_shape_classifier(), const DetectionLimits& limits = DetectionLimits())
+{
+	auto yellow = std::find_if(bands.begin(), bands.end(), [](const ColorBand& band) { return band.name == "yellow"; });
+	if (factor < 2 || yellow == bands.end())
+		return detect_logos(image, bands, pool, buffers, stats, classifier, limits);
+
+	std::vector<cv::Rect> regions;
+	{
+		TraceScope scope(buffers.trace, "yellow_candidate_regions");
+		regions = yellow_candidate_regions(image, *yellow, factor, pool, limits);
+	}
+	if (tracing(buffers.trace))
+		buffers.trace->count("candidate_regions", (long long)regions.size());
+	std::vector<Logo> logos;
+	for (const auto& region : regions)
+	{
+		const std::vector<Logo>& found = detect_logos_in_region(image, region, bands, pool, buffers, stats, classifier, limits);
+		logos.insert(logos.end(), found.begin(), found.end());
+	}
+	return logos;
+}
+
+inline std::vector<Logo> detect_logos_pyramid(const cv::Mat& image, const std::vector<ColorBand>& bands, ThreadPool& pool, int factor, CascadeStats* stats = nullptr, const ShapeClassifier& classifier = logo_shape_classifier(), const DetectionLimits& limits = DetectionLimits())
+{
+	FrameBuffers buffers;
+	return detect_logos_pyramid(image, bands, pool, factor, buffers, stats, classifier, limits);
+}
+
+#endif
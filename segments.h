@@ -1,12 +1,16 @@
 #ifndef SEGMENTS_H
 #define SEGMENTS_H
 
+#include <algorithm>
 #include <vector>
-#include <deque>
 #include <opencv2/core/core.hpp>
 #include <opencv2/highgui/highgui.hpp>
 #include <opencv2/imgproc/imgproc.hpp>
 
+#include "mask.h"
+#include "labeling.h"
+#include "moments.h"
+
 enum SegmentType
 {
 	Undefined,
@@ -14,137 +18,281 @@ enum SegmentType
 	Letter_D,
 	Letter_I,
 	Red_Dot,
-	Letter_I_With_Dot
+	Letter_I_With_Dot,
+	Yellow_Circle
 };
 
 
+struct SegmentRun
+{
+	int row;
+	int col_begin;
+	int col_end;
+};
+
+// Pixels are kept as horizontal runs [col_begin, col_end) in raster order.
 struct Segment
 {
 	int row_min;
 	int row_max;
 	int col_min;
 	int col_max;
-	std::vector<std::pair<int, int>> pixel_coordinates;
-	std::vector<std::pair<int, int>> border_pixel_coordinates;
+	std::vector<SegmentRun> runs;
 	SegmentType type;
+	CentralMoments central_moments;
 
-	int get_width()
+	int get_width() const
 	{
 		return col_max - col_min + 1;
 	}
 
-	int get_height()
+	int get_height() const
 	{
 		return row_max - row_min + 1;
 	}
 
-	bool contains(Segment other)
+	long long area() const
+	{
+		long long result = 0;
+		for (const auto& run : runs)
+		{
+			result += run.col_end - run.col_begin;
+		}
+		return result;
+	}
+
+	RawMoments raw_moments() const
+	{
+		RawMoments raw;
+		for (const auto& run : runs)
+		{
+			raw.add_run(run.row, run.col_begin, run.col_end);
+		}
+		return raw;
+	}
+
+	std::vector<std::pair<int, int>> pixel_coordinates() const
+	{
+		std::vector<std::pair<int, int>> pixels;
+		pixels.reserve(area());
+		for (const auto& run : runs)
+		{
+			for (int j = run.col_begin; j < run.col_end; j++)
+			{
+				pixels.push_back(std::make_pair(run.row, j));
+			}
+		}
+		return pixels;
+	}
+
+	// Pixels with a 4-neighbour outside the segment, in raster order.
+	std::vector<std::pair<int, int>> border_pixel_coordinates() const
+	{
+		std::vector<size_t> row_begin(get_height() + 1, runs.size());
+		for (size_t k = runs.size(); k-- > 0; )
+		{
+			row_begin[runs[k].row - row_min] = k;
+		}
+		for (int r = get_height() - 1; r >= 0; r--)
+		{
+			row_begin[r] = std::min(row_begin[r], row_begin[r + 1]);
+		}
+
+		std::vector<std::pair<int, int>> border;
+		for (int r = 0; r < get_height(); r++)
+		{
+			size_t above = r > 0 ? row_begin[r - 1] : 0;
+			size_t above_end = r > 0 ? row_begin[r] : 0;
+			size_t below = r + 1 < get_height() ? row_begin[r + 1] : 0;
+			size_t below_end = r + 1 < get_height() ? row_begin[r + 2] : 0;
+			for (size_t k = row_begin[r]; k < row_begin[r + 1]; k++)
+			{
+				for (int j = runs[k].col_begin; j < runs[k].col_end; j++)
+				{
+					while (above < above_end && runs[above].col_end <= j)
+						above++;
+					while (below < below_end && runs[below].col_end <= j)
+						below++;
+					bool covered_above = above < above_end && runs[above].col_begin <= j;
+					bool covered_below = below < below_end && runs[below].col_begin <= j;
+					if (j == runs[k].col_begin || j == runs[k].col_end - 1 || !covered_above || !covered_below)
+						border.push_back(std::make_pair(row_min + r, j));
+				}
+			}
+		}
+		return border;
+	}
+
+	// Moves the segment by (rows, cols); the central moments do not change.
+	void translate(int rows, int cols)
+	{
+		row_min += rows;
+		row_max += rows;
+		col_min += cols;
+		col_max += cols;
+		for (auto& run : runs)
+		{
+			run.row += rows;
+			run.col_begin += cols;
+			run.col_end += cols;
+		}
+	}
+
+	bool contains(const Segment& other) const
 	{
 		return (other.row_min > row_min && other.row_max < row_max&& other.col_min > col_min && other.col_max < col_max);
 	}
 };
 
-bool compare_segments_by_x(const Segment& a, const Segment& b)
+// Strict orderings for std::sort. Comparing by "ends before the other begins" is not one when
+// segments overlap, and the order then depends on which other segments are in the list.
+inline bool compare_segments_by_x(const Segment& a, const Segment& b)
 {
-	return a.col_max < b.col_min;
+	return a.col_min < b.col_min || (a.col_min == b.col_min && a.row_min < b.row_min);
 }
 
-bool compare_segments_by_y(const Segment& a, const Segment& b)
+inline bool compare_segments_by_y(const Segment& a, const Segment& b)
 {
-	return a.row_max < b.row_min;
+	return a.row_min < b.row_min || (a.row_min == b.row_min && a.col_min < b.col_min);
 }
 
-bool is_border_color(cv::Mat& mask, int y, int x)
+// Resizes items to count, parking removed elements in spare and taking new ones from there, so
+// the buffers the elements own are kept for later frames instead of being freed.
+template <typename T>
+void resize_reusing(std::vector<T>& items, size_t count, std::vector<T>& spare)
 {
-	if (x == 0 || x == mask.cols - 1 || y == 0 || y == mask.rows - 1)
+	while (items.size() > count)
 	{
-		return true;
+		spare.push_back(std::move(items.back()));
+		items.pop_back();
+	}
+	while (items.size() < count)
+	{
+		if (spare.empty())
+		{
+			items.emplace_back();
+			continue;
+		}
+		items.push_back(std::move(spare.back()));
+		spare.pop_back();
 	}
-	return mask.at<cv::Vec3b>(y - 1, x) == cv::Vec3b(0, 0, 0) ||
-		mask.at<cv::Vec3b>(y + 1, x) == cv::Vec3b(0, 0, 0) ||
-		mask.at<cv::Vec3b>(y, x - 1) == cv::Vec3b(0, 0, 0) ||
-		mask.at<cv::Vec3b>(y, x + 1) == cv::Vec3b(0, 0, 0);
 }
 
-Segment flood_fill_segment(cv::Mat mask, std::pair<int, int> seed)
+struct SegmentBuffers
 {
-	int row_min = mask.rows;
-	int row_max = 0;
-	int col_min = mask.cols;
-	int col_max = 0;
-	std::vector<std::pair<int, int>> pixel_coordinates;
-	std::vector<std::pair<int, int>> border_pixel_coordinates;
-	std::deque<std::pair<int, int>> stack;
+	std::vector<Segment> spare;
+	std::vector<size_t> run_counts;
+	std::vector<size_t> order;
+	std::vector<std::vector<SegmentRun>> run_vectors;
+};
 
-	stack.push_back(seed);
-	while (!stack.empty())
+// Hands the run vectors of segments and spare with the most capacity to the segments with the
+// most runs, so a component only needs a new vector when it is bigger than all but a few seen
+// before rather than whenever it lands in a slot that held a smaller one.
+inline void assign_run_vectors(std::vector<Segment>& segments, SegmentBuffers& buffers)
+{
+	const std::vector<size_t>& run_counts = buffers.run_counts;
+	std::vector<size_t>& order = buffers.order;
+	order.resize(segments.size());
+	for (size_t k = 0; k < order.size(); k++)
 	{
-		std::pair<int, int> current_pixel_coords = stack.front();
-		stack.pop_front();
-		if (current_pixel_coords.first >= 0 && current_pixel_coords.second >= 0 && current_pixel_coords.first < mask.rows && current_pixel_coords.second < mask.cols)
-		{
-
-			cv::Vec3b pixel = mask.at<cv::Vec3b>(current_pixel_coords.first, current_pixel_coords.second);
-			if (pixel != cv::Vec3b(0, 0, 0))
-			{
-				if (current_pixel_coords.first < row_min)
-				{
-					row_min = current_pixel_coords.first;
-				}
-				if (current_pixel_coords.first > row_max)
-				{
-					row_max = current_pixel_coords.first;
-				}
-				if (current_pixel_coords.second < col_min)
-				{
-					col_min = current_pixel_coords.second;
-				}
-				if (current_pixel_coords.second > col_max)
-				{
-					col_max = current_pixel_coords.second;
-				}
-				pixel_coordinates.push_back(current_pixel_coords);
-				mask.at<cv::Vec3b>(current_pixel_coords.first, current_pixel_coords.second) = cv::Vec3b(0, 0, 0);
-
-				if (is_border_color(mask, current_pixel_coords.first, current_pixel_coords.second))
-				{
-					border_pixel_coordinates.push_back(current_pixel_coords);
-				}
+		order[k] = k;
+	}
+	std::sort(order.begin(), order.end(), [&](size_t a, size_t b) { return run_counts[a] > run_counts[b]; });
 
-				stack.push_back(std::make_pair(current_pixel_coords.first - 1, current_pixel_coords.second));
-				stack.push_back(std::make_pair(current_pixel_coords.first + 1, current_pixel_coords.second));
-				stack.push_back(std::make_pair(current_pixel_coords.first, current_pixel_coords.second - 1));
-				stack.push_back(std::make_pair(current_pixel_coords.first, current_pixel_coords.second + 1));
+	std::vector<std::vector<SegmentRun>>& run_vectors = buffers.run_vectors;
+	run_vectors.clear();
+	for (auto* list : { &segments, &buffers.spare })
+	{
+		for (auto& segment : *list)
+			run_vectors.push_back(std::move(segment.runs));
+	}
+	std::sort(run_vectors.begin(), run_vectors.end(), [](const std::vector<SegmentRun>& a, const std::vector<SegmentRun>& b) { return a.capacity() > b.capacity(); });
+	for (size_t k = 0; k < order.size(); k++)
+	{
+		segments[order[k]].runs = std::move(run_vectors[k]);
+	}
+	for (size_t k = 0; k < buffers.spare.size(); k++)
+	{
+		buffers.spare[k].runs = std::move(run_vectors[order.size() + k]);
+	}
+}
 
-			}
-		}
+// segments_from_labeling into segments, reusing their run vectors.
+inline void segments_from_labeling(const Labeling& labeling, std::vector<Segment>& segments, SegmentBuffers& buffers)
+{
+	std::vector<size_t>& run_counts = buffers.run_counts;
+	run_counts.assign(labeling.components.size(), 0);
+	for (const auto& run : labeling.runs)
+	{
+		run_counts[run.label - 1]++;
 	}
 
-	return Segment{ row_min, row_max, col_min, col_max, pixel_coordinates, border_pixel_coordinates, Undefined };
+	resize_reusing(segments, labeling.components.size(), buffers.spare);
+	assign_run_vectors(segments, buffers);
+	for (size_t k = 0; k < labeling.components.size(); k++)
+	{
+		const ComponentStats& component = labeling.components[k];
+		Segment& segment = segments[k];
+		segment.row_min = component.row_min;
+		segment.row_max = component.row_max;
+		segment.col_min = component.col_min;
+		segment.col_max = component.col_max;
+		segment.type = Undefined;
+		segment.runs.clear();
+		segment.runs.reserve(run_counts[k]);
+		segment.central_moments = mu_table(component.moments);
+	}
+	for (const auto& run : labeling.runs)
+	{
+		segments[run.label - 1].runs.push_back(SegmentRun{ run.row, run.col_begin, run.col_end });
+	}
 }
 
-std::vector<Segment> segment_mask(cv::Mat image)
+inline std::vector<Segment> segments_from_labeling(const Labeling& labeling)
 {
-	cv::Mat mask = image.clone();
+	std::vector<size_t> run_counts(labeling.components.size(), 0);
+	for (const auto& run : labeling.runs)
+	{
+		run_counts[run.label - 1]++;
+	}
+
 	std::vector<Segment> segments;
-	for (int i = 0; i < mask.rows; i++)
+	segments.reserve(labeling.components.size());
+	for (size_t k = 0; k < labeling.components.size(); k++)
 	{
-		for (int j = 0; j < mask.cols; j++)
-		{
-			if (mask.at<cv::Vec3b>(i, j) != cv::Vec3b(0, 0, 0))
-			{
-				Segment segment = flood_fill_segment(mask, std::make_pair(i, j));
-				segments.push_back(segment);
-			}
-		}
+		const ComponentStats& component = labeling.components[k];
+		segments.emplace_back();
+		Segment& segment = segments.back();
+		segment.row_min = component.row_min;
+		segment.row_max = component.row_max;
+		segment.col_min = component.col_min;
+		segment.col_max = component.col_max;
+		segment.runs.reserve(run_counts[k]);
+		segment.type = Undefined;
+		segment.central_moments = mu_table(component.moments);
+	}
+	for (const auto& run : labeling.runs)
+	{
+		segments[run.label - 1].runs.push_back(SegmentRun{ run.row, run.col_begin, run.col_end });
 	}
 	return segments;
 }
 
-std::vector<Segment> filter_out_segments(std::vector<Segment> segments, int min_height, int min_width, int max_height, int max_width)
+inline std::vector<Segment> segment_mask(const BinaryMask& mask)
+{
+	return segments_from_labeling(label_runs(mask));
+}
+
+inline std::vector<Segment> segment_mask(cv::Mat image)
+{
+	return segment_mask(mask_from_mat(image, Mask_Bytes));
+}
+
+inline std::vector<Segment> filter_out_segments(const std::vector<Segment>& segments, int min_height, int min_width, int max_height, int max_width)
 {
 	std::vector<Segment> filtered_segments;
-	for (Segment segment : segments)
+	for (const Segment& segment : segments)
 	{
 		if (segment.get_height() >= min_height && segment.get_height() <= max_height && segment.get_width() >= min_width && segment.get_width() <= max_width)
 		{
@@ -154,4 +302,35 @@ std::vector<Segment> filter_out_segments(std::vector<Segment> segments, int min_
 	return filtered_segments;
 }
 
+// filter_out_segments without copies: kept segments are swapped to the front in order.
+inline void filter_segments_in_place(std::vector<Segment>& segments, int min_height, int min_width, int max_height, int max_width, std::vector<Segment>& spare)
+{
+	size_t kept = 0;
+	for (size_t k = 0; k < segments.size(); k++)
+	{
+		const Segment& segment = segments[k];
+		if (segment.get_height() >= min_height && segment.get_height() <= max_height && segment.get_width() >= min_width && segment.get_width() <= max_width)
+		{
+			if (k != kept)
+				std::swap(segments[kept], segments[k]);
+			kept++;
+		}
+	}
+	resize_reusing(segments, kept, spare);
+}
+
+// Size limits of the segments of one color, in pixels.
+struct SegmentLimits
+{
+	int min_height;
+	int min_width;
+	int max_height;
+	int max_width;
+};
+
+inline void filter_segments_in_place(std::vector<Segment>& segments, const SegmentLimits& limits, std::vector<Segment>& spare)
+{
+	filter_segments_in_place(segments, limits.min_height, limits.min_width, limits.max_height, limits.max_width, spare);
+}
+
 #endif
\ No newline at end of file
@@ -0,0 +1,318 @@
+#ifndef SHAPE_CLASSIFIER_H
+#define SHAPE_CLASSIFIER_H
+
+#include <cstdint>
+#include <fstream>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "moments.h"
+#include "segments.h"
+#include "trace.h"
+
+// Bit k of a ShapeMask stands for class k of a ShapeClassifier.
+typedef uint32_t ShapeMask;
+
+const int invariant_count = 7;
+const int max_shape_classes = 32;
+
+// Accepted range [lower, upper] of each of M1..M7 for one shape class.
+struct ShapeClassBounds
+{
+	const char* name;
+	SegmentType type;
+	double lower[invariant_count];
+	double upper[invariant_count];
+};
+
+// Reference invariants of the logo parts times the tolerance factors.
+const ShapeClassBounds logo_shape_classes[] = {
+	{ "letter_l", Letter_L,
+		{ 0.232904 * 0.7, 0.001229 * 0.7, 0.002978 * 0.7, 0.000188 * 0.7, -0.000001 * 1.3, -0.000068 * 1.3, 0.011456 * 0.7 },
+		{ 0.452047 * 1.2, 0.23478 * 1.2, 0.01445 * 1.2, 0.006359 * 1.2, 0.00006 * 1.2, 0.002069 * 1.2, 0.0165816 * 1.2 } },
+	{ "letter_d", Letter_D,
+		{ 0.197702 * 0.8, 0.00011 * 0.7, 0.00028 * 0.8, -0.000001 * 1.2, -0.000001 * 1.2, -0.000001 * 1.2, 0.0089269 * 0.7 },
+		{ 0.237674 * 1.2, 0.02854 * 1.2, 0.0011 * 1.2, 0.00035 * 1.2, 0.003797 * 1.2, 0.000064 * 1.2, 0.0109863 * 1.2 } },
+	{ "red_dot", Red_Dot,
+		{ 0.159161 * 0.8, -0.000001 * 1.2, -0.000001 * 1.2, -0.000001 * 1.2, -0.000001 * 1.2, -0.000001 * 1.2, 0.0062891 * 0.8 },
+		{ 0.195348 * 1.2, 0.013819 * 1.2, 0.000105 * 1.2, 0.00001 * 1.2, 0.000001 * 1.2, 0.000001 * 1.2, 0.00634452 * 1.2 } },
+	{ "letter_i", Letter_I,
+		{ 0.166381 * 0.8, 0.000004 * 0.8, 0.00001 * 0.8, -0.000001 * 1.2, -0.000001 * 1.2, -0.000007 * 1.2, 0.00805614 * 0.8 },
+		{ 0.19249 * 1.2, 0.0085 * 1.2, 0.000852 * 1.2, 0.000075 * 1.2, 0.000001 * 1.2, 0.0000013 * 1.2, 0.00962518 * 1.2 } },
+	{ "i_with_dot", Letter_I_With_Dot,
+		{ 0.2564 * 0.8, 0.0214 * 0.8, 0.00379 * 0.8, 0.00081339 * 0.8, 0.00000134 * 0.8, 0.0001176 * 0.8, 0.011 * 0.8 },
+		{ 0.46 * 1.2, 0.1525 * 1.2, 0.02201 * 1.2, 0.01332 * 1.2, 0.0002276 * 1.2, 0.005164 * 1.2, 0.0153 * 1.2 } },
+	{ "yellow_circle", Yellow_Circle,
+		{ 0.210226 * 0.8, 0.00012 * 0.8, -0.000001 * 1.2, -0.000001 * 1.2, -0.000001 * 1.2, -0.000001 * 1.2, 0.00891144 * 0.8 },
+		{ 0.252874 * 1.2, 0.021667 * 1.2, 0.000058 * 1.2, 0.000018 * 1.2, 0.000001 * 1.2, 0.000001 * 1.2, 0.0102189 * 1.2 } }
+};
+
+// Class table with the bounds stored per invariant, one entry per class, so the classification
+// loops read them with unit stride.
+struct ShapeClassifier
+{
+	std::vector<std::string> names;
+	// Trace counter names of the segments of each class rejected by the second-order bounds and
+	// by the full invariants.
+	std::vector<const char*> second_order_counters;
+	std::vector<const char*> hu_counters;
+	std::vector<SegmentType> types;
+	std::vector<double> lower[invariant_count];
+	std::vector<double> upper[invariant_count];
+
+	int size() const
+	{
+		return (int)names.size();
+	}
+
+	void add_class(const std::string& name, SegmentType type, const double* class_lower, const double* class_upper)
+	{
+		if (size() == max_shape_classes)
+			throw std::runtime_error("too many shape classes");
+		names.push_back(name);
+		second_order_counters.push_back(trace_counter_name(name + "_rejected_second_order"));
+		hu_counters.push_back(trace_counter_name(name + "_rejected_hu"));
+		types.push_back(type);
+		for (int m = 0; m < invariant_count; m++)
+		{
+			lower[m].push_back(class_lower[m]);
+			upper[m].push_back(class_upper[m]);
+		}
+	}
+
+	ShapeMask mask_of(SegmentType type) const
+	{
+		ShapeMask mask = 0;
+		for (int k = 0; k < size(); k++)
+		{
+			if (types[k] == type)
+				mask |= ShapeMask(1) << k;
+		}
+		return mask;
+	}
+};
+
+inline const char* segment_type_name(SegmentType type)
+{
+	switch (type)
+	{
+	case Letter_L: return "letter_l";
+	case Letter_D: return "letter_d";
+	case Letter_I: return "letter_i";
+	case Red_Dot: return "red_dot";
+	case Letter_I_With_Dot: return "i_with_dot";
+	case Yellow_Circle: return "yellow_circle";
+	default: return "undefined";
+	}
+}
+
+inline SegmentType segment_type_from_name(const std::string& name)
+{
+	for (int type = Letter_L; type <= Yellow_Circle; type++)
+	{
+		if (name == segment_type_name((SegmentType)type))
+			return (SegmentType)type;
+	}
+	return Undefined;
+}
+
+inline ShapeClassifier make_shape_classifier(const ShapeClassBounds* classes, int count)
+{
+	ShapeClassifier classifier;
+	for (int k = 0; k < count; k++)
+	{
+		classifier.add_class(classes[k].name, classes[k].type, classes[k].lower, classes[k].upper);
+	}
+	return classifier;
+}
+
+inline const ShapeClassifier& logo_shape_classifier()
+{
+	static const ShapeClassifier classifier = make_shape_classifier(logo_shape_classes, sizeof(logo_shape_classes) / sizeof(logo_shape_classes[0]));
+	return classifier;
+}
+
+// One class per line: a name followed by the lower and upper bound of M1, then of M2, ... M7.
+// Empty lines and lines starting with # are skipped. Classes named after a segment type
+// (letter_l, red_dot, ...) get that type, others stay Undefined.
+inline ShapeClassifier load_shape_classifier(const std::string& path)
+{
+	std::ifstream file(path);
+	if (!file)
+		throw std::runtime_error(path + ": cannot read shape classes");
+	ShapeClassifier classifier;
+	std::string line;
+	int line_number = 0;
+	while (std::getline(file, line))
+	{
+		line_number++;
+		std::istringstream fields(line);
+		std::string name;
+		if (!(fields >> name) || name[0] == '#')
+			continue;
+		double class_lower[invariant_count];
+		double class_upper[invariant_count];
+		for (int m = 0; m < invariant_count; m++)
+		{
+			if (!(fields >> class_lower[m] >> class_upper[m]))
+				throw std::runtime_error(path + ":" + std::to_string(line_number) + ": expected 14 bounds after the class name");
+		}
+		classifier.add_class(name, segment_type_from_name(name), class_lower, class_upper);
+	}
+	return classifier;
+}
+
+// Invariants of many segments, one array per invariant.
+struct InvariantBatch
+{
+	std::vector<double> values[invariant_count];
+
+	int size() const
+	{
+		return (int)values[0].size();
+	}
+
+	void clear()
+	{
+		for (auto& value : values)
+		{
+			value.clear();
+		}
+	}
+
+	void push_back(const RotationInvariants& r)
+	{
+		values[0].push_back(r.M1);
+		values[1].push_back(r.M2);
+		values[2].push_back(r.M3);
+		values[3].push_back(r.M4);
+		values[4].push_back(r.M5);
+		values[5].push_back(r.M6);
+		values[6].push_back(r.M7);
+	}
+};
+
+// Clears the bit of every class in masks[i] whose bounds on invariants [first, last) do not hold
+// for entry i of the batch. The inner loop is branch-free so it vectorizes.
+inline void classify_shapes(const ShapeClassifier& classifier, const InvariantBatch& batch, int first, int last, std::vector<ShapeMask>& masks)
+{
+	int count = batch.size();
+	ShapeMask* mask = masks.data();
+	for (int k = 0; k < classifier.size(); k++)
+	{
+		ShapeMask bit = ShapeMask(1) << k;
+		for (int m = first; m < last; m++)
+		{
+			const double* value = batch.values[m].data();
+			double lower = classifier.lower[m][k];
+			double upper = classifier.upper[m][k];
+			for (int i = 0; i < count; i++)
+			{
+				ShapeMask inside = (ShapeMask)((value[i] >= lower) & (value[i] <= upper));
+				mask[i] &= ~(bit & (inside - 1));
+			}
+		}
+	}
+}
+
+// Class masks of a segment list, one entry per segment. second_order holds the classes whose
+// M1, M2 and M7 bounds hold; full ones the classes whose all seven bounds hold. The third-order
+// invariants are only computed for the segments with a non-empty second_order mask. Segments
+// can be classified a few at a time as they are needed: classified marks those done so far, and
+// the masks of the others are 0.
+struct SegmentClasses
+{
+	std::vector<ShapeMask> second_order;
+	std::vector<ShapeMask> full;
+	std::vector<uint8_t> classified;
+	long long hu_computed = 0;
+};
+
+struct ClassifyBuffers
+{
+	InvariantBatch batch;
+	std::vector<int> indices;
+	std::vector<int> pending;
+	std::vector<int> survivors;
+	std::vector<ShapeMask> masks;
+};
+
+// Marks all count segments unclassified.
+inline void reset_segment_classes(SegmentClasses& result, size_t count)
+{
+	result.second_order.assign(count, 0);
+	result.full.assign(count, 0);
+	result.classified.assign(count, 0);
+	result.hu_computed = 0;
+}
+
+// Classifies the segments of indices not classified yet, in one batch; indices may repeat.
+inline void classify_segments_at(const ShapeClassifier& classifier, const std::vector<Segment>& segments, const std::vector<int>& indices, ShapeMask classes, SegmentClasses& result, ClassifyBuffers& buffers)
+{
+	std::vector<int>& pending = buffers.pending;
+	std::vector<ShapeMask>& masks = buffers.masks;
+	InvariantBatch& batch = buffers.batch;
+	pending.clear();
+	masks.clear();
+	batch.clear();
+	for (int i : indices)
+	{
+		if (result.classified[i])
+			continue;
+		result.classified[i] = 1;
+		pending.push_back(i);
+		masks.push_back(classes);
+		batch.push_back(second_order_invariants(segments[i].central_moments));
+	}
+	if (pending.empty() || classes == 0)
+		return;
+	// M3..M6 are zero in the second-order batch, so [0, 2) and [6, 7) are checked separately.
+	classify_shapes(classifier, batch, 0, 2, masks);
+	classify_shapes(classifier, batch, 6, 7, masks);
+
+	std::vector<int>& survivors = buffers.survivors;
+	survivors.clear();
+	batch.clear();
+	for (size_t k = 0; k < pending.size(); k++)
+	{
+		result.second_order[pending[k]] = masks[k];
+		if (masks[k] == 0)
+			continue;
+		survivors.push_back(pending[k]);
+		batch.push_back(hu_moments(segments[pending[k]].central_moments));
+	}
+	result.hu_computed += (long long)survivors.size();
+	masks.clear();
+	for (int i : survivors)
+	{
+		masks.push_back(result.second_order[i]);
+	}
+	classify_shapes(classifier, batch, 2, 6, masks);
+	for (size_t k = 0; k < survivors.size(); k++)
+	{
+		result.full[survivors[k]] = masks[k];
+	}
+}
+
+inline void classify_segments(const ShapeClassifier& classifier, const std::vector<Segment>& segments, ShapeMask classes, SegmentClasses& result, ClassifyBuffers& buffers)
+{
+	reset_segment_classes(result, segments.size());
+	buffers.indices.resize(segments.size());
+	for (size_t i = 0; i < segments.size(); i++)
+	{
+		buffers.indices[i] = (int)i;
+	}
+	classify_segments_at(classifier, segments, buffers.indices, classes, result, buffers);
+}
+
+inline SegmentClasses classify_segments(const ShapeClassifier& classifier, const std::vector<Segment>& segments, ShapeMask classes)
+{
+	SegmentClasses result;
+	ClassifyBuffers buffers;
+	classify_segments(classifier, segments, classes, result, buffers);
+	return result;
+}
+
+#endif
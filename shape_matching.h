@@ -5,348 +5,259 @@
 #include <string>
 #include <map>
 #include <cmath>
-#include <optional>
 
+#include "letter_matching.h"
 #include "logo.h"
+#include "moments.h"
+#include "shape_classifier.h"
+#include "spatial_index.h"
 
-struct CentralMoments
+// Yellow candidates are counted at every stage of the cascade; letters are counted once per
+// yellow candidate that reaches them. hu_computed counts the segments whose seven invariants were
+// computed, each once, which are only those reaching the class tests.
+struct CascadeStats
 {
-	long double mu00;
-	long double mu01;
-	long double mu10;
-	long double mu11;
-	long double mu20;
-	long double mu02;
-	long double mu21;
-	long double mu12;
-	long double mu30;
-	long double mu03;
-};
+	long long yellow_candidates = 0;
+	long long rejected_aspect_ratio = 0;
+	long long rejected_fill_ratio = 0;
+	long long rejected_containment = 0;
+	long long rejected_second_order = 0;
+	long long rejected_hu = 0;
+	long long letter_candidates = 0;
+	long long letters_rejected_second_order = 0;
+	long long letters_rejected_hu = 0;
+	long long hu_computed = 0;
+	long long logos = 0;
 
-struct ScaleInvariants
-{
-	long double eta11;
-	long double eta20;
-	long double eta02;
-	long double eta21;
-	long double eta12;
-	long double eta30;
-	long double eta03;
+	void add(const CascadeStats& other)
+	{
+		yellow_candidates += other.yellow_candidates;
+		rejected_aspect_ratio += other.rejected_aspect_ratio;
+		rejected_fill_ratio += other.rejected_fill_ratio;
+		rejected_containment += other.rejected_containment;
+		rejected_second_order += other.rejected_second_order;
+		rejected_hu += other.rejected_hu;
+		letter_candidates += other.letter_candidates;
+		letters_rejected_second_order += other.letters_rejected_second_order;
+		letters_rejected_hu += other.letters_rejected_hu;
+		hu_computed += other.hu_computed;
+		logos += other.logos;
+	}
 };
 
-struct RotationInvariants
-{
-	long double M1;
-	long double M2;
-	long double M3;
-	long double M4;
-	long double M5;
-	long double M6;
-	long double M7;
-};
+// Loose bounds for the yellow disc around the letters: a circle fills pi / 4 of its box and the
+// letters cut out of it take roughly a fifth of that.
+const double yellow_min_aspect_ratio = 0.5;
+const double yellow_max_aspect_ratio = 2.0;
+const double yellow_min_fill_ratio = 0.3;
+const double yellow_max_fill_ratio = 0.95;
+const int logo_blue_letters = 3;
 
-long double m(int i, int j, std::vector<std::pair<int, int>> pixels)
+// Fills letters with the segments of indices [begin, end) that passed at least one class, with
+// their full class masks.
+inline void collect_letters(const SegmentClasses& classes, const std::vector<int>& indices, size_t begin, size_t end, std::vector<LetterCandidate>& letters, CascadeStats& stats)
 {
-	long double result = 0;
-	for (int k = 0; k < pixels.size(); k++)
+	letters.clear();
+	for (size_t k = begin; k < end; k++)
 	{
-		long double x = (long double)pixels[k].second;
-		long double y = (long double)pixels[k].first;
-		result = result + (long double)(std::pow(x, i) * std::pow(y, j));
-
+		int index = indices[k];
+		stats.letter_candidates++;
+		if (classes.second_order[index] == 0)
+		{
+			stats.letters_rejected_second_order++;
+			continue;
+		}
+		if (classes.full[index] == 0)
+		{
+			stats.letters_rejected_hu++;
+			continue;
+		}
+		letters.push_back(LetterCandidate{ index, classes.full[index] });
 	}
-	return result;
 }
 
-CentralMoments mu_table(std::vector<std::pair<int, int>> pixels)
+// Copies the letters of match into logo, typed after their roles, reusing its segments.
+inline void assign_logo_letters(const std::vector<Segment>& blue_segments, const std::vector<Segment>& red_segments, const LetterMatch& match, Logo& logo, std::vector<Segment>& spare)
 {
-	CentralMoments moments;
-	long double m_00 = m(0, 0, pixels);
-	long double m_10 = m(1, 0, pixels);
-	long double m_01 = m(0, 1, pixels);
-	long double m_11 = m(1, 1, pixels);
-	long double m_20 = m(2, 0, pixels);
-	long double m_02 = m(0, 2, pixels);
-	long double m_21 = m(2, 1, pixels);
-	long double m_12 = m(1, 2, pixels);
-	long double m_30 = m(3, 0, pixels);
-	long double m_03 = m(0, 3, pixels);
-	long double x_ = m_10 / m_00;
-	long double y_ = m_01 / m_00;
-	moments.mu00 = m_00;
-	moments.mu01 = 0.0;
-	moments.mu10 = 0.0;
-	moments.mu11 = m_11 - x_ * m_01;
-	moments.mu20 = m_20 - x_ * m_10;
-	moments.mu02 = m_02 - y_ * m_01;
-	moments.mu21 = m_21 - 2.0 * x_ * m_11 - y_ * m_20 + 2.0 * x_ * x_ * m_01;
-	moments.mu12 = m_12 - 2.0 * y_ * m_11 - x_ * m_02 + 2.0 * y_ * y_ * m_10;
-	moments.mu30 = m_30 - 3.0 * x_ * m_20 + 2.0 * x_ * x_ * m_10;
-	moments.mu03 = m_03 - 3.0 * y_ * m_02 + 2.0 * y_ * y_ * m_01;
-	return moments;
-}
-
-long double calculate_eta(int i, int j, long double mu_ij, long double mu_00)
-{
-	long double power = (((long double)i + (long double)j + 2.0) / 2.0);
-	long double eta = mu_ij / (std::pow(mu_00, power));
-	return eta;
-}
-
-ScaleInvariants eta_table(std::vector<std::pair<int, int>> pixels)
-{
-	CentralMoments moments = mu_table(pixels);
-	ScaleInvariants eta_table;
-	eta_table.eta11 = calculate_eta(1, 1, moments.mu11, moments.mu00);
-	eta_table.eta20 = calculate_eta(2, 0, moments.mu20, moments.mu00);
-	eta_table.eta02 = calculate_eta(0, 2, moments.mu02, moments.mu00);
-	eta_table.eta21 = calculate_eta(2, 1, moments.mu21, moments.mu00);
-	eta_table.eta12 = calculate_eta(1, 2, moments.mu12, moments.mu00);
-	eta_table.eta30 = calculate_eta(3, 0, moments.mu30, moments.mu00);
-	eta_table.eta03 = calculate_eta(0, 3, moments.mu03, moments.mu00);
-	return eta_table;
+	resize_reusing(logo.blue_segments, 3, spare);
+	logo.blue_segments[0] = blue_segments[match.first_l];
+	logo.blue_segments[0].type = Letter_L;
+	logo.blue_segments[1] = blue_segments[match.d];
+	logo.blue_segments[1].type = Letter_D;
+	logo.blue_segments[2] = blue_segments[match.second_l];
+	logo.blue_segments[2].type = Letter_L;
+	if (match.dot < 0)
+	{
+		resize_reusing(logo.red_segments, 1, spare);
+		logo.red_segments[0] = red_segments[match.i];
+		logo.red_segments[0].type = Letter_I_With_Dot;
+		return;
+	}
+	resize_reusing(logo.red_segments, 2, spare);
+	logo.red_segments[0] = red_segments[match.dot];
+	logo.red_segments[0].type = Red_Dot;
+	logo.red_segments[1] = red_segments[match.i];
+	logo.red_segments[1].type = Letter_I;
 }
 
-RotationInvariants hu_moments(std::vector<std::pair<int, int>> pixels)
+// A yellow segment that passed the box tests, with the ranges of LogoBuffers::blue_inside and
+// red_inside holding the segments inside it.
+struct LogoCandidate
 {
-	std::vector<long double> hu(7, 0.0);
-	ScaleInvariants e = eta_table(pixels);
-	RotationInvariants i;
-
-	i.M1 = e.eta20 + e.eta02;
-	i.M2 = std::pow((e.eta20 - e.eta02), 2) + 4.0 * std::pow(e.eta11, 2);
-	i.M3 = std::pow((e.eta30 - 3.0 * e.eta12), 2) + std::pow((3.0 * e.eta21 - e.eta03), 2);
-	i.M4 = std::pow((e.eta30 + e.eta12), 2) + std::pow((e.eta21 + e.eta03), 2);
-	i.M5 = (e.eta30 - 3.0 * e.eta12) * (e.eta30 + e.eta12) * (std::pow((e.eta30 + e.eta12), 2) - 3.0 * std::pow((e.eta21 + e.eta03), 2)) + (3.0 * e.eta21 - e.eta03) * (e.eta21 + e.eta03) * (3.0 * std::pow((e.eta30 + e.eta12), 2) - std::pow((e.eta21 + e.eta03), 2));
-	i.M6 = (e.eta20 - e.eta02) * (std::pow((e.eta30 + e.eta12), 2) - std::pow((e.eta21 + e.eta03), 2)) + 4.0 * e.eta11 * (e.eta30 + e.eta12) * (e.eta21 + e.eta03);
-	i.M7 = e.eta20 * e.eta02 - e.eta11 * e.eta11;
-
-	return i;
-}
+	int yellow;
+	size_t blue_begin;
+	size_t blue_end;
+	size_t red_begin;
+	size_t red_end;
+};
 
-bool is_letter_l(RotationInvariants r)
+// Classes, grids and spare elements of build_logos, kept from one frame to the next.
+struct LogoBuffers
 {
-	if (r.M1 < 0.232904 * 0.7 || r.M1 > 0.452047 * 1.2)
-		return false;
-	if (r.M2 < 0.001229 * 0.7 || r.M2 > 0.23478 * 1.2)
-		return false;
-	if (r.M3 < 0.002978 * 0.7 || r.M3 > 0.01445 * 1.2)
-		return false;
-	if (r.M4 < 0.000188 * 0.7 || r.M4 > 0.006359 * 1.2)
-		return false;
-	if (r.M5 < -0.000001 * 1.3 || r.M5 > 0.00006 * 1.2)
-		return false;
-	if (r.M6 < -0.000068 * 1.3 || r.M6 > 0.002069 * 1.2)
-		return false;
-	if (r.M7 < 0.011456 * 0.7 || r.M7 > 0.0165816 * 1.2)
-		return false;
-	return true;
-}
+	SegmentClasses yellow;
+	SegmentClasses blue;
+	SegmentClasses red;
+	ClassifyBuffers classify;
+	SegmentGrid blue_grid;
+	SegmentGrid red_grid;
+	std::vector<int> inside;
+	std::vector<LogoCandidate> candidates;
+	std::vector<int> blue_inside;
+	std::vector<int> red_inside;
+	std::vector<int> to_classify;
+	std::vector<LetterCandidate> blue_letters;
+	std::vector<LetterCandidate> red_letters;
+	LetterMatchBuffers letters;
+	std::vector<Segment> spare_segments;
+	std::vector<Logo> spare_logos;
+};
 
-bool is_letter_d(RotationInvariants r)
+// The tests of a yellow candidate that need no invariants: bounding box aspect ratio, fill ratio
+// and at least three blue segments inside, whose indices are left in buffers.inside.
+inline bool passes_yellow_box_tests(const Segment& yellow_segment, const std::vector<Segment>& blue_segments, LogoBuffers& buffers, CascadeStats& stats)
 {
-	if (r.M1 < 0.197702 * 0.8 || r.M1 > 0.237674 * 1.2)
-		return false;
-	if (r.M2 < 0.00011 * 0.7 || r.M2 > 0.02854 * 1.2)
-		return false;
-	if (r.M3 < 0.00028 * 0.8 || r.M3 > 0.0011 * 1.2)
-		return false;
-	if (r.M4 < -0.000001 * 1.2 || r.M4 > 0.00035 * 1.2)
-		return false;
-	if (r.M5 < -0.000001 * 1.2 || r.M5 > 0.003797 * 1.2)
+	stats.yellow_candidates++;
+	double aspect_ratio = (double)yellow_segment.get_width() / yellow_segment.get_height();
+	if (aspect_ratio < yellow_min_aspect_ratio || aspect_ratio > yellow_max_aspect_ratio)
+	{
+		stats.rejected_aspect_ratio++;
 		return false;
-	if (r.M6 < -0.000001 * 1.2 || r.M6 > 0.000064 * 1.2)
+	}
+	double fill_ratio = yellow_segment.central_moments.mu00 / ((double)yellow_segment.get_width() * yellow_segment.get_height());
+	if (fill_ratio < yellow_min_fill_ratio || fill_ratio > yellow_max_fill_ratio)
+	{
+		stats.rejected_fill_ratio++;
 		return false;
-	if (r.M7 < 0.0089269 * 0.7 || r.M7 > 0.0109863 * 1.2)
+	}
+	std::vector<int>& inside = buffers.inside;
+	query_segments_inside(buffers.blue_grid, blue_segments, yellow_segment, inside);
+	if ((int)inside.size() < logo_blue_letters)
+	{
+		stats.rejected_containment++;
 		return false;
+	}
 	return true;
 }
 
-bool is_letter_i(RotationInvariants r)
+// The rest of the cascade for a candidate past passes_yellow_box_tests: its class masks, which
+// classify_segments_at computed from the second-order invariants first and all seven only where
+// those passed. The letters inside that passed a class go to match_logo_letters as indices, and
+// only the matched ones are copied, into logo, which is only a complete Logo when true is returned.
+inline bool build_logo(const LogoCandidate& candidate, const std::vector<Segment>& yellow_segments, const std::vector<Segment>& blue_segments, const std::vector<Segment>& red_segments, const ShapeClassifier& classifier, LogoBuffers& buffers, Logo& logo, CascadeStats& stats)
 {
-	if (r.M1 < 0.166381 * 0.8 || r.M1 > 0.19249 * 1.2)
-		return false;
-	if (r.M2 < 0.000004 * 0.8 || r.M2 > 0.0085 * 1.2)
-		return false;
-	if (r.M3 < 0.00001 * 0.8 || r.M3 > 0.000852 * 1.2)
-		return false;
-	if (r.M4 < -0.000001 * 1.2 || r.M4 >  0.000075 * 1.2)
-		return false;
-	if (r.M5 < -0.000001 * 1.2 || r.M5 > 0.000001 * 1.2)
-		return false;
-	if (r.M6 < -0.000007 * 1.2 || r.M6 >  0.0000013 * 1.2)
+	if (buffers.yellow.second_order[candidate.yellow] == 0)
+	{
+		stats.rejected_second_order++;
 		return false;
-	if (r.M7 < 0.00805614 * 0.8 || r.M7 >  0.00962518 * 1.2)
+	}
+	if (buffers.yellow.full[candidate.yellow] == 0)
+	{
+		stats.rejected_hu++;
 		return false;
-	return true;
-}
+	}
 
-bool is_yellow_circle(RotationInvariants r)
-{
-	if (r.M1 < 0.210226 * 0.8 || r.M1 > 0.252874 * 1.2)
-		return false;
-	if (r.M2 < 0.00012 * 0.8 || r.M2 >  0.021667 * 1.2)
-		return false;
-	if (r.M3 < -0.000001 * 1.2 || r.M3 > 0.000058 * 1.2)
-		return false;
-	if (r.M4 < -0.000001 * 1.2 || r.M4 > 0.000018 * 1.2)
-		return false;
-	if (r.M5 < -0.000001 * 1.2 || r.M5 > 0.000001 * 1.2)
-		return false;
-	if (r.M6 < -0.000001 * 1.2 || r.M6 > 0.000001 * 1.2)
-		return false;
-	if (r.M7 < 0.00891144 * 0.8 || r.M7 > 0.0102189 * 1.2)
-		return false;
-	return true;
-}
+	collect_letters(buffers.blue, buffers.blue_inside, candidate.blue_begin, candidate.blue_end, buffers.blue_letters, stats);
+	collect_letters(buffers.red, buffers.red_inside, candidate.red_begin, candidate.red_end, buffers.red_letters, stats);
 
-bool is_red_dot(RotationInvariants r)
-{
-	if (r.M1 < 0.159161 * 0.8 || r.M1 > 0.195348 * 1.2)
-		return false;
-	if (r.M2 < -0.000001 * 1.2 || r.M2 > 0.013819 * 1.2)
-		return false;
-	if (r.M3 < -0.000001 * 1.2 || r.M3 > 0.000105 * 1.2)
-		return false;
-	if (r.M4 < -0.000001 * 1.2 || r.M4 >  0.00001 * 1.2)
-		return false;
-	if (r.M5 < -0.000001 * 1.2 || r.M5 > 0.000001 * 1.2)
-		return false;
-	if (r.M6 < -0.000001 * 1.2 || r.M6 > 0.000001 * 1.2)
-		return false;
-	if (r.M7 < 0.0062891 * 0.8 || r.M7 > 0.00634452 * 1.2)
-		return false;
+	LetterMatch match;
+	if (!match_logo_letters(blue_segments, red_segments, buffers.blue_letters, buffers.red_letters, classifier, buffers.letters, match))
+		return false;
+	assign_logo_letters(blue_segments, red_segments, match, logo, buffers.spare_segments);
+	stats.logos++;
+	const Segment& yellow_segment = yellow_segments[candidate.yellow];
+	logo.row_min = yellow_segment.row_min;
+	logo.row_max = yellow_segment.row_max;
+	logo.col_min = yellow_segment.col_min;
+	logo.col_max = yellow_segment.col_max;
+	logo.yellow_segment = yellow_segment;
 	return true;
 }
 
-bool is_i_with_dot(RotationInvariants r)
-{
-	if (r.M1 < 0.2564 * 0.8 || r.M1 > 0.46 * 1.2)
-		return false;
-	if (r.M2 < 0.0214 * 0.8 || r.M2 > 0.1525 * 1.2)
-		return false;
-	if (r.M3 < 0.00379 * 0.8 || r.M3 > 0.02201 * 1.2)
-		return false;
-	if (r.M4 < 0.00081339 * 0.8 || r.M4 >  0.01332 * 1.2)
-		return false;
-	if (r.M5 < 0.00000134 * 0.8 || r.M5 > 0.0002276 * 1.2)
-		return false;
-	if (r.M6 < 0.0001176 * 0.8 || r.M6 > 0.005164 * 1.2)
-		return false;
-	if (r.M7 < 0.011 * 0.8 || r.M7 > 0.0153 * 1.2)
-		return false;
-	return true;
-}
-bool is_correct_logo(std::vector<Segment> blue_segments, std::vector<Segment> red_segments) 
+// Logos into logos, whose elements are reused, as are those parked in buffers.spare_logos.
+// Only the yellow segments past the box tests are classified, and only the letters inside those
+// whose class masks passed; each segment in one batch per colour and at most once.
+inline void build_logos(const std::vector<Segment>& yellow_segments, const std::vector<Segment>& blue_segments, const std::vector<Segment>& red_segments, std::vector<Logo>& logos, LogoBuffers& buffers, CascadeStats* stats = nullptr, const ShapeClassifier& classifier = logo_shape_classifier())
 {
-	int min_y = std::min(std::min(blue_segments[0].row_min, blue_segments[1].row_min), blue_segments[2].row_min);
-	int max_y = std::max(std::max(blue_segments[0].row_min, blue_segments[1].row_min), blue_segments[2].row_min);
-	if (max_y - min_y > 30)
-		return false;
-	return (
-		blue_segments.size() == 3 && red_segments.size() == 2 &&
-		blue_segments[0].type == Letter_L &&
-		blue_segments[1].type == Letter_D &&
-		blue_segments[2].type == Letter_L &&
-		red_segments[0].type == Red_Dot &&
-		red_segments[1].type == Letter_I &&
-		blue_segments[0].col_max <= blue_segments[1].col_min &&
-		blue_segments[1].col_max <= blue_segments[2].col_min &&
-		red_segments[0].col_min >= red_segments[1].col_min &&
-		red_segments[0].col_max <= red_segments[1].col_max &&
-		red_segments[1].col_min >= blue_segments[0].col_max &&
-		red_segments[1].col_min <= blue_segments[1].col_min) ||
-		(
-			blue_segments.size() == 3 && red_segments.size() == 1 &&
-			blue_segments[0].type == Letter_L &&
-			blue_segments[1].type == Letter_D &&
-			blue_segments[2].type == Letter_L &&
-			red_segments[0].type == Letter_I_With_Dot &&
-			blue_segments[0].col_max <= blue_segments[1].col_min &&
-			blue_segments[1].col_max <= blue_segments[2].col_min &&
-			red_segments[0].col_min >= blue_segments[0].col_max &&
-			red_segments[0].col_min <= blue_segments[1].col_min
-		);
-}
+	ShapeMask yellow_classes = classifier.mask_of(Yellow_Circle);
+	ShapeMask blue_classes = classifier.mask_of(Letter_L) | classifier.mask_of(Letter_D);
+	ShapeMask red_classes = classifier.mask_of(Red_Dot) | classifier.mask_of(Letter_I) | classifier.mask_of(Letter_I_With_Dot);
+	build_segment_grid(blue_segments, buffers.blue_grid);
+	build_segment_grid(red_segments, buffers.red_grid);
+	reset_segment_classes(buffers.yellow, yellow_segments.size());
+	reset_segment_classes(buffers.blue, blue_segments.size());
+	reset_segment_classes(buffers.red, red_segments.size());
+	CascadeStats local_stats;
 
-std::optional<Logo> build_logo(Segment yellow_segment, std::vector<Segment> blue_segments, std::vector<Segment> red_segments)
-{
-	std::vector<Segment> matched_blue_segments;
-	std::vector<Segment> matched_red_segments;
-	bool yellow_circle = false;
-	if (is_yellow_circle(hu_moments(yellow_segment.pixel_coordinates)))
+	std::vector<LogoCandidate>& candidates = buffers.candidates;
+	std::vector<int>& to_classify = buffers.to_classify;
+	candidates.clear();
+	to_classify.clear();
+	buffers.blue_inside.clear();
+	buffers.red_inside.clear();
+	for (size_t i = 0; i < yellow_segments.size(); i++)
 	{
-		yellow_circle = true;
-		for (auto& blue_segment : blue_segments)
-		{
-			if (yellow_segment.contains(blue_segment))
-			{
-				RotationInvariants invariants = hu_moments(blue_segment.pixel_coordinates);
-				if (is_letter_l(invariants))
-				{
-					blue_segment.type = Letter_L;
-					matched_blue_segments.push_back(blue_segment);
-				}
-				if (is_letter_d(invariants))
-				{
-					blue_segment.type = Letter_D;
-					matched_blue_segments.push_back(blue_segment);
-				}
-
-			}
-		}
-
-		for (auto& red_segment : red_segments)
-		{
-			if (yellow_segment.contains(red_segment))
-			{
-				RotationInvariants invariants = hu_moments(red_segment.pixel_coordinates);
-				if (is_red_dot(invariants))
-				{
-					red_segment.type = Red_Dot;
-					matched_red_segments.push_back(red_segment);
-				}
-				if (is_letter_i(invariants))
-				{
-					red_segment.type = Letter_I;
-					matched_red_segments.push_back(red_segment);
-				}
-				if (is_i_with_dot(invariants))
-				{
-					red_segment.type = Letter_I_With_Dot;
-					matched_red_segments.push_back(red_segment);
-				}
+		if (!passes_yellow_box_tests(yellow_segments[i], blue_segments, buffers, local_stats))
+			continue;
+		LogoCandidate candidate = { (int)i, buffers.blue_inside.size(), 0, 0, 0 };
+		buffers.blue_inside.insert(buffers.blue_inside.end(), buffers.inside.begin(), buffers.inside.end());
+		candidate.blue_end = buffers.blue_inside.size();
+		candidates.push_back(candidate);
+		to_classify.push_back((int)i);
+	}
+	classify_segments_at(classifier, yellow_segments, to_classify, yellow_classes, buffers.yellow, buffers.classify);
 
-			}
-		}
+	to_classify.clear();
+	for (auto& candidate : candidates)
+	{
+		candidate.red_begin = candidate.red_end = buffers.red_inside.size();
+		if (buffers.yellow.full[candidate.yellow] == 0)
+			continue;
+		to_classify.insert(to_classify.end(), buffers.blue_inside.begin() + candidate.blue_begin, buffers.blue_inside.begin() + candidate.blue_end);
+		query_segments_inside(buffers.red_grid, red_segments, yellow_segments[candidate.yellow], buffers.inside);
+		buffers.red_inside.insert(buffers.red_inside.end(), buffers.inside.begin(), buffers.inside.end());
+		candidate.red_end = buffers.red_inside.size();
 	}
+	classify_segments_at(classifier, blue_segments, to_classify, blue_classes, buffers.blue, buffers.classify);
+	classify_segments_at(classifier, red_segments, buffers.red_inside, red_classes, buffers.red, buffers.classify);
+	local_stats.hu_computed = buffers.yellow.hu_computed + buffers.blue.hu_computed + buffers.red.hu_computed;
 
-	if (yellow_circle && is_correct_logo(matched_blue_segments, matched_red_segments))
+	size_t count = 0;
+	for (const auto& candidate : candidates)
 	{
-		return Logo{
-			yellow_segment.row_min,
-			yellow_segment.row_max,
-			yellow_segment.col_min,
-			yellow_segment.col_max,
-			yellow_segment,
-			matched_blue_segments,
-			matched_red_segments
-		};
+		resize_reusing(logos, count + 1, buffers.spare_logos);
+		if (build_logo(candidate, yellow_segments, blue_segments, red_segments, classifier, buffers, logos[count], local_stats))
+			count++;
 	}
-	return std::nullopt;
+	resize_reusing(logos, count, buffers.spare_logos);
+	if (stats)
+		stats->add(local_stats);
 }
 
-std::vector<Logo> build_logos(std::vector<Segment> yellow_segments, std::vector<Segment> blue_segments, std::vector<Segment> red_segments)
+inline std::vector<Logo> build_logos(const std::vector<Segment>& yellow_segments, const std::vector<Segment>& blue_segments, const std::vector<Segment>& red_segments, CascadeStats* stats = nullptr, const ShapeClassifier& classifier = logo_shape_classifier())
 {
 	std::vector<Logo> logos;
-	for (const auto& yellow_segment : yellow_segments)
-	{
-		auto logo = build_logo(yellow_segment, blue_segments, red_segments);
-		if (logo)
-		{
-			logos.push_back(*logo);
-		}
-	}
+	LogoBuffers buffers;
+	build_logos(yellow_segments, blue_segments, red_segments, logos, buffers, stats, classifier);
 	return logos;
 }
 
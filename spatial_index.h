@@ -0,0 +1,109 @@
+#ifndef SPATIAL_INDEX_H
+#define SPATIAL_INDEX_H
+
+#include <algorithm>
+#include <vector>
+
+#include "segments.h"
+
+// Uniform grid over segment bounding boxes. A segment inside a box has its top-left corner
+// inside that box too, so each segment is filed once, under the cell of its corner, and
+// a containment query only visits the cells the box overlaps. Cells are stored as one
+// index array with per-cell offsets. cell_of and cell_fill are scratch space of
+// build_segment_grid, kept so that rebuilding a grid reuses them.
+struct SegmentGrid
+{
+	int cell_size = 64;
+	int origin_row = 0;
+	int origin_col = 0;
+	int grid_rows = 0;
+	int grid_cols = 0;
+	std::vector<int> cell_begin;
+	std::vector<int> indices;
+	std::vector<int> cell_of;
+	std::vector<int> cell_fill;
+};
+
+inline void build_segment_grid(const std::vector<Segment>& segments, SegmentGrid& grid, int cell_size = 64)
+{
+	grid.cell_size = cell_size;
+	grid.origin_row = 0;
+	grid.origin_col = 0;
+	grid.grid_rows = 0;
+	grid.grid_cols = 0;
+	grid.cell_begin.clear();
+	grid.indices.clear();
+	if (segments.empty())
+		return;
+
+	int row_max = segments[0].row_min;
+	int col_max = segments[0].col_min;
+	grid.origin_row = segments[0].row_min;
+	grid.origin_col = segments[0].col_min;
+	for (const auto& segment : segments)
+	{
+		grid.origin_row = std::min(grid.origin_row, segment.row_min);
+		grid.origin_col = std::min(grid.origin_col, segment.col_min);
+		row_max = std::max(row_max, segment.row_min);
+		col_max = std::max(col_max, segment.col_min);
+	}
+	grid.grid_rows = (row_max - grid.origin_row) / cell_size + 1;
+	grid.grid_cols = (col_max - grid.origin_col) / cell_size + 1;
+
+	std::vector<int>& cell_of = grid.cell_of;
+	cell_of.resize(segments.size());
+	grid.cell_begin.assign((size_t)grid.grid_rows * grid.grid_cols + 1, 0);
+	for (size_t k = 0; k < segments.size(); k++)
+	{
+		int cell = (segments[k].row_min - grid.origin_row) / cell_size * grid.grid_cols + (segments[k].col_min - grid.origin_col) / cell_size;
+		cell_of[k] = cell;
+		grid.cell_begin[cell + 1]++;
+	}
+	for (size_t c = 1; c < grid.cell_begin.size(); c++)
+	{
+		grid.cell_begin[c] += grid.cell_begin[c - 1];
+	}
+	grid.indices.resize(segments.size());
+	std::vector<int>& fill = grid.cell_fill;
+	fill.assign(grid.cell_begin.begin(), grid.cell_begin.end() - 1);
+	for (size_t k = 0; k < segments.size(); k++)
+	{
+		grid.indices[fill[cell_of[k]]++] = (int)k;
+	}
+}
+
+inline SegmentGrid build_segment_grid(const std::vector<Segment>& segments, int cell_size = 64)
+{
+	SegmentGrid grid;
+	build_segment_grid(segments, grid, cell_size);
+	return grid;
+}
+
+// Indices, in ascending order, of the segments that box.contains().
+inline void query_segments_inside(const SegmentGrid& grid, const std::vector<Segment>& segments, const Segment& box, std::vector<int>& result)
+{
+	result.clear();
+	if (grid.indices.empty())
+		return;
+	int first_row = std::max(0, (box.row_min + 1 - grid.origin_row) / grid.cell_size);
+	int first_col = std::max(0, (box.col_min + 1 - grid.origin_col) / grid.cell_size);
+	int last_row = std::min(grid.grid_rows - 1, (box.row_max - 1 - grid.origin_row) / grid.cell_size);
+	int last_col = std::min(grid.grid_cols - 1, (box.col_max - 1 - grid.origin_col) / grid.cell_size);
+	if (box.row_max - 1 < grid.origin_row || box.col_max - 1 < grid.origin_col)
+		return;
+	for (int r = first_row; r <= last_row; r++)
+	{
+		for (int c = first_col; c <= last_col; c++)
+		{
+			int cell = r * grid.grid_cols + c;
+			for (int i = grid.cell_begin[cell]; i < grid.cell_begin[cell + 1]; i++)
+			{
+				if (box.contains(segments[grid.indices[i]]))
+					result.push_back(grid.indices[i]);
+			}
+		}
+	}
+	std::sort(result.begin(), result.end());
+}
+
+#endif
@@ -0,0 +1,337 @@
+#ifndef STATIC_PIPELINE_H
+#define STATIC_PIPELINE_H
+
+#include <algorithm>
+#include <cstdint>
+#include <vector>
+#include <opencv2/core/core.hpp>
+
+#include "color_bands.h"
+#include "color_lut.h"
+#include "detection.h"
+#include "hsv_conversion.h"
+#include "logo.h"
+#include "mask.h"
+#include "segments.h"
+#include "shape_matching.h"
+#include "thread_pool.h"
+#include "tiling.h"
+
+// A pipeline configuration fixed at compile time. The bounds of the color bands, the dilation
+// window and the segment size limits are template arguments, so the kernels below are generated
+// for one configuration: range tests against constant bounds, with the ones a bound of 0 or 255
+// makes redundant left out, and a dilation with its window unrolled. detect_logos_static gives
+// the same logos as detect_logos with the equivalent runtime arguments, which stay the path for
+// any other configuration.
+
+// Inclusive HSV box with the semantics of HsvRange: HueLow > HueHigh wraps around the hue circle.
+template <int HueLow, int SaturationLow, int ValueLow, int HueHigh, int SaturationHigh, int ValueHigh>
+struct StaticHsvRange
+{
+	static HsvRange range()
+	{
+		return { cv::Vec3b(HueLow, SaturationLow, ValueLow), cv::Vec3b(HueHigh, SaturationHigh, ValueHigh) };
+	}
+
+	static bool contains(int h, int s, int v)
+	{
+		bool in_hue = HueLow > HueHigh ? (h >= HueLow || h <= HueHigh) : (h >= HueLow && h <= HueHigh);
+		return in_hue && s >= SaturationLow && s <= SaturationHigh && v >= ValueLow && v <= ValueHigh;
+	}
+
+#ifdef HSV_CONVERSION_X86
+	// 0xff in the bytes of the pixels inside the range.
+	template <int Low, int High, bool Wraps = false>
+	HSV_TARGET("sse4.1") static __m128i channel_mask(__m128i x)
+	{
+		const __m128i all = _mm_set1_epi8(-1);
+		__m128i above = all;
+		__m128i below = all;
+		if constexpr (Low > 0)
+			above = _mm_cmpeq_epi8(_mm_max_epu8(x, _mm_set1_epi8((char)Low)), x);
+		if constexpr (High < 255)
+			below = _mm_cmpeq_epi8(_mm_min_epu8(x, _mm_set1_epi8((char)High)), x);
+		return Wraps ? _mm_or_si128(above, below) : _mm_and_si128(above, below);
+	}
+
+	HSV_TARGET("sse4.1") static __m128i mask(__m128i h, __m128i s, __m128i v)
+	{
+		return _mm_and_si128(_mm_and_si128(channel_mask<HueLow, HueHigh, (HueLow > HueHigh)>(h), channel_mask<SaturationLow, SaturationHigh>(s)),
+			channel_mask<ValueLow, ValueHigh>(v));
+	}
+#endif
+};
+
+template <typename... Ranges>
+struct StaticBand
+{
+	static std::vector<HsvRange> ranges()
+	{
+		return { Ranges::range()... };
+	}
+
+	static bool contains(int h, int s, int v)
+	{
+		return (Ranges::contains(h, s, v) || ...);
+	}
+
+#ifdef HSV_CONVERSION_X86
+	HSV_TARGET("sse4.1") static __m128i mask(__m128i h, __m128i s, __m128i v)
+	{
+		__m128i result = _mm_setzero_si128();
+		((result = _mm_or_si128(result, Ranges::mask(h, s, v))), ...);
+		return result;
+	}
+#endif
+};
+
+template <int MinHeight, int MinWidth, int MaxHeight, int MaxWidth>
+struct StaticSegmentLimits
+{
+	static constexpr SegmentLimits limits{ MinHeight, MinWidth, MaxHeight, MaxWidth };
+};
+
+// The configuration main runs with: logo_color_bands(), DetectionLimits() and a single 3 x 3
+// dilation.
+struct LogoPipeline
+{
+	typedef StaticBand<StaticHsvRange<80, 40, 30, 130, 255, 225>> Blue;
+	typedef StaticBand<StaticHsvRange<0, 50, 100, 15, 255, 255>, StaticHsvRange<160, 50, 50, 179, 255, 255>> Red;
+	typedef StaticBand<StaticHsvRange<20, 100, 100, 30, 255, 255>> Yellow;
+	typedef StaticSegmentLimits<7, 5, 150, 150> BlueLimits;
+	typedef StaticSegmentLimits<5, 5, 150, 150> RedLimits;
+	typedef StaticSegmentLimits<15, 30, 500, 500> YellowLimits;
+	static constexpr int dilation_size = 3;
+	static constexpr int dilation_iterations = 1;
+};
+
+template <typename Pipeline>
+inline std::vector<ColorBand> static_pipeline_bands()
+{
+	return {
+			{ "blue", Pipeline::Blue::ranges() },
+			{ "red", Pipeline::Red::ranges() },
+			{ "yellow", Pipeline::Yellow::ranges() }
+	};
+}
+
+inline bool same_segment_limits(const SegmentLimits& a, const SegmentLimits& b)
+{
+	return a.min_height == b.min_height && a.min_width == b.min_width && a.max_height == b.max_height && a.max_width == b.max_width;
+}
+
+// Whether detect_logos with these runtime arguments is what Pipeline was generated for.
+template <typename Pipeline>
+inline bool matches_static_pipeline(const std::vector<ColorBand>& bands, const DetectionLimits& limits)
+{
+	return same_bands(bands, static_pipeline_bands<Pipeline>())
+		&& same_segment_limits(limits.blue, Pipeline::BlueLimits::limits)
+		&& same_segment_limits(limits.red, Pipeline::RedLimits::limits)
+		&& same_segment_limits(limits.yellow, Pipeline::YellowLimits::limits)
+		&& limits.dilation_size == Pipeline::dilation_size
+		&& limits.dilation_iterations == Pipeline::dilation_iterations;
+}
+
+// Blue, red and yellow bits of pixels [begin, width) of a row, converted one at a time, into the
+// words holding them.
+template <typename Pipeline>
+inline void classify_static_pixels(const uchar* bgr, int begin, int width, uint64_t* blue, uint64_t* red, uint64_t* yellow)
+{
+	for (int j = begin; j < width; j++)
+	{
+		uchar hsv[3];
+		pixel_bgr2hsv_integer(bgr + 3 * j, hsv);
+		uint64_t bit = uint64_t(1) << (j & 63);
+		if (Pipeline::Blue::contains(hsv[0], hsv[1], hsv[2]))
+			blue[j >> 6] |= bit;
+		if (Pipeline::Red::contains(hsv[0], hsv[1], hsv[2]))
+			red[j >> 6] |= bit;
+		if (Pipeline::Yellow::contains(hsv[0], hsv[1], hsv[2]))
+			yellow[j >> 6] |= bit;
+	}
+}
+
+#ifdef HSV_CONVERSION_X86
+// Range tests of 16 pixels straight into bits [offset, offset + 16) of the band words.
+template <typename Pipeline>
+HSV_TARGET("sse4.1") inline void static_band_bits(__m128i h, __m128i s, __m128i v, int offset, uint64_t* words)
+{
+	words[0] |= (uint64_t)(uint16_t)_mm_movemask_epi8(Pipeline::Blue::mask(h, s, v)) << offset;
+	words[1] |= (uint64_t)(uint16_t)_mm_movemask_epi8(Pipeline::Red::mask(h, s, v)) << offset;
+	words[2] |= (uint64_t)(uint16_t)_mm_movemask_epi8(Pipeline::Yellow::mask(h, s, v)) << offset;
+}
+
+// BGR to HSV to mask words in registers, 64 pixels per word; the HSV row and the per-pixel range
+// bits of classify_color_band_rows never exist.
+template <typename Pipeline>
+HSV_TARGET("sse4.1") inline void classify_static_row_sse41(const uchar* bgr, int width, uint64_t* blue, uint64_t* red, uint64_t* yellow)
+{
+	const __m128i zero = _mm_setzero_si128();
+	int j = 0;
+	for (; j + 64 <= width; j += 64)
+	{
+		uint64_t words[3] = { 0, 0, 0 };
+		for (int k = 0; k < 64; k += 16)
+		{
+			__m128i b, g, r;
+			hsv_deinterleave_sse41(bgr + 3 * (j + k), b, g, r);
+			__m128i h_lo, s_lo, h_hi, s_hi;
+			hsv_core_sse41(_mm_unpacklo_epi8(b, zero), _mm_unpacklo_epi8(g, zero), _mm_unpacklo_epi8(r, zero), h_lo, s_lo);
+			hsv_core_sse41(_mm_unpackhi_epi8(b, zero), _mm_unpackhi_epi8(g, zero), _mm_unpackhi_epi8(r, zero), h_hi, s_hi);
+			__m128i v = _mm_max_epu8(_mm_max_epu8(r, g), b);
+			static_band_bits<Pipeline>(_mm_packus_epi16(h_lo, h_hi), _mm_packus_epi16(s_lo, s_hi), v, k, words);
+		}
+		blue[j >> 6] = words[0];
+		red[j >> 6] = words[1];
+		yellow[j >> 6] = words[2];
+	}
+	classify_static_pixels<Pipeline>(bgr, j, width, blue, red, yellow);
+}
+
+template <typename Pipeline>
+HSV_TARGET("avx2") inline void classify_static_row_avx2(const uchar* bgr, int width, uint64_t* blue, uint64_t* red, uint64_t* yellow)
+{
+	int j = 0;
+	for (; j + 64 <= width; j += 64)
+	{
+		uint64_t words[3] = { 0, 0, 0 };
+		for (int k = 0; k < 64; k += 16)
+		{
+			__m128i b, g, r;
+			hsv_deinterleave_sse41(bgr + 3 * (j + k), b, g, r);
+			__m256i h16, s16;
+			hsv_core_avx2(_mm256_cvtepu8_epi16(b), _mm256_cvtepu8_epi16(g), _mm256_cvtepu8_epi16(r), h16, s16);
+			__m128i h = _mm_packus_epi16(_mm256_castsi256_si128(h16), _mm256_extracti128_si256(h16, 1));
+			__m128i s = _mm_packus_epi16(_mm256_castsi256_si128(s16), _mm256_extracti128_si256(s16, 1));
+			__m128i v = _mm_max_epu8(_mm_max_epu8(r, g), b);
+			static_band_bits<Pipeline>(h, s, v, k, words);
+		}
+		blue[j >> 6] = words[0];
+		red[j >> 6] = words[1];
+		yellow[j >> 6] = words[2];
+	}
+	classify_static_pixels<Pipeline>(bgr, j, width, blue, red, yellow);
+}
+#endif
+
+// Rows [row_begin, row_end) of the blue, red and yellow Mask_Bits masks, which start out zeroed.
+template <typename Pipeline>
+inline void classify_static_rows(const cv::Mat& image, int row_begin, int row_end, BinaryMask& blue, BinaryMask& red, BinaryMask& yellow, HsvConversionMethod method)
+{
+	for (int i = row_begin; i < row_end; i++)
+	{
+		const uchar* bgr = image.ptr<uchar>(i);
+		switch (method)
+		{
+#ifdef HSV_CONVERSION_X86
+		case Hsv_Avx2:
+			classify_static_row_avx2<Pipeline>(bgr, image.cols, blue.word_row(i), red.word_row(i), yellow.word_row(i));
+			break;
+		case Hsv_Sse41:
+			classify_static_row_sse41<Pipeline>(bgr, image.cols, blue.word_row(i), red.word_row(i), yellow.word_row(i));
+			break;
+#endif
+		default:
+			classify_static_pixels<Pipeline>(bgr, 0, image.cols, blue.word_row(i), red.word_row(i), yellow.word_row(i));
+			break;
+		}
+	}
+}
+
+// Horizontal part of a dilation by Radius: the OR of the bits up to Radius columns on either side.
+template <int Radius>
+inline uint64_t dilate_word(uint64_t previous, uint64_t word, uint64_t next)
+{
+	uint64_t result = word;
+	for (int s = 1; s <= Radius; s++)
+	{
+		result |= (word << s) | (previous >> (64 - s)) | (word >> s) | (next << (64 - s));
+	}
+	return result;
+}
+
+// dilation_filter with an odd window of 2 * Radius + 1 and Border as in extremum_filter_rows on
+// rows [row_begin, row_end) of dst. Rows are ORed first and the row sum dilated once, which is
+// the same since both steps are ORs.
+template <int Radius, int Border>
+inline void dilate_static_rows(const BinaryMask& src, BinaryMask& dst, int row_begin, int row_end, std::vector<uint64_t>& vertical)
+{
+	static_assert(Radius >= 1 && Radius < 64 && Border >= 0, "unsupported dilation window");
+	int words = src.words_per_row;
+	vertical.assign(words + 2, 0);
+	for (int x = row_begin; x < row_end; x++)
+	{
+		uint64_t* out = dst.word_row(x);
+		if (x < Border || x >= src.rows - Border || src.rows <= 2 * Border || src.cols <= 2 * Border)
+		{
+			std::fill(out, out + words, 0);
+			continue;
+		}
+		uint64_t* sum = vertical.data() + 1;
+		std::fill(sum, sum + words, 0);
+		for (int y = std::max(0, x - Radius); y <= std::min(src.rows - 1, x + Radius); y++)
+		{
+			const uint64_t* row = src.word_row(y);
+			for (int w = 0; w < words; w++)
+				sum[w] |= row[w];
+		}
+		for (int w = 0; w < words; w++)
+		{
+			out[w] = dilate_word<Radius>(sum[w - 1], sum[w], sum[w + 1]);
+		}
+		out[words - 1] &= src.tail_mask();
+		for (int y = 0; y < Border; y++)
+		{
+			dst.set(x, y, false);
+			dst.set(x, src.cols - 1 - y, false);
+		}
+	}
+}
+
+// detect_logos for the configuration of Pipeline, with the shape classes still read from
+// classifier. Blue, red and yellow end up in buffers.color_bands.masks[0..2]. method picks the
+// row kernel, all of which give the same masks; tests/static_pipeline.cpp checks them.
+template <typename Pipeline>
+inline const std::vector<Logo>& detect_logos_static(const cv::Mat& image, ThreadPool& pool, FrameBuffers& buffers, CascadeStats* stats = nullptr, const ShapeClassifier& classifier = logo_shape_classifier(), HsvConversionMethod method = best_hsv_conversion_method())
+{
+	static_assert(Pipeline::dilation_size % 2 == 1 && Pipeline::dilation_iterations >= 1, "even dilation windows take the runtime path");
+	constexpr int radius = Pipeline::dilation_iterations * (Pipeline::dilation_size / 2);
+	constexpr int border = Pipeline::dilation_size / 2;
+	CV_Assert(image.type() == CV_8UC3);
+
+	ColorBandBuffers& color_bands = buffers.color_bands;
+	grow_to(color_bands.masks, 3);
+	for (int b = 0; b < 3; b++)
+		color_bands.masks[b].create(image.rows, image.cols, Mask_Bits);
+	BinaryMask& blue = color_bands.masks[0];
+	BinaryMask& red = color_bands.masks[1];
+	BinaryMask& yellow = color_bands.masks[2];
+	split_row_tiles(image.rows, 3 * (size_t)image.cols, pool.size(), color_bands.tiles);
+	pool.parallel_for((int)color_bands.tiles.size(), [&](int t)
+	{
+		classify_static_rows<Pipeline>(image, color_bands.tiles[t].row_begin, color_bands.tiles[t].row_end, blue, red, yellow, method);
+	});
+
+	buffers.dilated_yellow.create(image.rows, image.cols, Mask_Bits);
+	FilterBuffers& filter = buffers.filter;
+	split_row_tiles(image.rows, 8 * (size_t)yellow.words_per_row, pool.size(), filter.tiles, 4 * (2 * radius + 1));
+	grow_to(filter.tile_buffers, filter.tiles.size());
+	pool.parallel_for((int)filter.tiles.size(), [&](int t)
+	{
+		dilate_static_rows<radius, border>(yellow, buffers.dilated_yellow, filter.tiles[t].row_begin, filter.tiles[t].row_end, filter.tile_buffers[t].line);
+	});
+
+	segment_mask(blue, pool, buffers, buffers.blue_segments, buffers.blue_segment_buffers);
+	filter_segments_in_place(buffers.blue_segments, Pipeline::BlueLimits::limits, buffers.blue_segment_buffers.spare);
+	std::sort(buffers.blue_segments.begin(), buffers.blue_segments.end(), compare_segments_by_x);
+	segment_mask(red, pool, buffers, buffers.red_segments, buffers.red_segment_buffers);
+	filter_segments_in_place(buffers.red_segments, Pipeline::RedLimits::limits, buffers.red_segment_buffers.spare);
+	std::sort(buffers.red_segments.begin(), buffers.red_segments.end(), compare_segments_by_y);
+	segment_mask(buffers.dilated_yellow, pool, buffers, buffers.yellow_segments, buffers.yellow_segment_buffers);
+	filter_segments_in_place(buffers.yellow_segments, Pipeline::YellowLimits::limits, buffers.yellow_segment_buffers.spare);
+
+	build_logos(buffers.yellow_segments, buffers.blue_segments, buffers.red_segments, buffers.logos, buffers.logo_buffers, stats, classifier);
+	return buffers.logos;
+}
+
+#endif
@@ -0,0 +1,479 @@
+#ifndef STREAMING_H
+#define STREAMING_H
+
+#include <algorithm>
+#include <cctype>
+#include <climits>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <functional>
+#include <string>
+#include <vector>
+#include <opencv2/core/core.hpp>
+#include <opencv2/highgui/highgui.hpp>
+
+#include "batch.h"
+#include "color_lut.h"
+#include "detection.h"
+#include "detections_output.h"
+#include "logo.h"
+#include "segments.h"
+#include "shape_matching.h"
+#include "thread_pool.h"
+#include "tiling.h"
+#include "timing.h"
+
+// Rows of an image handed out top to bottom. Binary PPM files (P6, maxval 255) are read from
+// disk as the rows are asked for; other formats go through cv::imread and are held decoded in
+// full, since OpenCV cannot decode them in parts.
+struct StripSource
+{
+	int rows = 0;
+	int cols = 0;
+	int next_row = 0;
+	std::ifstream file;
+	cv::Mat image;
+	std::vector<uchar> rgb;
+
+	bool open(const std::string& path)
+	{
+		next_row = 0;
+		image = cv::Mat();
+		file.open(path, std::ios::binary);
+		std::string magic;
+		int max_value = 0;
+		if (file >> magic && magic == "P6" && read_header_value(cols) && read_header_value(rows) && read_header_value(max_value)
+			&& max_value == 255 && rows > 0 && cols > 0)
+		{
+			file.get();
+			rgb.resize(3 * (size_t)cols);
+			return true;
+		}
+		file.close();
+		image = cv::imread(path);
+		rows = image.rows;
+		cols = image.cols;
+		return !image.empty();
+	}
+
+	// False when open fell back to decoding the whole image.
+	bool streaming() const
+	{
+		return file.is_open();
+	}
+
+	// The next count rows into rows [dst_row, dst_row + count) of the CV_8UC3 dst, as BGR.
+	bool read_rows(cv::Mat& dst, int dst_row, int count)
+	{
+		for (int i = 0; i < count; i++, next_row++)
+		{
+			uchar* out = dst.ptr<uchar>(dst_row + i);
+			if (!file.is_open())
+			{
+				std::memcpy(out, image.ptr<uchar>(next_row), 3 * (size_t)cols);
+				continue;
+			}
+			if (!file.read((char*)rgb.data(), (std::streamsize)rgb.size()))
+				return false;
+			for (int j = 0; j < cols; j++)
+			{
+				out[3 * j] = rgb[3 * j + 2];
+				out[3 * j + 1] = rgb[3 * j + 1];
+				out[3 * j + 2] = rgb[3 * j];
+			}
+		}
+		return true;
+	}
+
+private:
+	// A decimal header field, after whitespace and # comments.
+	bool read_header_value(int& value)
+	{
+		while (file && (std::isspace(file.peek()) || file.peek() == '#'))
+		{
+			if (file.get() == '#')
+			{
+				std::string comment;
+				std::getline(file, comment);
+			}
+		}
+		return (bool)(file >> value);
+	}
+};
+
+// A component of a StreamLabeler still open after the last row. Merged components point to the
+// one that took them over through parent.
+struct OpenComponent
+{
+	int parent = 0;
+	bool open = false;
+	bool too_large = false;
+	int row_min = 0;
+	int row_max = 0;
+	int col_min = 0;
+	int col_max = 0;
+	RawMoments moments;
+	std::vector<SegmentRun> runs;
+};
+
+// Run-based labeling with 4-connectivity, as label_runs, fed one mask row at a time. A component
+// is closed by the first row without runs of it and comes out as the Segment segment_mask would
+// give for the whole image, if it passes limits. A component exceeding the maximum size drops
+// its runs, so what is kept is bounded by the components open in one row and the size limits.
+struct StreamLabeler
+{
+	SegmentLimits limits;
+	int next_row = 0;
+	std::vector<OpenComponent> components;
+	std::vector<int> free_components;
+	std::vector<int> merged;
+	std::vector<LabelRun> previous;
+	std::vector<LabelRun> current;
+
+	explicit StreamLabeler(const SegmentLimits& segment_limits)
+		: limits(segment_limits)
+	{
+	}
+
+	int find(int c)
+	{
+		while (components[c].parent != c)
+		{
+			components[c].parent = components[components[c].parent].parent;
+			c = components[c].parent;
+		}
+		return c;
+	}
+
+	int create(int row, int col_begin, int col_end)
+	{
+		if (free_components.empty())
+		{
+			free_components.push_back((int)components.size());
+			components.emplace_back();
+		}
+		int c = free_components.back();
+		free_components.pop_back();
+		OpenComponent& component = components[c];
+		component.parent = c;
+		component.open = true;
+		component.too_large = false;
+		component.row_min = row;
+		component.row_max = row;
+		component.col_min = col_begin;
+		component.col_max = col_end - 1;
+		component.moments = RawMoments();
+		component.runs.clear();
+		return c;
+	}
+
+	void check_size(OpenComponent& component)
+	{
+		if (component.too_large)
+			return;
+		if (component.row_max - component.row_min + 1 > limits.max_height || component.col_max - component.col_min + 1 > limits.max_width)
+		{
+			component.too_large = true;
+			std::vector<SegmentRun>().swap(component.runs);
+		}
+	}
+
+	void add_run(int c, int row, int col_begin, int col_end)
+	{
+		OpenComponent& component = components[c];
+		component.row_max = row;
+		component.col_min = std::min(component.col_min, col_begin);
+		component.col_max = std::max(component.col_max, col_end - 1);
+		component.moments.add_run(row, col_begin, col_end);
+		if (!component.too_large)
+			component.runs.push_back(SegmentRun{ row, col_begin, col_end });
+		check_size(component);
+	}
+
+	// Component b taken over by a; both are roots.
+	int merge(int a, int b)
+	{
+		OpenComponent& into = components[a];
+		OpenComponent& from = components[b];
+		into.row_min = std::min(into.row_min, from.row_min);
+		into.row_max = std::max(into.row_max, from.row_max);
+		into.col_min = std::min(into.col_min, from.col_min);
+		into.col_max = std::max(into.col_max, from.col_max);
+		into.moments.add(from.moments);
+		into.too_large = into.too_large || from.too_large;
+		if (into.too_large)
+			std::vector<SegmentRun>().swap(into.runs);
+		else
+			into.runs.insert(into.runs.end(), from.runs.begin(), from.runs.end());
+		check_size(into);
+		from.runs.clear();
+		from.parent = a;
+		merged.push_back(b);
+		return a;
+	}
+
+	void close(int c, std::vector<Segment>& closed)
+	{
+		OpenComponent& component = components[c];
+		component.open = false;
+		free_components.push_back(c);
+		int height = component.row_max - component.row_min + 1;
+		int width = component.col_max - component.col_min + 1;
+		if (component.too_large || height < limits.min_height || width < limits.min_width)
+			return;
+		// Merged components leave their runs out of raster order.
+		std::sort(component.runs.begin(), component.runs.end(), [](const SegmentRun& a, const SegmentRun& b)
+		{
+			return a.row < b.row || (a.row == b.row && a.col_begin < b.col_begin);
+		});
+		closed.emplace_back();
+		Segment& segment = closed.back();
+		segment.row_min = component.row_min;
+		segment.row_max = component.row_max;
+		segment.col_min = component.col_min;
+		segment.col_max = component.col_max;
+		segment.runs = component.runs;
+		segment.type = Undefined;
+		segment.central_moments = mu_table(component.moments);
+	}
+
+	// Labels row mask_row of mask as the next image row; the components it closes are appended to
+	// closed.
+	void add_row(const BinaryMask& mask, int mask_row, std::vector<Segment>& closed)
+	{
+		int row = next_row++;
+		current.clear();
+		size_t p = 0;
+		for (int start = next_set_column(mask, mask_row, 0); start < mask.cols; )
+		{
+			int end = next_clear_column(mask, mask_row, start);
+			while (p < previous.size() && previous[p].col_end <= start)
+			{
+				p++;
+			}
+			int label = -1;
+			for (size_t q = p; q < previous.size() && previous[q].col_begin < end; q++)
+			{
+				int other = find(previous[q].label);
+				if (label < 0)
+					label = other;
+				else if (other != label)
+					label = merge(label, other);
+			}
+			if (label < 0)
+				label = create(row, start, end);
+			add_run(label, row, start, end);
+			current.push_back(LabelRun{ row, start, end, label });
+			start = next_set_column(mask, mask_row, end);
+		}
+		for (auto& run : current)
+		{
+			run.label = find(run.label);
+		}
+		for (const auto& run : previous)
+		{
+			int c = find(run.label);
+			if (components[c].open && components[c].row_max < row)
+				close(c, closed);
+		}
+		free_components.insert(free_components.end(), merged.begin(), merged.end());
+		merged.clear();
+		previous.swap(current);
+	}
+
+	// Closes what is still open after the last row.
+	void finish(std::vector<Segment>& closed)
+	{
+		for (const auto& run : previous)
+		{
+			int c = find(run.label);
+			if (components[c].open)
+				close(c, closed);
+		}
+		previous.clear();
+	}
+
+	// Smallest first row of the open components that may still become segments, INT_MAX if none.
+	int open_row_min() const
+	{
+		int row_min = INT_MAX;
+		for (const auto& run : previous)
+		{
+			const OpenComponent& component = components[run.label];
+			if (!component.too_large)
+				row_min = std::min(row_min, component.row_min);
+		}
+		return row_min;
+	}
+};
+
+struct StreamingOptions
+{
+	int strip_rows = 256;
+	DetectionLimits limits;
+	ShapeClassifier classifier = logo_shape_classifier();
+	const BgrLut* lut = nullptr;
+};
+
+struct StreamingReport
+{
+	int rows = 0;
+	int cols = 0;
+	int strips = 0;
+	int logos = 0;
+	size_t window_bytes = 0;
+	size_t peak_pending_segments = 0;
+	// Set when the image ended before its last row.
+	bool truncated = false;
+	CascadeStats cascade;
+};
+
+// detect_logos on an image read strip by strip. Each strip is classified together with the rows
+// of halo the dilation needs on both sides, and its rows are labeled by one StreamLabeler per
+// color, which carries the open runs and moment sums into the next strip. Once a yellow segment
+// is closed, the blue and red segments closed by then are all it can contain, so its logo is
+// built and handed to found right away. Letters are dropped as soon as no open yellow component
+// starts above them. The pixels held at any time are strip_rows plus the halo times the width,
+// whatever the height of the image; the logos are the ones detect_logos finds, which
+// tests/streaming.cpp checks for several strip heights.
+inline StreamingReport detect_logos_streaming(StripSource& source, const std::vector<ColorBand>& bands, ThreadPool& pool, const StreamingOptions& options, const std::function<void(const Logo&)>& found)
+{
+	StreamingReport report;
+	report.rows = source.rows;
+	report.cols = source.cols;
+	const DetectionLimits& limits = options.limits;
+	int halo = std::max(1, limits.dilation_size * std::max(1, limits.dilation_iterations));
+	int strip_rows = std::max(1, options.strip_rows);
+	int blue_index = band_index(bands, "blue");
+	int red_index = band_index(bands, "red");
+	int yellow_index = band_index(bands, "yellow");
+
+	cv::Mat buffer(std::min(source.rows, strip_rows + 2 * halo), source.cols, CV_8UC3);
+	report.window_bytes = buffer.total() * buffer.elemSize();
+	ColorBandBuffers color_bands;
+	FilterBuffers filter;
+	BinaryMask dilated_yellow;
+	StreamLabeler labelers[3] = { StreamLabeler(limits.blue), StreamLabeler(limits.red), StreamLabeler(limits.yellow) };
+	std::vector<Segment> closed[3];
+	std::vector<Segment> blue_segments;
+	std::vector<Segment> red_segments;
+	LogoBuffers logo_buffers;
+	std::vector<Logo> logos;
+
+	int window_begin = 0;
+	int window_end = 0;
+	for (int strip_begin = 0; strip_begin < source.rows; strip_begin += strip_rows)
+	{
+		int strip_end = std::min(source.rows, strip_begin + strip_rows);
+		int begin = std::max(0, strip_begin - halo);
+		int end = std::min(source.rows, strip_end + halo);
+		int kept = std::max(0, window_end - begin);
+		for (int i = 0; i < kept; i++)
+		{
+			std::memmove(buffer.ptr<uchar>(i), buffer.ptr<uchar>(begin - window_begin + i), 3 * (size_t)source.cols);
+		}
+		if (!source.read_rows(buffer, kept, end - begin - kept))
+		{
+			report.truncated = true;
+			break;
+		}
+		window_begin = begin;
+		window_end = end;
+		report.strips++;
+
+		cv::Mat window = buffer(cv::Rect(0, 0, source.cols, end - begin));
+		classify_color_bands(window, bands, pool, color_bands, Mask_Bits, best_hsv_conversion_method(), options.lut);
+		const std::vector<BinaryMask>& masks = color_bands.masks;
+		dilation_filter(masks[yellow_index], limits.dilation_size, limits.dilation_iterations, pool, dilated_yellow, filter);
+		const BinaryMask* labeled[3] = { &masks[blue_index], &masks[red_index], &dilated_yellow };
+		pool.parallel_for(3, [&](int color)
+		{
+			for (int row = strip_begin; row < strip_end; row++)
+			{
+				labelers[color].add_row(*labeled[color], row - begin, closed[color]);
+			}
+			if (strip_end == source.rows)
+				labelers[color].finish(closed[color]);
+		});
+
+		blue_segments.insert(blue_segments.end(), closed[0].begin(), closed[0].end());
+		red_segments.insert(red_segments.end(), closed[1].begin(), closed[1].end());
+		std::sort(blue_segments.begin(), blue_segments.end(), compare_segments_by_x);
+		std::sort(red_segments.begin(), red_segments.end(), compare_segments_by_y);
+		report.peak_pending_segments = std::max(report.peak_pending_segments, blue_segments.size() + red_segments.size());
+		if (!closed[2].empty())
+		{
+			build_logos(closed[2], blue_segments, red_segments, logos, logo_buffers, &report.cascade, options.classifier);
+			for (const auto& logo : logos)
+				found(logo);
+			report.logos += (int)logos.size();
+		}
+		for (auto& segments : closed)
+			segments.clear();
+
+		// A yellow segment contains a letter only if it starts on an earlier row.
+		int first_open_row = std::min(labelers[2].open_row_min(), strip_end);
+		auto unreachable = [&](const Segment& segment) { return segment.row_min <= first_open_row; };
+		blue_segments.erase(std::remove_if(blue_segments.begin(), blue_segments.end(), unreachable), blue_segments.end());
+		red_segments.erase(std::remove_if(red_segments.begin(), red_segments.end(), unreachable), red_segments.end());
+	}
+	return report;
+}
+
+// run_batch for images too large to decode whole: every image is streamed in strips of
+// strip_rows with all threads, one after the other. Only the logo boxes are written, as
+// detections.csv with Output_Csv and detections.json otherwise. The decode stage is the time
+// StripSource::open takes, which for a PPM only reads the header; the strips are read during
+// the detect stage. Images that are not 8-bit binary PPM are decoded whole, with a warning, since
+// their memory is then not bounded by the strip height.
+inline BatchReport run_streaming_batch(const BatchOptions& options, int strip_rows)
+{
+	BatchReport report;
+	std::vector<std::string> files = collect_batch_inputs(options.inputs);
+	ThreadPool pool(std::max(1, options.threads));
+	std::vector<ColorBand> bands = logo_color_bands();
+	StreamingOptions streaming;
+	streaming.strip_rows = strip_rows;
+	streaming.classifier = options.classifier;
+	streaming.lut = options.lut.get();
+	std::vector<ImageDetections> detections;
+	auto start = Clock::now();
+	for (const auto& path : files)
+	{
+		report.images++;
+		auto image_start = Clock::now();
+		StripSource source;
+		if (!source.open(path))
+		{
+			fprintf(stderr, "%s: cannot read image\n", path.c_str());
+			report.failed++;
+			continue;
+		}
+		auto detect_start = Clock::now();
+		if (!source.streaming())
+			fprintf(stderr, "%s: not an 8-bit binary PPM, decoded whole instead of in strips of %d rows\n", path.c_str(), strip_rows);
+		ImageDetections image{ path, {} };
+		StreamingReport streamed = detect_logos_streaming(source, bands, pool, streaming, [&](const Logo& logo) { image.boxes.push_back(logo_box(logo)); });
+		if (streamed.truncated)
+		{
+			fprintf(stderr, "%s: image ends before row %d\n", path.c_str(), source.rows);
+			report.failed++;
+		}
+		report.logos += streamed.logos;
+		report.cascade.add(streamed.cascade);
+		auto image_end = Clock::now();
+		report.stage_ms[Stage_Decode].push_back(elapsed_ms(image_start, detect_start));
+		report.stage_ms[Stage_Detect].push_back(elapsed_ms(detect_start, image_end));
+		report.stage_ms[Stage_Total].push_back(elapsed_ms(image_start, image_end));
+		detections.push_back(image);
+	}
+	report.seconds = elapsed_ms(start, Clock::now()) / 1000;
+
+	OutputFormat format = options.output_format == Output_Csv ? Output_Csv : Output_Json;
+	if (!write_detections_file(options.output_dir, format, detections))
+		report.output_failed = true;
+	return report;
+}
+
+#endif
@@ -0,0 +1,129 @@
+#ifndef SYNTHETIC_IMAGE_H
+#define SYNTHETIC_IMAGE_H
+
+#include <algorithm>
+#include <cmath>
+#include <random>
+#include <opencv2/core/core.hpp>
+
+// Images with logos at known places, for the benchmark and the tests.
+
+const cv::Vec3b synthetic_yellow(0, 210, 255);
+const cv::Vec3b synthetic_blue(160, 60, 10);
+const cv::Vec3b synthetic_red(30, 20, 220);
+
+inline void put_pixel(cv::Mat& image, int row, int col, cv::Vec3b color)
+{
+	if (row >= 0 && col >= 0 && row < image.rows && col < image.cols)
+		image.at<cv::Vec3b>(row, col) = color;
+}
+
+// Yellow disc of radius 26 centred at (row, col) with the blue L, D, L letters and the red dotted I.
+inline void draw_synthetic_logo(cv::Mat& image, int row, int col)
+{
+	const int radius = 26;
+	for (int i = -radius; i <= radius; i++)
+	{
+		for (int j = -radius; j <= radius; j++)
+		{
+			if (i * i + j * j <= radius * radius)
+				put_pixel(image, row + i, col + j, synthetic_yellow);
+		}
+	}
+
+	int top = row - 10;
+	auto letter_l = [&](int c0)
+	{
+		for (int i = 0; i < 20; i++)
+		{
+			for (int j = 0; j < (i < 16 ? 4 : 8); j++)
+				put_pixel(image, top + i, c0 + j, synthetic_blue);
+		}
+	};
+	auto letter_d = [&](int c0)
+	{
+		const int height = 20, thickness = 6, width = 14;
+		double r = height / 2.0;
+		double inner = r - thickness;
+		for (int i = 0; i < height; i++)
+		{
+			for (int j = 0; j < width; j++)
+			{
+				double y = i - r + 0.5;
+				double x = j - (width - r);
+				bool inside = j < width - r || x * x + y * y <= r * r;
+				bool hole = i >= thickness && i < height - thickness && j >= thickness && (j < width - r || x * x + y * y <= inner * inner);
+				if (inside && !hole)
+					put_pixel(image, top + i, c0 + j, synthetic_blue);
+			}
+		}
+	};
+	auto letter_i = [&](int r0, int c0)
+	{
+		for (int i = 0; i < 8; i++)
+		{
+			int serif = i < 2;
+			for (int j = 0; j < (serif ? 7 : 5); j++)
+				put_pixel(image, r0 + i, c0 + j + (serif ? 0 : 1), synthetic_red);
+		}
+		for (int i = 0; i < 5; i++)
+		{
+			for (int j = 0; j < 5; j++)
+				put_pixel(image, r0 - 7 + i, c0 + 1 + j, synthetic_red);
+		}
+	};
+
+	int c = col - 23;
+	letter_l(c);
+	letter_i(top + 10, c + 12);
+	letter_d(c + 24);
+	letter_l(c + 42);
+}
+
+// Grey noisy background with non-yellow blobs, and one logo in every 512 x 512 cell.
+inline cv::Mat synthetic_image(double megapixels, unsigned int seed)
+{
+	int cols = std::max(128, (int)std::lround(std::sqrt(megapixels * 1e6 * 4 / 3)));
+	int rows = std::max(128, (int)std::lround(megapixels * 1e6 / cols));
+	std::mt19937 random(seed);
+	cv::Mat image(rows, cols, CV_8UC3);
+	for (int i = 0; i < rows; i++)
+	{
+		uchar* row = image.ptr<uchar>(i);
+		for (int j = 0; j < 3 * cols; j++)
+			row[j] = (uchar)(80 + random() % 21);
+	}
+
+	const cv::Vec3b blob_colors[] = { synthetic_blue, synthetic_red, cv::Vec3b(40, 200, 40), cv::Vec3b(200, 200, 200), cv::Vec3b(10, 10, 10) };
+	int blobs = (int)(megapixels * 200);
+	for (int b = 0; b < blobs; b++)
+	{
+		cv::Vec3b color = blob_colors[random() % 5];
+		int cy = random() % rows, cx = random() % cols;
+		int ry = 3 + random() % 40, rx = 3 + random() % 40;
+		for (int i = std::max(0, cy - ry); i < std::min(rows, cy + ry); i++)
+		{
+			for (int j = std::max(0, cx - rx); j < std::min(cols, cx + rx); j++)
+				image.at<cv::Vec3b>(i, j) = color;
+		}
+	}
+
+	// Logos are shifted by up to +-128 px inside their cell so that no two share columns.
+	for (int cell_row = 256; cell_row + 200 < rows; cell_row += 512)
+	{
+		for (int cell_col = 256; cell_col + 200 < cols; cell_col += 512)
+		{
+			int row = cell_row + (int)(random() % 257) - 128;
+			int col = cell_col + (int)(random() % 257) - 128;
+			for (int i = row - 40; i < row + 40; i++)
+			{
+				for (int j = col - 40; j < col + 40; j++)
+					put_pixel(image, i, j, cv::Vec3b(90, 90, 90));
+			}
+			draw_synthetic_logo(image, row, col);
+		}
+	}
+	return image;
+}
+
+#endif
@@ -0,0 +1,72 @@
+#include <cstdio>
+#include <cstring>
+#include <vector>
+
+#include "colors.h"
+
+// Checks every BGR to HSV path against pixel_bgr2hsv, the original floating-point formula, over
+// all 2^24 BGR values: pixel_bgr2hsv_integer and the table path always, the SSE4.1 and AVX2
+// paths where the CPU has them. Each row of 4096 values is converted whole and again from an
+// odd offset with an odd width, so the vector tails are covered too. Exits with 1 on the first
+// path that differs anywhere.
+
+const int row_pixels = 4096;
+
+int main()
+{
+	std::vector<uchar> bgr(3 * row_pixels);
+	std::vector<uchar> expected(3 * row_pixels);
+	std::vector<uchar> hsv(3 * row_pixels);
+	long long mismatches[4] = {};
+	bool tested[4] = {};
+	for (int m = Hsv_Scalar; m <= Hsv_Avx2; m++)
+	{
+		tested[m] = hsv_conversion_supported((HsvConversionMethod)m);
+	}
+
+	for (int row = 0; row < (1 << 24) / row_pixels; row++)
+	{
+		for (int j = 0; j < row_pixels; j++)
+		{
+			int value = row * row_pixels + j;
+			cv::Vec3b pixel(value & 255, (value >> 8) & 255, value >> 16);
+			cv::Vec3b reference = pixel_bgr2hsv(pixel);
+			for (int c = 0; c < 3; c++)
+			{
+				bgr[3 * j + c] = pixel[c];
+				expected[3 * j + c] = reference[c];
+			}
+		}
+
+		for (int j = 0; j < row_pixels; j++)
+		{
+			pixel_bgr2hsv_integer(&bgr[3 * j], &hsv[3 * j]);
+		}
+		mismatches[Hsv_Scalar] += memcmp(hsv.data(), expected.data(), hsv.size()) != 0;
+
+		for (int m = Hsv_Table; m <= Hsv_Avx2; m++)
+		{
+			if (!tested[m])
+				continue;
+			bgr2hsv_row(bgr.data(), hsv.data(), row_pixels, (HsvConversionMethod)m);
+			mismatches[m] += memcmp(hsv.data(), expected.data(), hsv.size()) != 0;
+			std::fill(hsv.begin(), hsv.end(), 0);
+			bgr2hsv_row(&bgr[3], &hsv[3], row_pixels - 4, (HsvConversionMethod)m);
+			mismatches[m] += memcmp(&hsv[3], &expected[3], 3 * (row_pixels - 4)) != 0;
+		}
+	}
+
+	static const char* names[4] = { "integer", "table", "sse4.1", "avx2" };
+	int failed = 0;
+	for (int m = Hsv_Scalar; m <= Hsv_Avx2; m++)
+	{
+		if (!tested[m])
+			printf("%s: not supported here, skipped\n", names[m]);
+		else if (mismatches[m] > 0)
+			printf("%s: %lld rows differ from pixel_bgr2hsv\n", names[m], mismatches[m]);
+		else
+			printf("%s: exact\n", names[m]);
+		failed |= mismatches[m] > 0;
+	}
+	return failed;
+}
@@ -0,0 +1,235 @@
+#include <cmath>
+#include <cstdio>
+#include <random>
+#include <string>
+#include <vector>
+#include <opencv2/core/core.hpp>
+#include <opencv2/highgui/highgui.hpp>
+
+#include "color_bands.h"
+#include "contours.h"
+#include "detection.h"
+#include "filters.h"
+#include "moments.h"
+#include "segments.h"
+#include "shape_classifier.h"
+
+// Checks the integer-centralized Hu invariants of moments.h against the long double / std::pow
+// computation they replaced, on every segment of the color masks and of the dilated yellow mask
+// of each image given, and of random blobs: M1, M2 and M7 within 1e-13 relative, M3..M6 within
+// 1e-12 absolute or 1e-9 relative, and no segment in a different set of shape classes. The raw
+// moments contour_moments sums along the traced contours must equal those of the pixels exactly,
+// on the same segments and on masks full of holes and of pixels touching only at a corner, the
+// cases trace_contour handles specially. The legacy computation is not compared on the latter,
+// whose tiny noise segments it gets wrong in the 13th digit. Exits with 1 when any segment
+// differs.
+
+RotationInvariants legacy_hu_moments(const RawMoments& raw)
+{
+	long double m_00 = (long double)raw.m00;
+	long double m_10 = (long double)raw.m10;
+	long double m_01 = (long double)raw.m01;
+	long double x_ = m_10 / m_00;
+	long double y_ = m_01 / m_00;
+	long double mu11 = (long double)raw.m11 - x_ * m_01;
+	long double mu20 = (long double)raw.m20 - x_ * m_10;
+	long double mu02 = (long double)raw.m02 - y_ * m_01;
+	long double mu21 = (long double)raw.m21 - 2.0 * x_ * (long double)raw.m11 - y_ * (long double)raw.m20 + 2.0 * x_ * x_ * m_01;
+	long double mu12 = (long double)raw.m12 - 2.0 * y_ * (long double)raw.m11 - x_ * (long double)raw.m02 + 2.0 * y_ * y_ * m_10;
+	long double mu30 = (long double)raw.m30 - 3.0 * x_ * (long double)raw.m20 + 2.0 * x_ * x_ * m_10;
+	long double mu03 = (long double)raw.m03 - 3.0 * y_ * (long double)raw.m02 + 2.0 * y_ * y_ * m_01;
+	auto eta = [&](int i, int j, long double mu) { return mu / std::pow(m_00, ((long double)i + j + 2.0) / 2.0); };
+	long double eta11 = eta(1, 1, mu11);
+	long double eta20 = eta(2, 0, mu20);
+	long double eta02 = eta(0, 2, mu02);
+	long double eta21 = eta(2, 1, mu21);
+	long double eta12 = eta(1, 2, mu12);
+	long double eta30 = eta(3, 0, mu30);
+	long double eta03 = eta(0, 3, mu03);
+
+	RotationInvariants i;
+	i.M1 = (double)(eta20 + eta02);
+	i.M2 = (double)(std::pow(eta20 - eta02, 2) + 4.0 * std::pow(eta11, 2));
+	i.M3 = (double)(std::pow(eta30 - 3.0 * eta12, 2) + std::pow(3.0 * eta21 - eta03, 2));
+	i.M4 = (double)(std::pow(eta30 + eta12, 2) + std::pow(eta21 + eta03, 2));
+	i.M5 = (double)((eta30 - 3.0 * eta12) * (eta30 + eta12) * (std::pow(eta30 + eta12, 2) - 3.0 * std::pow(eta21 + eta03, 2)) + (3.0 * eta21 - eta03) * (eta21 + eta03) * (3.0 * std::pow(eta30 + eta12, 2) - std::pow(eta21 + eta03, 2)));
+	i.M6 = (double)((eta20 - eta02) * (std::pow(eta30 + eta12, 2) - std::pow(eta21 + eta03, 2)) + 4.0 * eta11 * (eta30 + eta12) * (eta21 + eta03));
+	i.M7 = (double)(eta20 * eta02 - eta11 * eta11);
+	return i;
+}
+
+ShapeMask class_mask(const ShapeClassifier& classifier, const RotationInvariants& r)
+{
+	double values[invariant_count] = { r.M1, r.M2, r.M3, r.M4, r.M5, r.M6, r.M7 };
+	ShapeMask mask = 0;
+	for (int k = 0; k < classifier.size(); k++)
+	{
+		bool inside = true;
+		for (int m = 0; m < invariant_count; m++)
+			inside = inside && values[m] >= classifier.lower[m][k] && values[m] <= classifier.upper[m][k];
+		if (inside)
+			mask |= ShapeMask(1) << k;
+	}
+	return mask;
+}
+
+bool close_relative(double a, double b, double tolerance)
+{
+	return std::fabs(a - b) <= tolerance * std::max(std::fabs(a), std::fabs(b));
+}
+
+bool close_third_order(double a, double b)
+{
+	return std::fabs(a - b) <= 1e-12 || close_relative(a, b, 1e-9);
+}
+
+struct RegressionCount
+{
+	long long segments = 0;
+	long long invariants_differ = 0;
+	long long classes_differ = 0;
+	long long contour_segments = 0;
+	long long contours_differ = 0;
+};
+
+bool same_raw_moments(const RawMoments& a, const RawMoments& b)
+{
+	return a.m00 == b.m00 && a.m10 == b.m10 && a.m01 == b.m01 && a.m11 == b.m11 && a.m20 == b.m20 &&
+		a.m02 == b.m02 && a.m21 == b.m21 && a.m12 == b.m12 && a.m30 == b.m30 && a.m03 == b.m03;
+}
+
+void compare_contours(const BinaryMask& mask, RegressionCount& count)
+{
+	for (const auto& segment : segment_mask(mask))
+	{
+		count.contour_segments++;
+		count.contours_differ += !same_raw_moments(contour_moments(trace_contours(segment)), segment.raw_moments());
+	}
+}
+
+void compare_segments(const BinaryMask& mask, RegressionCount& count)
+{
+	const ShapeClassifier& classifier = logo_shape_classifier();
+	for (const auto& segment : segment_mask(mask))
+	{
+		RotationInvariants current = hu_moments(segment.central_moments);
+		RotationInvariants legacy = legacy_hu_moments(segment.raw_moments());
+		count.segments++;
+		bool same = close_relative(current.M1, legacy.M1, 1e-13) && close_relative(current.M2, legacy.M2, 1e-13) && close_relative(current.M7, legacy.M7, 1e-13) &&
+			close_third_order(current.M3, legacy.M3) && close_third_order(current.M4, legacy.M4) && close_third_order(current.M5, legacy.M5) && close_third_order(current.M6, legacy.M6);
+		count.invariants_differ += !same;
+		count.classes_differ += class_mask(classifier, current) != class_mask(classifier, legacy);
+	}
+	compare_contours(mask, count);
+}
+
+// Filled ellipses, some with an elliptic hole, at random positions in a 1000 x 1000 mask.
+BinaryMask random_blobs(unsigned seed)
+{
+	std::mt19937 random(seed);
+	BinaryMask mask(1000, 1000, Mask_Bits);
+	for (int blob = 0; blob < 300; blob++)
+	{
+		double row = random() % 1000;
+		double col = random() % 1000;
+		double a = 2 + random() % 60;
+		double b = 2 + random() % 60;
+		double hole = random() % 2 ? 0.5 : 0;
+		for (int r = std::max(0, (int)(row - b)); r <= std::min(999, (int)(row + b)); r++)
+		{
+			for (int c = std::max(0, (int)(col - a)); c <= std::min(999, (int)(col + a)); c++)
+			{
+				double d = (c - col) * (c - col) / (a * a) + (r - row) * (r - row) / (b * b);
+				if (d <= 1 && d >= hole * hole)
+					mask.set(r, c, true);
+			}
+		}
+	}
+	return mask;
+}
+
+// Pixels set with probability 0.6, which leaves many holes and many pixels touching only at a
+// corner.
+BinaryMask random_noise(unsigned seed)
+{
+	std::mt19937 random(seed);
+	BinaryMask mask(300, 300, Mask_Bits);
+	for (int r = 0; r < mask.rows; r++)
+	{
+		for (int c = 0; c < mask.cols; c++)
+			mask.set(r, c, random() % 5 < 3);
+	}
+	return mask;
+}
+
+// Shapes drawn for the corner cases of trace_contour, each in its own 40 x 40 cell.
+BinaryMask contour_cases()
+{
+	BinaryMask mask(40, 200, Mask_Bits);
+	auto fill = [&](int row, int col, int height, int width, bool value)
+	{
+		for (int r = row; r < row + height; r++)
+		{
+			for (int c = col; c < col + width; c++)
+				mask.set(r, c, value);
+		}
+	};
+	// 2 x 2 blocks in a checkerboard, touching only at their corners.
+	for (int r = 2; r < 38; r += 2)
+	{
+		for (int c = 2 + r % 4; c < 38; c += 4)
+			fill(r, c, 2, 2, true);
+	}
+	// A square with two holes meeting at a corner, a hole with an island in it and a hole
+	// touching the outside at a corner.
+	fill(2, 42, 30, 30, true);
+	fill(6, 46, 3, 3, false);
+	fill(9, 49, 3, 3, false);
+	fill(15, 55, 7, 7, false);
+	mask.set(18, 58, true);
+	mask.set(2, 42, false);
+	mask.set(3, 43, false);
+	// A ring whose two halves touch only at corners, so it is two segments, around a plus.
+	fill(4, 84, 12, 12, true);
+	fill(5, 85, 10, 10, false);
+	mask.set(4, 90, false);
+	mask.set(5, 90, true);
+	fill(9, 89, 2, 2, true);
+	// A diagonal staircase and a one-pixel-wide frame.
+	for (int k = 0; k < 30; k++)
+		mask.set(5 + k, 125 + k, true);
+	fill(2, 162, 30, 30, true);
+	fill(3, 163, 28, 28, false);
+	return mask;
+}
+
+int main(int argc, char** argv)
+{
+	RegressionCount count;
+	for (unsigned seed = 1; seed <= 4; seed++)
+	{
+		compare_segments(random_blobs(seed), count);
+		compare_contours(random_noise(seed), count);
+	}
+	compare_contours(contour_cases(), count);
+	std::vector<ColorBand> bands = logo_color_bands();
+	for (int a = 1; a < argc; a++)
+	{
+		cv::Mat image = cv::imread(argv[a]);
+		if (image.empty())
+		{
+			fprintf(stderr, "%s: cannot read image\n", argv[a]);
+			return 1;
+		}
+		std::map<std::string, BinaryMask> masks = classify_color_bands(image, bands);
+		for (const auto& band : masks)
+		{
+			compare_segments(band.second, count);
+		}
+		compare_segments(dilation_filter(masks["yellow"], 3, 1), count);
+	}
+	printf("%lld segments of %d images and 4 random masks: %lld with different invariants, %lld in different classes\n",
+		count.segments, argc - 1, count.invariants_differ, count.classes_differ);
+	printf("%lld segments of those and 5 more masks: %lld with different contour moments\n", count.contour_segments, count.contours_differ);
+	return count.invariants_differ + count.classes_differ + count.contours_differ > 0;
+}
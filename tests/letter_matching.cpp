@@ -0,0 +1,321 @@
+#include <algorithm>
+#include <cstdio>
+#include <random>
+#include <vector>
+
+#include "letter_matching.h"
+#include "shape_classifier.h"
+
+// Checks match_logo_letters against a brute-force search over every first L, I, dot, D and
+// second L: whether there is a match, that the D is the leftmost one with a match, that the I is
+// the one starting last before it and that every returned letter plays a role it may take. The
+// same letters in shuffled order must give the same match. Hand-made scenes cover ties in
+// column order, segments in several classes and the dot before and after the I in y order;
+// random ones, on a small grid so ties are frequent, cover the rest. Exits with 1 on the first
+// scene that fails.
+
+// Letters by segment index; a class mask of 0 keeps the segment out of the candidates.
+struct Scene
+{
+	std::vector<Segment> blue_segments;
+	std::vector<Segment> red_segments;
+	std::vector<ShapeMask> blue_classes;
+	std::vector<ShapeMask> red_classes;
+};
+
+const ShapeClassifier& classifier = logo_shape_classifier();
+const ShapeMask l_class = classifier.mask_of(Letter_L);
+const ShapeMask d_class = classifier.mask_of(Letter_D);
+const ShapeMask i_class = classifier.mask_of(Letter_I);
+const ShapeMask dot_class = classifier.mask_of(Red_Dot);
+const ShapeMask i_with_dot_class = classifier.mask_of(Letter_I_With_Dot);
+
+Segment box(int row_min, int col_min, int height, int width)
+{
+	Segment segment = Segment();
+	segment.row_min = row_min;
+	segment.row_max = row_min + height - 1;
+	segment.col_min = col_min;
+	segment.col_max = col_min + width - 1;
+	return segment;
+}
+
+void add_blue(Scene& scene, const Segment& segment, ShapeMask classes)
+{
+	scene.blue_segments.push_back(segment);
+	scene.blue_classes.push_back(classes);
+}
+
+void add_red(Scene& scene, const Segment& segment, ShapeMask classes)
+{
+	scene.red_segments.push_back(segment);
+	scene.red_classes.push_back(classes);
+}
+
+std::vector<LetterCandidate> candidates(const std::vector<ShapeMask>& classes)
+{
+	std::vector<LetterCandidate> letters;
+	for (size_t k = 0; k < classes.size(); k++)
+	{
+		if (classes[k] != 0)
+			letters.push_back(LetterCandidate{ (int)k, classes[k] });
+	}
+	return letters;
+}
+
+bool valid_dot(const Scene& scene, int i, int dot)
+{
+	const Segment& stem = scene.red_segments[i];
+	const Segment& segment = scene.red_segments[dot];
+	return dot != i && (scene.red_classes[dot] & dot_class) && compare_segments_by_y(segment, stem) &&
+		segment.col_min >= stem.col_min && segment.col_max <= stem.col_max;
+}
+
+// Whether red segment i can be the I, with a dot if it needs one.
+bool valid_i(const Scene& scene, int i)
+{
+	if (scene.red_classes[i] & i_with_dot_class)
+		return true;
+	if (!(scene.red_classes[i] & i_class))
+		return false;
+	for (size_t dot = 0; dot < scene.red_segments.size(); dot++)
+	{
+		if (valid_dot(scene, i, (int)dot))
+			return true;
+	}
+	return false;
+}
+
+bool valid_blue_letters(const Scene& scene, int first_l, int d, int second_l, int i)
+{
+	const std::vector<Segment>& blue = scene.blue_segments;
+	if (first_l == d || second_l == d || first_l == second_l)
+		return false;
+	if (!(scene.blue_classes[first_l] & l_class) || !(scene.blue_classes[d] & d_class) || !(scene.blue_classes[second_l] & l_class))
+		return false;
+	const Segment& stem = scene.red_segments[i];
+	if (blue[first_l].col_max > stem.col_min || stem.col_min > blue[d].col_min || blue[d].col_max > blue[second_l].col_min)
+		return false;
+	int top_min = std::min(std::min(blue[first_l].row_min, blue[d].row_min), blue[second_l].row_min);
+	int top_max = std::max(std::max(blue[first_l].row_min, blue[d].row_min), blue[second_l].row_min);
+	return top_max - top_min <= logo_max_letter_row_spread;
+}
+
+bool valid_match(const Scene& scene, const LetterMatch& match)
+{
+	if (!valid_i(scene, match.i) || !valid_blue_letters(scene, match.first_l, match.d, match.second_l, match.i))
+		return false;
+	if (scene.red_classes[match.i] & i_with_dot_class)
+		return match.dot == -1;
+	return match.dot >= 0 && valid_dot(scene, match.i, match.dot);
+}
+
+// The I a D takes: the last start at or before the D, the lowest index among equal starts.
+int expected_i(const Scene& scene, int d)
+{
+	int best = -1;
+	for (size_t i = 0; i < scene.red_segments.size(); i++)
+	{
+		int col = scene.red_segments[i].col_min;
+		if (col > scene.blue_segments[d].col_min || !valid_i(scene, (int)i))
+			continue;
+		if (best < 0 || col > scene.red_segments[best].col_min)
+			best = (int)i;
+	}
+	return best;
+}
+
+// The leftmost D, in compare_segments_by_x order and then by index, with any match, or -1.
+int brute_force_d(const Scene& scene)
+{
+	const std::vector<Segment>& blue = scene.blue_segments;
+	std::vector<int> ds;
+	for (size_t d = 0; d < blue.size(); d++)
+	{
+		if (scene.blue_classes[d] & d_class)
+			ds.push_back((int)d);
+	}
+	std::sort(ds.begin(), ds.end(), [&](int a, int b)
+	{
+		return compare_segments_by_x(blue[a], blue[b]) || (!compare_segments_by_x(blue[b], blue[a]) && a < b);
+	});
+	for (int d : ds)
+	{
+		for (size_t i = 0; i < scene.red_segments.size(); i++)
+		{
+			if (!valid_i(scene, (int)i))
+				continue;
+			for (size_t first = 0; first < blue.size(); first++)
+			{
+				for (size_t second = 0; second < blue.size(); second++)
+				{
+					if (valid_blue_letters(scene, (int)first, d, (int)second, (int)i))
+						return d;
+				}
+			}
+		}
+	}
+	return -1;
+}
+
+bool same_match(const LetterMatch& a, const LetterMatch& b)
+{
+	return a.first_l == b.first_l && a.d == b.d && a.second_l == b.second_l && a.i == b.i && a.dot == b.dot;
+}
+
+LetterMatchBuffers buffers;
+std::mt19937 shuffle_random(7);
+
+// Empty when scene passes, else what went wrong.
+const char* check(const Scene& scene)
+{
+	std::vector<LetterCandidate> blue = candidates(scene.blue_classes);
+	std::vector<LetterCandidate> red = candidates(scene.red_classes);
+	LetterMatch match;
+	bool found = match_logo_letters(scene.blue_segments, scene.red_segments, blue, red, classifier, buffers, match);
+	int d = brute_force_d(scene);
+	if (found != (d >= 0))
+		return found ? "match where brute force finds none" : "no match where brute force finds one";
+	if (!found)
+		return nullptr;
+	if (!valid_match(scene, match))
+		return "invalid match";
+	if (match.d != d)
+		return "not the leftmost D";
+	if (match.i != expected_i(scene, d))
+		return "not the last I before the D";
+	for (int round = 0; round < 3; round++)
+	{
+		std::shuffle(blue.begin(), blue.end(), shuffle_random);
+		std::shuffle(red.begin(), red.end(), shuffle_random);
+		LetterMatch shuffled;
+		if (!match_logo_letters(scene.blue_segments, scene.red_segments, blue, red, classifier, buffers, shuffled) || !same_match(match, shuffled))
+			return "different match for shuffled letters";
+	}
+	return nullptr;
+}
+
+// L, dotted I, D, L as drawn in the logo, starting at column col.
+void add_logo(Scene& scene, int row, int col)
+{
+	add_blue(scene, box(row, col, 20, 8), l_class);
+	add_red(scene, box(row + 3, col + 9, 8, 5), i_class);
+	add_red(scene, box(row - 5, col + 10, 5, 3), dot_class);
+	add_blue(scene, box(row, col + 16, 20, 14), d_class);
+	add_blue(scene, box(row, col + 32, 20, 8), l_class);
+}
+
+// A scene and whether it holds a match.
+struct HandMadeScene
+{
+	Scene scene;
+	bool match;
+};
+
+std::vector<HandMadeScene> hand_made_scenes()
+{
+	std::vector<HandMadeScene> scenes;
+	Scene scene;
+
+	add_logo(scene, 10, 0);
+	scenes.push_back({ scene, true });
+
+	// The dot is not ahead of the I in y order: at the same top but starting right of it, below
+	// it, and at the same top-left corner.
+	scene = Scene();
+	add_blue(scene, box(10, 0, 20, 8), l_class);
+	add_red(scene, box(13, 9, 8, 5), i_class);
+	add_red(scene, box(13, 10, 3, 3), dot_class);
+	add_blue(scene, box(10, 16, 20, 14), d_class);
+	add_blue(scene, box(10, 32, 20, 8), l_class);
+	scenes.push_back({ scene, false });
+	scene.red_segments[1] = box(18, 10, 3, 3);
+	scenes.push_back({ scene, false });
+	scene.red_segments[1] = box(13, 9, 3, 5);
+	scenes.push_back({ scene, false });
+	// One row above the I it is.
+	scene.red_segments[1] = box(12, 10, 3, 3);
+	scenes.push_back({ scene, true });
+
+	// Two Is starting in the same column, and two Ds with the same top-left corner.
+	scene = Scene();
+	add_blue(scene, box(10, 0, 20, 8), l_class);
+	add_red(scene, box(13, 9, 8, 5), i_with_dot_class);
+	add_red(scene, box(12, 9, 8, 5), i_with_dot_class);
+	add_blue(scene, box(10, 16, 12, 10), d_class);
+	add_blue(scene, box(10, 16, 20, 14), d_class);
+	add_blue(scene, box(10, 32, 20, 8), l_class);
+	scenes.push_back({ scene, true });
+
+	// Blue segments that may be an L or a D, of which the middle one is the D, and a red one
+	// that may be an I with or without a dot and needs none.
+	scene = Scene();
+	add_blue(scene, box(10, 0, 20, 8), l_class | d_class);
+	add_red(scene, box(13, 9, 8, 5), i_class | i_with_dot_class);
+	add_blue(scene, box(10, 16, 20, 14), l_class | d_class);
+	add_blue(scene, box(10, 32, 20, 8), l_class | d_class);
+	scenes.push_back({ scene, true });
+	// The I now needs a dot, which may also be an I.
+	scene.red_classes[0] = i_class;
+	scenes.push_back({ scene, false });
+	add_red(scene, box(5, 10, 5, 3), dot_class | i_class);
+	scenes.push_back({ scene, true });
+
+	// Letters that cannot match, an L too far below and an I after the D, left of a logo.
+	scene = Scene();
+	add_blue(scene, box(50, 0, 20, 8), l_class);
+	add_blue(scene, box(10, 10, 20, 14), d_class);
+	add_red(scene, box(13, 30, 8, 5), i_with_dot_class);
+	add_logo(scene, 10, 60);
+	scenes.push_back({ scene, true });
+	return scenes;
+}
+
+Scene random_scene(std::mt19937& random)
+{
+	const ShapeMask blue_masks[] = { 0, l_class, d_class, l_class | d_class };
+	const ShapeMask red_masks[] = { 0, i_class, dot_class, i_with_dot_class, i_class | dot_class, i_class | i_with_dot_class, dot_class | i_with_dot_class };
+	Scene scene;
+	int blue = random() % 8;
+	int red = random() % 7;
+	for (int k = 0; k < blue; k++)
+	{
+		add_blue(scene, box(random() % 50, random() % 48, 2 + random() % 20, 2 + random() % 8), blue_masks[random() % 4]);
+	}
+	for (int k = 0; k < red; k++)
+	{
+		add_red(scene, box(random() % 50, random() % 48, 2 + random() % 10, 2 + random() % 6), red_masks[random() % 7]);
+	}
+	return scene;
+}
+
+int main()
+{
+	std::vector<HandMadeScene> scenes = hand_made_scenes();
+	for (size_t k = 0; k < scenes.size(); k++)
+	{
+		const char* error = check(scenes[k].scene);
+		if (!error && (brute_force_d(scenes[k].scene) >= 0) != scenes[k].match)
+			error = scenes[k].match ? "brute force finds no match" : "brute force finds a match";
+		if (error)
+		{
+			fprintf(stderr, "hand-made scene %d: %s\n", (int)k, error);
+			return 1;
+		}
+	}
+	std::mt19937 random(1);
+	const int random_scenes = 200000;
+	int matches = 0;
+	for (int k = 0; k < random_scenes; k++)
+	{
+		Scene scene = random_scene(random);
+		if (const char* error = check(scene))
+		{
+			fprintf(stderr, "random scene %d: %s\n", k, error);
+			return 1;
+		}
+		matches += brute_force_d(scene) >= 0;
+	}
+	printf("%d hand-made and %d random scenes, %d of them with a match: all agree with brute force\n", (int)scenes.size(), random_scenes, matches);
+	return 0;
+}
@@ -0,0 +1,121 @@
+#include <cmath>
+#include <cstdio>
+#include <random>
+#include <utility>
+#include <vector>
+
+#ifndef LOGO_PORTABLE_MOMENT_SUM
+#define LOGO_PORTABLE_MOMENT_SUM
+#endif
+#include "moments.h"
+
+// Checks Int128, the MomentSum of compilers without __int128, which this file selects everywhere.
+// Where __int128 exists, random products, sums, quotients and conversions are compared with it.
+// Everywhere, a component moved 2^28 pixels away must keep its central moments bit for bit,
+// which only holds while the sums are exact. Exits with 1 when anything differs.
+
+int failures = 0;
+
+void check(bool ok, const char* what)
+{
+	if (!ok)
+	{
+		fprintf(stderr, "%s differs\n", what);
+		failures++;
+	}
+}
+
+#if defined(__SIZEOF_INT128__)
+bool same(const Int128& a, __int128 b)
+{
+	return a.low == (uint64_t)b && a.high == (uint64_t)((unsigned __int128)b >> 64);
+}
+
+Int128 from_native(__int128 value)
+{
+	Int128 result;
+	result.low = (uint64_t)value;
+	result.high = (uint64_t)((unsigned __int128)value >> 64);
+	return result;
+}
+
+// Values of every magnitude up to 2^127, of either sign, and the edge cases.
+__int128 random_native(std::mt19937_64& random)
+{
+	int bits = (int)(random() % 128);
+	unsigned __int128 value = ((unsigned __int128)random() << 64) | random();
+	value = bits == 0 ? 0 : value >> (128 - bits);
+	return random() % 2 ? -(__int128)value : (__int128)value;
+}
+
+void compare_with_native()
+{
+	std::mt19937_64 random(1);
+	const int divisors[] = { 1, 2, 3, 6, -1, -7 };
+	for (int r = 0; r < 1000000; r++)
+	{
+		__int128 a = random_native(random);
+		__int128 b = random_native(random);
+		// The products and sums wrap, as the native ones do; do them unsigned to keep that defined.
+		__int128 sum = (__int128)((unsigned __int128)a + (unsigned __int128)b);
+		__int128 difference = (__int128)((unsigned __int128)a - (unsigned __int128)b);
+		__int128 product = (__int128)((unsigned __int128)a * (unsigned __int128)b);
+		Int128 x = from_native(a);
+		Int128 y = from_native(b);
+		int divisor = divisors[r % 6];
+		check(same(x + y, sum), "sum");
+		check(same(x - y, difference), "difference");
+		check(same(x * y, product), "product");
+		check(same(-x, -a), "negation");
+		check(same(x / divisor, a / divisor), "quotient");
+		check((x < y) == (a < b) && (x == y) == (a == b), "comparison");
+		check((double)x == (double)a, "conversion to double");
+		check((long double)x == (long double)a, "conversion to long double");
+		long long small = (long long)random();
+		check(same(Int128(small), small), "conversion from long long");
+	}
+}
+#endif
+
+// A blob with holes, its pixels shifted by (offset, offset).
+std::vector<std::pair<int, int>> blob(int offset)
+{
+	std::vector<std::pair<int, int>> pixels;
+	for (int i = 0; i < 40; i++)
+	{
+		for (int j = 0; j < 60; j++)
+		{
+			if ((i * 7 + j * 3) % 11 != 0 && i * i + j < 1500)
+				pixels.push_back({ offset + i, offset + j });
+		}
+	}
+	return pixels;
+}
+
+bool same_central(const CentralMoments& a, const CentralMoments& b)
+{
+	return a.mu00 == b.mu00 && a.mu11 == b.mu11 && a.mu20 == b.mu20 && a.mu02 == b.mu02 && a.mu21 == b.mu21 &&
+		a.mu12 == b.mu12 && a.mu30 == b.mu30 && a.mu03 == b.mu03;
+}
+
+int main()
+{
+	check(-Int128(1) < 0 && Int128(-5) / 2 == -2 && Int128(7) / -2 == -3, "small values");
+	Int128 big = 1;
+	for (int i = 0; i < 100; i++)
+		big *= 2;
+	check((double)big == std::ldexp(1.0, 100) && (double)-big == -std::ldexp(1.0, 100), "2^100");
+	// 2^100 + 2^47 + 1 lies just above halfway between two doubles and must round up.
+	Int128 halfway = big + Int128(1LL << 47) + 1;
+	check((double)halfway == std::ldexp(1.0, 100) + std::ldexp(1.0, 48), "rounding");
+#if defined(__SIZEOF_INT128__)
+	compare_with_native();
+#endif
+
+	CentralMoments origin = mu_table(raw_moments(blob(0)));
+	for (int offset : { 1000, 1 << 20, 1 << 28 })
+		check(same_central(origin, mu_table(raw_moments(blob(offset)))), "translated central moments");
+
+	printf("Int128: %d checks failed\n", failures);
+	return failures > 0;
+}
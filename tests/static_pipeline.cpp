@@ -0,0 +1,145 @@
+#include <cstdio>
+#include <random>
+#include <string>
+#include <vector>
+#include <opencv2/core/core.hpp>
+#include <opencv2/highgui/highgui.hpp>
+
+#include "detection.h"
+#include "static_pipeline.h"
+#include "synthetic_image.h"
+
+// Checks detect_logos_static<LogoPipeline>, which LogoDetector runs with the default
+// configuration, against detect_logos with the equivalent runtime arguments: the blue, red and
+// yellow masks, the dilated yellow mask and the logos, for every HSV conversion method the CPU
+// has. Random images, a synthetic image with two logos and the images given are run whole, cropped to widths that are not a
+// multiple of 64 and as column views into a wider image, which are not continuous. Exits with 1
+// when anything differs.
+
+bool same_mask(const BinaryMask& a, const BinaryMask& b)
+{
+	return a.rows == b.rows && a.cols == b.cols && a.storage == b.storage && a.words == b.words;
+}
+
+bool same_box(const Segment& a, const Segment& b)
+{
+	return a.row_min == b.row_min && a.row_max == b.row_max && a.col_min == b.col_min && a.col_max == b.col_max && a.type == b.type;
+}
+
+bool same_segments(const std::vector<Segment>& a, const std::vector<Segment>& b)
+{
+	if (a.size() != b.size())
+		return false;
+	for (size_t i = 0; i < a.size(); i++)
+	{
+		if (!same_box(a[i], b[i]))
+			return false;
+	}
+	return true;
+}
+
+bool same_logos(const std::vector<Logo>& a, const std::vector<Logo>& b)
+{
+	if (a.size() != b.size())
+		return false;
+	for (size_t i = 0; i < a.size(); i++)
+	{
+		if (!(logo_box(a[i]) == logo_box(b[i])) || !same_box(a[i].yellow_segment, b[i].yellow_segment) ||
+			!same_segments(a[i].blue_segments, b[i].blue_segments) || !same_segments(a[i].red_segments, b[i].red_segments))
+			return false;
+	}
+	return true;
+}
+
+// Uniform noise, which hits every band somewhere, with rectangles of band colors on top so the
+// segments and the dilation have something to work on.
+cv::Mat random_image(int rows, int cols, unsigned seed)
+{
+	std::mt19937 random(seed);
+	cv::Mat image(rows, cols, CV_8UC3);
+	for (int i = 0; i < rows; i++)
+	{
+		uchar* row = image.ptr<uchar>(i);
+		for (int j = 0; j < 3 * cols; j++)
+			row[j] = (uchar)random();
+	}
+	const cv::Scalar colors[] = { cv::Scalar(200, 40, 20), cv::Scalar(20, 20, 210), cv::Scalar(30, 220, 230) };
+	for (int r = 0; r < rows * cols / 400; r++)
+	{
+		cv::Rect box(random() % cols, random() % rows, 1 + random() % 24, 1 + random() % 24);
+		image(box & cv::Rect(0, 0, cols, rows)) = colors[random() % 3];
+	}
+	return image;
+}
+
+int failures = 0;
+int cases = 0;
+
+void compare(const std::string& name, const cv::Mat& image, ThreadPool& pool)
+{
+	std::vector<ColorBand> bands = logo_color_bands();
+	FrameBuffers runtime;
+	detect_logos(image, bands, pool, runtime);
+	for (int m = Hsv_Scalar; m <= Hsv_Avx2; m++)
+	{
+		HsvConversionMethod method = (HsvConversionMethod)m;
+		if (!hsv_conversion_supported(method))
+			continue;
+		cases++;
+		FrameBuffers generated;
+		detect_logos_static<LogoPipeline>(image, pool, generated, nullptr, logo_shape_classifier(), method);
+		const char* differs = nullptr;
+		const char* names[] = { "blue", "red", "yellow" };
+		for (int g = 0; g < 3; g++)
+		{
+			if (!differs && !same_mask(runtime.color_bands.masks[band_index(bands, names[g])], generated.color_bands.masks[g]))
+				differs = names[g];
+		}
+		if (!differs && !same_mask(runtime.dilated_yellow, generated.dilated_yellow))
+			differs = "dilated yellow";
+		if (!differs && !same_logos(runtime.logos, generated.logos))
+			differs = "logos";
+		if (differs)
+		{
+			fprintf(stderr, "%s (%d x %d, %scontinuous), HSV method %d: %s differs\n", name.c_str(), image.cols, image.rows, image.isContinuous() ? "" : "not ", m, differs);
+			failures++;
+		}
+	}
+}
+
+// image whole, cropped to a width of the form 64 k + 37 and in a wider image at an odd column.
+void compare_layouts(const std::string& name, const cv::Mat& image, ThreadPool& pool)
+{
+	compare(name, image, pool);
+	int cropped = image.cols >= 101 ? (image.cols - 37) / 64 * 64 + 37 : image.cols;
+	if (cropped != image.cols)
+		compare(name + " cropped", image(cv::Rect(0, 0, cropped, image.rows)), pool);
+	cv::Mat wide(image.rows, image.cols + 70, CV_8UC3, cv::Scalar(30, 220, 230));
+	cv::Mat view = wide(cv::Rect(5, 0, image.cols, image.rows));
+	image.copyTo(view);
+	compare(name + " view", view, pool);
+}
+
+int main(int argc, char** argv)
+{
+	ThreadPool pool(4);
+	const int widths[] = { 1, 7, 63, 64, 65, 100, 127, 129, 300 };
+	unsigned seed = 1;
+	for (int cols : widths)
+	{
+		compare_layouts("random " + std::to_string(cols), random_image(97, cols, seed++), pool);
+	}
+	compare_layouts("synthetic", synthetic_image(1, 1), pool);
+	for (int a = 1; a < argc; a++)
+	{
+		cv::Mat image = cv::imread(argv[a]);
+		if (image.empty())
+		{
+			fprintf(stderr, "%s: cannot read image\n", argv[a]);
+			return 1;
+		}
+		compare_layouts(argv[a], image, pool);
+	}
+	printf("%d cases of %d random, 1 synthetic and %d given images: %d differ\n", cases, (int)(sizeof(widths) / sizeof(widths[0])), argc - 1, failures);
+	return failures > 0;
+}
@@ -0,0 +1,132 @@
+#include <algorithm>
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <string>
+#include <vector>
+#include <opencv2/core/core.hpp>
+#include <opencv2/highgui/highgui.hpp>
+
+#include "detection.h"
+#include "streaming.h"
+#include "synthetic_image.h"
+
+// Checks detect_logos_streaming against detect_logos: each image is written as a binary PPM and
+// streamed in strips of 1, 64 and 100 rows, neither of which divides the 1225 rows of the
+// synthetic image, and of more rows than the image has. The logo boxes must be the ones
+// detect_logos finds. The same file cut off halfway must come back truncated. A synthetic image
+// with six logos and the images given are checked. Exits with 1 when anything differs.
+
+bool write_ppm(const std::string& path, const cv::Mat& image, int rows)
+{
+	std::ofstream file(path, std::ios::binary);
+	file << "P6\n# streaming test\n" << image.cols << " " << image.rows << "\n255\n";
+	std::vector<char> rgb(3 * (size_t)image.cols);
+	for (int i = 0; i < rows; i++)
+	{
+		const uchar* bgr = image.ptr<uchar>(i);
+		for (int j = 0; j < image.cols; j++)
+		{
+			rgb[3 * j] = (char)bgr[3 * j + 2];
+			rgb[3 * j + 1] = (char)bgr[3 * j + 1];
+			rgb[3 * j + 2] = (char)bgr[3 * j];
+		}
+		file.write(rgb.data(), (std::streamsize)rgb.size());
+	}
+	return (bool)file;
+}
+
+bool box_before(const cv::Rect& a, const cv::Rect& b)
+{
+	return a.y < b.y || (a.y == b.y && (a.x < b.x || (a.x == b.x && (a.width < b.width || (a.width == b.width && a.height < b.height)))));
+}
+
+std::vector<cv::Rect> sorted_boxes(std::vector<cv::Rect> boxes)
+{
+	std::sort(boxes.begin(), boxes.end(), box_before);
+	return boxes;
+}
+
+bool same_boxes(const std::vector<cv::Rect>& a, const std::vector<cv::Rect>& b)
+{
+	if (a.size() != b.size())
+		return false;
+	for (size_t i = 0; i < a.size(); i++)
+	{
+		if (!(a[i] == b[i]))
+			return false;
+	}
+	return true;
+}
+
+// False when path cannot be read as a PPM in strips.
+bool stream(const std::string& path, int strip_rows, ThreadPool& pool, std::vector<cv::Rect>& boxes, StreamingReport& report)
+{
+	StripSource source;
+	if (!source.open(path) || !source.streaming())
+		return false;
+	StreamingOptions options;
+	options.strip_rows = strip_rows;
+	report = detect_logos_streaming(source, logo_color_bands(), pool, options, [&](const Logo& logo) { boxes.push_back(logo_box(logo)); });
+	return true;
+}
+
+int failures = 0;
+
+void check(const std::string& name, const cv::Mat& image, ThreadPool& pool)
+{
+	std::vector<cv::Rect> expected;
+	for (const auto& logo : detect_logos(image, logo_color_bands(), pool))
+		expected.push_back(logo_box(logo));
+	expected = sorted_boxes(expected);
+
+	std::string path = (std::filesystem::temp_directory_path() / "logo_streaming_test.ppm").string();
+	if (!write_ppm(path, image, image.rows))
+	{
+		fprintf(stderr, "%s: cannot write %s\n", name.c_str(), path.c_str());
+		failures++;
+		return;
+	}
+	const int heights[] = { 1, 64, 100, image.rows + 50 };
+	for (int strip_rows : heights)
+	{
+		std::vector<cv::Rect> boxes;
+		StreamingReport report;
+		if (!stream(path, strip_rows, pool, boxes, report) || report.truncated || !same_boxes(sorted_boxes(boxes), expected) || report.logos != (int)expected.size())
+		{
+			fprintf(stderr, "%s, strips of %d rows: %d logos streamed, %d found whole%s\n", name.c_str(), strip_rows, (int)boxes.size(), (int)expected.size(), report.truncated ? ", truncated" : "");
+			failures++;
+		}
+	}
+
+	write_ppm(path, image, image.rows / 2);
+	for (int strip_rows : heights)
+	{
+		std::vector<cv::Rect> boxes;
+		StreamingReport report;
+		if (!stream(path, strip_rows, pool, boxes, report) || !report.truncated)
+		{
+			fprintf(stderr, "%s cut off at row %d, strips of %d rows: not reported truncated\n", name.c_str(), image.rows / 2, strip_rows);
+			failures++;
+		}
+	}
+	std::filesystem::remove(path);
+	printf("%s: %d logos\n", name.c_str(), (int)expected.size());
+}
+
+int main(int argc, char** argv)
+{
+	ThreadPool pool(4);
+	check("synthetic", synthetic_image(2, 3), pool);
+	for (int a = 1; a < argc; a++)
+	{
+		cv::Mat image = cv::imread(argv[a]);
+		if (image.empty())
+		{
+			fprintf(stderr, "%s: cannot read image\n", argv[a]);
+			return 1;
+		}
+		check(argv[a], image, pool);
+	}
+	return failures > 0;
+}
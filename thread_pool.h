@@ -0,0 +1,140 @@
+#ifndef THREAD_POOL_H
+#define THREAD_POOL_H
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <exception>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+inline int default_thread_count()
+{
+	unsigned int count = std::thread::hardware_concurrency();
+	return count == 0 ? 1 : (int)count;
+}
+
+// Fixed set of worker threads for data-parallel loops. parallel_for hands out indices from a shared
+// counter; the calling thread works on the loop too and returns once every index is done.
+// The first exception thrown by the body is rethrown in the caller. The body is called through a
+// plain pointer to the caller's callable, so starting a loop does not allocate.
+struct ThreadPool
+{
+	std::vector<std::thread> workers;
+	std::mutex mutex;
+	std::condition_variable wake;
+	std::condition_variable finished;
+	const void* body = nullptr;
+	void (*invoke)(const void*, int) = nullptr;
+	int count = 0;
+	std::atomic<int> next{ 0 };
+	int busy_workers = 0;
+	long long generation = 0;
+	bool stopping = false;
+	std::exception_ptr error;
+
+	explicit ThreadPool(int thread_count = default_thread_count())
+	{
+		for (int i = 1; i < thread_count; i++)
+		{
+			workers.emplace_back([this] { worker_loop(); });
+		}
+	}
+
+	~ThreadPool()
+	{
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			stopping = true;
+		}
+		wake.notify_all();
+		for (auto& worker : workers)
+		{
+			worker.join();
+		}
+	}
+
+	ThreadPool(const ThreadPool&) = delete;
+	ThreadPool& operator=(const ThreadPool&) = delete;
+
+	int size() const
+	{
+		return (int)workers.size() + 1;
+	}
+
+	template <typename Body>
+	void parallel_for(int loop_count, const Body& loop_body)
+	{
+		if (loop_count <= 0)
+			return;
+		if (workers.empty() || loop_count == 1)
+		{
+			for (int i = 0; i < loop_count; i++)
+			{
+				loop_body(i);
+			}
+			return;
+		}
+
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			body = &loop_body;
+			invoke = [](const void* callable, int i) { (*(const Body*)callable)(i); };
+			count = loop_count;
+			next = 0;
+			busy_workers = (int)workers.size();
+			error = nullptr;
+			generation++;
+		}
+		wake.notify_all();
+		run_indices();
+
+		std::unique_lock<std::mutex> lock(mutex);
+		finished.wait(lock, [this] { return busy_workers == 0; });
+		body = nullptr;
+		if (error)
+			std::rethrow_exception(error);
+	}
+
+	void run_indices()
+	{
+		for (int i = next++; i < count; i = next++)
+		{
+			try
+			{
+				invoke(body, i);
+			}
+			catch (...)
+			{
+				std::lock_guard<std::mutex> lock(mutex);
+				if (!error)
+					error = std::current_exception();
+			}
+		}
+	}
+
+	void worker_loop()
+	{
+		long long seen = 0;
+		while (true)
+		{
+			{
+				std::unique_lock<std::mutex> lock(mutex);
+				wake.wait(lock, [&] { return stopping || generation != seen; });
+				if (stopping)
+					return;
+				seen = generation;
+			}
+			run_indices();
+			{
+				std::lock_guard<std::mutex> lock(mutex);
+				busy_workers--;
+			}
+			finished.notify_one();
+		}
+	}
+};
+
+#endif
@@ -0,0 +1,271 @@
+#ifndef TILING_H
+#define TILING_H
+
+#include <algorithm>
+#include <map>
+#include <string>
+#include <vector>
+#include <opencv2/core/core.hpp>
+
+#include "color_bands.h"
+#include "color_lut.h"
+#include "filters.h"
+#include "labeling.h"
+#include "mask.h"
+#include "segments.h"
+#include "thread_pool.h"
+
+// Horizontal bands of whole rows. Bit masks stay word aligned in a band, so tiles never
+// write to the same word and each band streams through memory in order.
+struct RowTile
+{
+	int row_begin;
+	int row_end;
+};
+
+// Splits rows into tiles of about tile_bytes of input (rows of row_bytes each), at least
+// min_rows high, with enough tiles to keep every thread of the pool busy.
+inline void split_row_tiles(int rows, size_t row_bytes, int threads, std::vector<RowTile>& tiles, int min_rows = 1, size_t tile_bytes = 256 * 1024)
+{
+	int tile_rows = (int)std::max<size_t>(1, tile_bytes / std::max<size_t>(1, row_bytes));
+	tile_rows = std::min(tile_rows, std::max(1, rows / (4 * threads)));
+	tile_rows = std::max(tile_rows, min_rows);
+	tiles.clear();
+	for (int row = 0; row < rows; row += tile_rows)
+	{
+		tiles.push_back(RowTile{ row, std::min(rows, row + tile_rows) });
+	}
+}
+
+inline std::vector<RowTile> split_row_tiles(int rows, size_t row_bytes, int threads, int min_rows = 1, size_t tile_bytes = 256 * 1024)
+{
+	std::vector<RowTile> tiles;
+	split_row_tiles(rows, row_bytes, threads, tiles, min_rows, tile_bytes);
+	return tiles;
+}
+
+// Storage of the tiled stages that is kept from one frame to the next. The per-tile vectors only
+// ever grow, so the buffers of a tile survive a frame with fewer tiles.
+struct ColorBandBuffers
+{
+	BandClassifier classifier;
+	std::vector<BinaryMask> masks;
+	std::vector<BinaryMask*> mask_pointers;
+	std::vector<RowTile> tiles;
+	std::vector<BandRowBuffers> rows;
+};
+
+struct FilterBuffers
+{
+	std::vector<RowTile> tiles;
+	std::vector<ExtremumBuffers> tile_buffers;
+};
+
+struct LabelingBuffers
+{
+	std::vector<RowTile> tiles;
+	std::vector<std::vector<LabelRun>> tile_runs;
+	std::vector<std::vector<int>> tile_parents;
+	std::vector<int> parent;
+	std::vector<int> final_label;
+};
+
+template <typename T>
+void grow_to(std::vector<T>& items, size_t count)
+{
+	if (items.size() < count)
+		items.resize(count);
+}
+
+// One mask per band, in the order of bands, into buffers.masks. With a lut compiled from the
+// same bands the pixels are looked up instead of converted to HSV.
+inline void classify_color_bands(const cv::Mat& image, const std::vector<ColorBand>& bands, ThreadPool& pool, ColorBandBuffers& buffers, MaskStorage storage = Mask_Bits, HsvConversionMethod method = best_hsv_conversion_method(), const BgrLut* lut = nullptr)
+{
+	CV_Assert(image.type() == CV_8UC3);
+	CV_Assert(!lut || same_bands(lut->bands, bands));
+	if (!lut)
+		build_band_classifier(bands, buffers.classifier);
+	grow_to(buffers.masks, bands.size());
+	buffers.mask_pointers.clear();
+	for (size_t b = 0; b < bands.size(); b++)
+	{
+		buffers.masks[b].create(image.rows, image.cols, storage);
+		buffers.mask_pointers.push_back(&buffers.masks[b]);
+	}
+	split_row_tiles(image.rows, 3 * (size_t)image.cols, pool.size(), buffers.tiles);
+	grow_to(buffers.rows, buffers.tiles.size());
+	pool.parallel_for((int)buffers.tiles.size(), [&](int t)
+	{
+		if (lut)
+			classify_lut_rows(*lut, image, buffers.tiles[t].row_begin, buffers.tiles[t].row_end, buffers.mask_pointers, buffers.rows[t]);
+		else
+			classify_color_band_rows(buffers.classifier, image, buffers.tiles[t].row_begin, buffers.tiles[t].row_end, buffers.mask_pointers, method, buffers.rows[t]);
+	});
+}
+
+inline std::map<std::string, BinaryMask> classify_color_bands(const cv::Mat& image, const std::vector<ColorBand>& bands, ThreadPool& pool, MaskStorage storage = Mask_Bits, HsvConversionMethod method = best_hsv_conversion_method())
+{
+	CV_Assert(image.type() == CV_8UC3);
+	BandClassifier classifier = build_band_classifier(bands);
+	std::map<std::string, BinaryMask> masks;
+	std::vector<BinaryMask*> band_masks = allocate_band_masks(masks, bands, image.rows, image.cols, storage);
+	std::vector<RowTile> tiles = split_row_tiles(image.rows, 3 * (size_t)image.cols, pool.size());
+	pool.parallel_for((int)tiles.size(), [&](int t)
+	{
+		classify_color_band_rows(classifier, image, tiles[t].row_begin, tiles[t].row_end, band_masks, method);
+	});
+	return masks;
+}
+
+// Each tile reads window_size rows of halo above and below itself from the shared source.
+inline void extremum_filter(const BinaryMask& src, int window_begin, int window_size, int border, FilterType type, ThreadPool& pool, BinaryMask& dst, FilterBuffers& buffers)
+{
+	dst.create(src.rows, src.cols, src.storage);
+	split_row_tiles(src.rows, 8 * (size_t)src.words_per_row, pool.size(), buffers.tiles, 4 * window_size);
+	grow_to(buffers.tile_buffers, buffers.tiles.size());
+	pool.parallel_for((int)buffers.tiles.size(), [&](int t)
+	{
+		extremum_filter_rows(src, dst, buffers.tiles[t].row_begin, buffers.tiles[t].row_end, window_begin, window_size, border, type, buffers.tile_buffers[t]);
+	});
+}
+
+inline BinaryMask extremum_filter(const BinaryMask& src, int window_begin, int window_size, int border, FilterType type, ThreadPool& pool)
+{
+	BinaryMask dst;
+	FilterBuffers buffers;
+	extremum_filter(src, window_begin, window_size, border, type, pool, dst, buffers);
+	return dst;
+}
+
+inline BinaryMask morphology_filter(const BinaryMask& src, int filter_size, int num_iter, FilterType type, ThreadPool& pool)
+{
+	CV_Assert(filter_size >= 1);
+	if (num_iter > 1 && filter_size % 2 == 1)
+	{
+		int radius = num_iter * (filter_size / 2);
+		return extremum_filter(src, -radius, 2 * radius + 1, type == Erosion ? radius : filter_size / 2, type, pool);
+	}
+	BinaryMask result = src;
+	for (int i = 0; i < num_iter; ++i)
+	{
+		result = extremum_filter(result, -(filter_size / 2), filter_size, filter_size / 2, type, pool);
+	}
+	return result;
+}
+
+inline BinaryMask erosion_filter(const BinaryMask& src, int filter_size, int num_iter, ThreadPool& pool)
+{
+	return morphology_filter(src, filter_size, num_iter, Erosion, pool);
+}
+
+inline BinaryMask dilation_filter(const BinaryMask& src, int filter_size, int num_iter, ThreadPool& pool)
+{
+	return morphology_filter(src, filter_size, num_iter, Dilation, pool);
+}
+
+// Single-pass dilation into dst: odd filter sizes merge the iterations into one window, as
+// morphology_filter does; even sizes with several iterations take the allocating path.
+inline void dilation_filter(const BinaryMask& src, int filter_size, int num_iter, ThreadPool& pool, BinaryMask& dst, FilterBuffers& buffers)
+{
+	CV_Assert(filter_size >= 1);
+	if (num_iter < 1 || (filter_size % 2 == 0 && num_iter > 1))
+	{
+		dst = dilation_filter(src, filter_size, num_iter, pool);
+		return;
+	}
+	int radius = num_iter * (filter_size / 2);
+	int window_size = num_iter > 1 ? 2 * radius + 1 : filter_size;
+	extremum_filter(src, num_iter > 1 ? -radius : -(filter_size / 2), window_size, filter_size / 2, Dilation, pool, dst, buffers);
+}
+
+// Every tile runs the first labeling pass on its own rows. The provisional labels of tile t are
+// then offset by the labels of the tiles above it, which keeps them in raster order, and the runs
+// on both sides of each seam are joined. The union-find roots, and so the final labels, are
+// the same as for the single-threaded label_runs.
+inline void label_runs(const BinaryMask& input, ThreadPool& pool, Labeling& labeling, LabelingBuffers& buffers)
+{
+	BinaryMask converted;
+	if (input.storage != Mask_Bits)
+		converted = convert_mask(input, Mask_Bits);
+	const BinaryMask& mask = input.storage == Mask_Bits ? input : converted;
+
+	labeling.runs.clear();
+	labeling.border.create(mask.rows, mask.cols, Mask_Bits);
+	std::vector<RowTile>& tiles = buffers.tiles;
+	split_row_tiles(mask.rows, 8 * (size_t)mask.words_per_row, pool.size(), tiles);
+	grow_to(buffers.tile_runs, tiles.size());
+	grow_to(buffers.tile_parents, tiles.size());
+	std::vector<std::vector<LabelRun>>& tile_runs = buffers.tile_runs;
+	std::vector<std::vector<int>>& tile_parents = buffers.tile_parents;
+	pool.parallel_for((int)tiles.size(), [&](int t)
+	{
+		tile_runs[t].clear();
+		tile_parents[t].clear();
+		label_row_range(mask, tiles[t].row_begin, tiles[t].row_end, tile_runs[t], tile_parents[t], labeling.border);
+	});
+
+	std::vector<int>& parent = buffers.parent;
+	parent.clear();
+	size_t previous_row_begin = 0;
+	for (size_t t = 0; t < tiles.size(); t++)
+	{
+		int label_offset = (int)parent.size();
+		for (int p : tile_parents[t])
+		{
+			parent.push_back(p + label_offset);
+		}
+		size_t tile_begin = labeling.runs.size();
+		for (const auto& run : tile_runs[t])
+		{
+			labeling.runs.push_back(LabelRun{ run.row, run.col_begin, run.col_end, run.label + label_offset });
+		}
+
+		// Runs on the last row of the previous tile against runs on the first row of this one.
+		size_t q = previous_row_begin;
+		size_t previous_row_end = tile_begin;
+		for (size_t r = tile_begin; r < labeling.runs.size() && labeling.runs[r].row == tiles[t].row_begin; r++)
+		{
+			const LabelRun& run = labeling.runs[r];
+			while (q < previous_row_end && labeling.runs[q].col_end <= run.col_begin)
+			{
+				q++;
+			}
+			for (size_t k = q; k < previous_row_end && labeling.runs[k].col_begin < run.col_end; k++)
+			{
+				if (labeling.runs[k].row == tiles[t].row_begin - 1)
+					union_labels(parent, labeling.runs[k].label, run.label);
+			}
+		}
+
+		if (labeling.runs.size() > tile_begin)
+		{
+			int last_row = labeling.runs.back().row;
+			previous_row_begin = labeling.runs.size();
+			while (previous_row_begin > tile_begin && labeling.runs[previous_row_begin - 1].row == last_row)
+			{
+				previous_row_begin--;
+			}
+		}
+		else
+		{
+			previous_row_begin = tile_begin;
+		}
+	}
+
+	resolve_labels(labeling, parent, mask.rows, mask.cols, buffers.final_label);
+}
+
+inline Labeling label_runs(const BinaryMask& input, ThreadPool& pool)
+{
+	Labeling labeling;
+	LabelingBuffers buffers;
+	label_runs(input, pool, labeling, buffers);
+	return labeling;
+}
+
+inline std::vector<Segment> segment_mask(const BinaryMask& mask, ThreadPool& pool)
+{
+	return segments_from_labeling(label_runs(mask, pool));
+}
+
+#endif
@@ -0,0 +1,26 @@
+#ifndef TIMING_H
+#define TIMING_H
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <vector>
+
+typedef std::chrono::steady_clock Clock;
+
+inline double elapsed_ms(Clock::time_point start, Clock::time_point end)
+{
+	return std::chrono::duration<double, std::milli>(end - start).count();
+}
+
+// Nearest-rank percentile of unsorted values.
+inline double percentile(std::vector<double> values, double p)
+{
+	if (values.empty())
+		return 0;
+	std::sort(values.begin(), values.end());
+	size_t rank = (size_t)std::ceil(p / 100.0 * values.size());
+	return values[std::min(values.size() - 1, rank == 0 ? 0 : rank - 1)];
+}
+
+#endif
@@ -0,0 +1,194 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <algorithm>
+#include <cstdio>
+#include <map>
+#include <mutex>
+#include <ostream>
+#include <set>
+#include <string>
+#include <vector>
+
+#include "detections_output.h"
+#include "timing.h"
+
+// Stage spans and counters recorded while one image goes through the pipeline. Nothing is
+// recorded unless a FrameTrace is handed in, and building with LOGO_NO_TRACE defined removes the
+// recording code, so the pipeline compiles as if no trace was ever given.
+struct TraceSpan
+{
+	const char* name;
+	Clock::time_point start;
+	Clock::time_point end;
+};
+
+// A counter is known by the address of its name, as a span is: a string literal, or for names
+// made at run time the pointer trace_counter_name returns, looked up once when the name is made.
+struct TraceCounter
+{
+	const char* name;
+	long long value;
+};
+
+// Keeps name for the life of the program and returns the same pointer for every equal name.
+inline const char* trace_counter_name(const std::string& name)
+{
+	static std::mutex mutex;
+	static std::set<std::string> names;
+	std::lock_guard<std::mutex> lock(mutex);
+	return names.insert(name).first->c_str();
+}
+
+struct FrameTrace
+{
+	std::string image;
+	int thread = 0;
+	std::vector<TraceSpan> spans;
+	std::vector<TraceCounter> counters;
+
+	// Adds value to the counter called name, so passes over several regions of an image sum up.
+	void count(const char* name, long long value)
+	{
+		for (auto& counter : counters)
+		{
+			if (counter.name == name)
+			{
+				counter.value += value;
+				return;
+			}
+		}
+		counters.push_back(TraceCounter{ name, value });
+	}
+};
+
+#ifdef LOGO_NO_TRACE
+const bool trace_enabled = false;
+#else
+const bool trace_enabled = true;
+#endif
+
+inline bool tracing(const FrameTrace* trace)
+{
+	return trace_enabled && trace != nullptr;
+}
+
+// Records the lifetime of the scope as a span of trace.
+struct TraceScope
+{
+	FrameTrace* trace;
+	const char* name;
+	Clock::time_point start;
+
+	TraceScope(FrameTrace* scope_trace, const char* scope_name)
+		: trace(tracing(scope_trace) ? scope_trace : nullptr), name(scope_name)
+	{
+		if (trace)
+			start = Clock::now();
+	}
+
+	~TraceScope()
+	{
+		if (trace)
+			trace->spans.push_back(TraceSpan{ name, start, Clock::now() });
+	}
+
+	TraceScope(const TraceScope&) = delete;
+	TraceScope& operator=(const TraceScope&) = delete;
+};
+
+inline Clock::time_point trace_begin(const FrameTrace& trace)
+{
+	Clock::time_point begin = trace.spans.empty() ? Clock::time_point() : trace.spans[0].start;
+	for (const auto& span : trace.spans)
+		begin = std::min(begin, span.start);
+	return begin;
+}
+
+inline Clock::time_point trace_end(const FrameTrace& trace)
+{
+	Clock::time_point end = trace.spans.empty() ? Clock::time_point() : trace.spans[0].end;
+	for (const auto& span : trace.spans)
+		end = std::max(end, span.end);
+	return end;
+}
+
+// Chrome trace event format, which chrome://tracing and Perfetto open. Every image becomes an
+// "image" event on the track of the thread that ran it, carrying the counters as arguments, with
+// its stage spans nested inside. Times are microseconds since origin.
+inline void write_chrome_trace(std::ostream& out, const std::vector<FrameTrace>& traces, Clock::time_point origin)
+{
+	auto microseconds = [&](Clock::time_point time) { return elapsed_ms(origin, time) * 1000; };
+	out << "{ \"traceEvents\": [\n";
+	bool first = true;
+	for (const auto& trace : traces)
+	{
+		if (trace.spans.empty())
+			continue;
+		Clock::time_point begin = trace_begin(trace);
+		out << (first ? "" : ",\n") << "  { \"name\": \"image\", \"ph\": \"X\", \"pid\": 1, \"tid\": " << trace.thread
+			<< ", \"ts\": " << microseconds(begin) << ", \"dur\": " << elapsed_ms(begin, trace_end(trace)) * 1000
+			<< ", \"args\": { \"image\": \"" << json_escape(trace.image) << "\"";
+		for (const auto& counter : trace.counters)
+			out << ", \"" << json_escape(counter.name) << "\": " << counter.value;
+		out << " } }";
+		first = false;
+		for (const auto& span : trace.spans)
+		{
+			out << ",\n  { \"name\": \"" << json_escape(span.name) << "\", \"ph\": \"X\", \"pid\": 1, \"tid\": " << trace.thread
+				<< ", \"ts\": " << microseconds(span.start) << ", \"dur\": " << elapsed_ms(span.start, span.end) * 1000 << " }";
+		}
+	}
+	out << "\n], \"displayTimeUnit\": \"ms\" }\n";
+}
+
+// Per stage the image count and the p50 / p95 / max of its time per image, per counter the total
+// and the largest value of one image, and the slowest image.
+inline void print_trace_summary(const std::vector<FrameTrace>& traces)
+{
+	std::vector<const char*> stage_names;
+	std::map<std::string, std::vector<double>> stage_ms;
+	std::vector<std::string> counter_names;
+	std::map<std::string, long long> counter_total;
+	std::map<std::string, long long> counter_max;
+	const FrameTrace* slowest = nullptr;
+	double slowest_ms = -1;
+	for (const auto& trace : traces)
+	{
+		std::map<std::string, double> image_ms;
+		for (const auto& span : trace.spans)
+		{
+			if (!stage_ms.count(span.name) && !image_ms.count(span.name))
+				stage_names.push_back(span.name);
+			image_ms[span.name] += elapsed_ms(span.start, span.end);
+		}
+		for (const auto& stage : image_ms)
+			stage_ms[stage.first].push_back(stage.second);
+		for (const auto& counter : trace.counters)
+		{
+			if (!counter_total.count(counter.name))
+				counter_names.push_back(counter.name);
+			counter_total[counter.name] += counter.value;
+			counter_max[counter.name] = std::max(counter_max[counter.name], counter.value);
+		}
+		double total = elapsed_ms(trace_begin(trace), trace_end(trace));
+		if (!trace.spans.empty() && total > slowest_ms)
+		{
+			slowest = &trace;
+			slowest_ms = total;
+		}
+	}
+
+	printf("trace of %zu images\n", traces.size());
+	for (const char* name : stage_names)
+	{
+		const std::vector<double>& ms = stage_ms[name];
+		printf("  %-24s %6zu images, ms p50 %.2f p95 %.2f max %.2f\n", name, ms.size(), percentile(ms, 50), percentile(ms, 95), percentile(ms, 100));
+	}
+	for (const std::string& name : counter_names)
+		printf("  %-36s total %lld, max per image %lld\n", name.c_str(), counter_total[name], counter_max[name]);
+	if (slowest)
+		printf("  slowest image %s: %.2f ms\n", slowest->image.c_str(), slowest_ms);
+}
+
+#endif
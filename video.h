@@ -0,0 +1,333 @@
+#ifndef VIDEO_H
+#define VIDEO_H
+
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <cstdio>
+#include <filesystem>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include <opencv2/core/core.hpp>
+#include <opencv2/videoio/videoio.hpp>
+
+#include "batch.h"
+#include "bounding_boxes.h"
+#include "detection.h"
+#include "logo.h"
+#include "thread_pool.h"
+#include "timing.h"
+
+// Full-frame detection runs every keyframe_interval frames. In between only padded boxes around
+// the tracked logos and one of scan_slices horizontal bands of the frame are searched, so logos
+// entering the picture are found within scan_slices frames. Bands overlap by slice_overlap rows
+// on each side, enough for a logo up to twice that height to fit inside the band holding its
+// centre. With realtime set, frames are read at the source frame rate and a frame still waiting
+// when the next one is decoded is dropped; otherwise every frame is processed. Every
+// verify_interval frames (0 = never) the ROI result is checked against full-frame detection.
+struct VideoOptions
+{
+	std::string input;
+	std::string output_dir = "out";
+	int threads = default_thread_count();
+	int keyframe_interval = 30;
+	int scan_slices = 8;
+	int slice_overlap = 256;
+	double roi_padding = 0.5;
+	int max_misses = 5;
+	bool realtime = false;
+	int verify_interval = 0;
+	ShapeClassifier classifier = logo_shape_classifier();
+	std::shared_ptr<const BgrLut> lut;
+};
+
+struct VideoReport
+{
+	int frames_read = 0;
+	int frames_processed = 0;
+	int frames_dropped = 0;
+	int keyframes = 0;
+	int logos = 0;
+	int verified_frames = 0;
+	int inconsistent_frames = 0;
+	int missed_logos = 0;
+	int extra_logos = 0;
+	double source_fps = 0;
+	double seconds = 0;
+	double searched_fraction = 0;
+	std::vector<double> frame_ms;
+	CascadeStats cascade;
+};
+
+// Hand-over of decoded frames from the reader thread. With overwrite set, put replaces a frame
+// that was not taken yet and counts it as dropped; otherwise it waits until the slot is free.
+struct FrameMailbox
+{
+	std::mutex mutex;
+	std::condition_variable changed;
+	cv::Mat frame;
+	int index = 0;
+	bool full = false;
+	bool closed = false;
+	int dropped = 0;
+
+	void put(const cv::Mat& new_frame, int new_index, bool overwrite)
+	{
+		std::unique_lock<std::mutex> lock(mutex);
+		if (!overwrite)
+			changed.wait(lock, [this] { return !full; });
+		else if (full)
+			dropped++;
+		frame = new_frame;
+		index = new_index;
+		full = true;
+		changed.notify_all();
+	}
+
+	void close()
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		closed = true;
+		changed.notify_all();
+	}
+
+	bool take(cv::Mat& taken, int& taken_index)
+	{
+		std::unique_lock<std::mutex> lock(mutex);
+		changed.wait(lock, [this] { return full || closed; });
+		if (!full)
+			return false;
+		taken = frame;
+		taken_index = index;
+		frame = cv::Mat();
+		full = false;
+		changed.notify_all();
+		return true;
+	}
+};
+
+struct LogoTrack
+{
+	int id;
+	cv::Rect box;
+	int row_velocity = 0;
+	int col_velocity = 0;
+	int misses = 0;
+};
+
+inline double box_overlap(const cv::Rect& a, const cv::Rect& b)
+{
+	double intersection = (a & b).area();
+	double united = (double)a.area() + b.area() - intersection;
+	return united > 0 ? intersection / united : 0;
+}
+
+// Padded box around where a track is expected in the next frame, clipped to the frame.
+inline cv::Rect track_roi(const LogoTrack& track, double padding, const cv::Rect& frame)
+{
+	int pad = (int)(padding * std::max(track.box.width, track.box.height)) + std::abs(track.row_velocity) + std::abs(track.col_velocity);
+	cv::Rect predicted(track.box.x + track.col_velocity - pad, track.box.y + track.row_velocity - pad, track.box.width + 2 * pad, track.box.height + 2 * pad);
+	return predicted & frame;
+}
+
+inline cv::Rect scan_slice(int slice, int slices, int overlap, const cv::Rect& frame)
+{
+	int height = (frame.height + slices - 1) / slices;
+	int begin = std::max(0, slice * height - overlap);
+	int end = std::min(frame.height, (slice + 1) * height + overlap);
+	return end > begin ? cv::Rect(0, begin, frame.width, end - begin) : cv::Rect();
+}
+
+// Greedy matching of detections to tracks by box overlap. Matched tracks take the new box and
+// its displacement as velocity, the others age and are dropped after max_misses frames.
+inline void update_tracks(std::vector<LogoTrack>& tracks, const std::vector<Logo>& logos, int max_misses, int& next_id)
+{
+	std::vector<bool> matched_track(tracks.size(), false);
+	for (const auto& logo : logos)
+	{
+		cv::Rect box = logo_box(logo);
+		int best = -1;
+		double best_overlap = 0;
+		for (size_t t = 0; t < tracks.size(); t++)
+		{
+			cv::Rect predicted(tracks[t].box.x + tracks[t].col_velocity, tracks[t].box.y + tracks[t].row_velocity, tracks[t].box.width, tracks[t].box.height);
+			double overlap = box_overlap(predicted, box);
+			if (!matched_track[t] && overlap > best_overlap)
+			{
+				best = (int)t;
+				best_overlap = overlap;
+			}
+		}
+		if (best < 0)
+		{
+			tracks.push_back(LogoTrack{ next_id++, box });
+			matched_track.push_back(true);
+			continue;
+		}
+		LogoTrack& track = tracks[best];
+		track.row_velocity = box.y - track.box.y;
+		track.col_velocity = box.x - track.box.x;
+		track.box = box;
+		track.misses = 0;
+		matched_track[best] = true;
+	}
+	for (size_t t = 0; t < tracks.size(); t++)
+	{
+		if (!matched_track[t])
+			tracks[t].misses++;
+	}
+	tracks.erase(std::remove_if(tracks.begin(), tracks.end(), [&](const LogoTrack& track) { return track.misses > max_misses; }), tracks.end());
+}
+
+// Number of logos in a without a logo with the same box in b.
+inline int count_unmatched_logos(const std::vector<Logo>& a, const std::vector<Logo>& b)
+{
+	std::vector<bool> used(b.size(), false);
+	int unmatched = 0;
+	for (const auto& logo : a)
+	{
+		bool found = false;
+		for (size_t k = 0; k < b.size() && !found; k++)
+		{
+			if (!used[k] && logo_box(logo) == logo_box(b[k]))
+			{
+				used[k] = true;
+				found = true;
+			}
+		}
+		if (!found)
+			unmatched++;
+	}
+	return unmatched;
+}
+
+inline void print_video_report(const VideoReport& report)
+{
+	printf("%d frames read, %d processed (%d keyframes), %d dropped, %d logo detections in %.2f s\n", report.frames_read,
+		report.frames_processed, report.keyframes, report.frames_dropped, report.logos, report.seconds);
+	printf("sustained %.2f frames/s (source %.2f), %.1f%% of the pixels searched per frame\n",
+		report.seconds > 0 ? report.frames_processed / report.seconds : 0.0, report.source_fps, 100 * report.searched_fraction);
+	printf("frame ms p50 %.2f p95 %.2f p99 %.2f\n", percentile(report.frame_ms, 50), percentile(report.frame_ms, 95), percentile(report.frame_ms, 99));
+	if (report.verified_frames > 0)
+		printf("%d of %d verified frames differ from full-frame detection: %d logos missed, %d extra\n", report.inconsistent_frames,
+			report.verified_frames, report.missed_logos, report.extra_logos);
+	print_cascade_stats(report.cascade);
+}
+
+// Decodes options.input on a reader thread and detects logos frame by frame on the calling
+// thread. The annotated frames are written to output_dir/<name>.avi when output_dir is set.
+inline VideoReport run_video(const VideoOptions& options)
+{
+	VideoReport report;
+	cv::VideoCapture capture(options.input);
+	if (!capture.isOpened())
+	{
+		fprintf(stderr, "%s: cannot open video\n", options.input.c_str());
+		return report;
+	}
+	report.source_fps = capture.get(cv::CAP_PROP_FPS);
+	double pace_fps = report.source_fps > 0 ? report.source_fps : 30;
+
+	ThreadPool pool(std::max(1, options.threads));
+	FrameBuffers buffers;
+	buffers.lut = options.lut.get();
+	std::vector<ColorBand> bands = logo_color_bands();
+	cv::VideoWriter writer;
+	std::string output_path;
+	if (!options.output_dir.empty())
+	{
+		std::filesystem::create_directories(options.output_dir);
+		output_path = (std::filesystem::path(options.output_dir) / std::filesystem::path(options.input).stem()).string() + ".avi";
+	}
+
+	FrameMailbox mailbox;
+	auto start = Clock::now();
+	std::thread reader([&]
+	{
+		cv::Mat frame;
+		for (int index = 0; capture.read(frame); index++)
+		{
+			if (options.realtime)
+				std::this_thread::sleep_until(start + std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(index / pace_fps)));
+			mailbox.put(frame.clone(), index, options.realtime);
+			report.frames_read = index + 1;
+		}
+		mailbox.close();
+	});
+
+	std::vector<LogoTrack> tracks;
+	int next_id = 0;
+	int frames_since_keyframe = options.keyframe_interval;
+	int slice = 0;
+	double searched = 0;
+	cv::Mat frame;
+	int index = 0;
+	std::vector<Logo> logos;
+	while (mailbox.take(frame, index))
+	{
+		auto frame_start = Clock::now();
+		cv::Rect whole(0, 0, frame.cols, frame.rows);
+		logos.clear();
+		if (frames_since_keyframe >= options.keyframe_interval)
+		{
+			logos = detect_logos(frame, bands, pool, buffers, &report.cascade, options.classifier);
+			frames_since_keyframe = 0;
+			report.keyframes++;
+			searched += 1;
+		}
+		else
+		{
+			std::vector<cv::Rect> regions;
+			for (const auto& track : tracks)
+			{
+				regions.push_back(track_roi(track, options.roi_padding, whole));
+			}
+			regions.push_back(scan_slice(slice, std::max(1, options.scan_slices), options.slice_overlap, whole));
+			slice = (slice + 1) % std::max(1, options.scan_slices);
+			double area = 0;
+			for (const auto& region : merge_regions(regions))
+			{
+				const std::vector<Logo>& found = detect_logos_in_region(frame, region, bands, pool, buffers, &report.cascade, options.classifier);
+				logos.insert(logos.end(), found.begin(), found.end());
+				area += region.area();
+			}
+			searched += area / whole.area();
+		}
+		frames_since_keyframe++;
+		update_tracks(tracks, logos, options.max_misses, next_id);
+		report.frame_ms.push_back(elapsed_ms(frame_start, Clock::now()));
+		report.frames_processed++;
+		report.logos += (int)logos.size();
+
+		if (options.verify_interval > 0 && index % options.verify_interval == 0)
+		{
+			report.verified_frames++;
+			std::vector<Logo> full_frame = detect_logos(frame, bands, pool, buffers, nullptr, options.classifier);
+			int missed = count_unmatched_logos(full_frame, logos);
+			int extra = count_unmatched_logos(logos, full_frame);
+			report.missed_logos += missed;
+			report.extra_logos += extra;
+			if (missed + extra > 0)
+				report.inconsistent_frames++;
+		}
+
+		if (!output_path.empty())
+		{
+			if (!writer.isOpened())
+				writer = cv::VideoWriter(output_path, cv::VideoWriter::fourcc('M', 'J', 'P', 'G'), pace_fps, cv::Size(frame.cols, frame.rows));
+			draw_bounding_boxes_for_logos_in_place(frame, logos);
+			writer.write(frame);
+		}
+	}
+	reader.join();
+
+	report.seconds = elapsed_ms(start, Clock::now()) / 1000;
+	report.frames_dropped = mailbox.dropped;
+	report.searched_fraction = report.frames_processed > 0 ? searched / report.frames_processed : 0;
+	return report;
+}
+
+#endif